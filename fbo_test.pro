@@ -22,7 +22,7 @@ INCLUDEPATH += $$PWD/include
 LIBS += -L$$PWD/lib
 
 unix:{
-    LIBS += -lglfw -lGL -lGLEW
+    LIBS += -lglfw -lGL -lGLEW -lpthread
 }
 win32:{
     LIBS += -lglfw3dll -lopengl32 -lglew32dll
@@ -31,25 +31,70 @@ win32:{
 }
 
 SOURCES += \
+    src/core/cpu_features.cpp \
+    src/core/job_system.cpp \
+    src/core/parallel.cpp \
     src/input/input.cpp \
     src/input/inputglfw.cpp \
     src/main.cpp \
+    src/render/aabb_batch.cpp \
+    src/render/bvh.cpp \
+    src/render/dynamic_batch.cpp \
+    src/render/frustum.cpp \
+    src/render/mesh_bvh.cpp \
+    src/render/occlusion_culler.cpp \
+    src/render/occlusion_queries.cpp \
+    src/render/pixel_upload_ring.cpp \
+    src/render/readback_ring.cpp \
     src/render/renderer.cpp \
+    src/render/scene_picker.cpp \
+    src/render/static_batch.cpp \
     src/render/texture.cpp \
+    src/render/texture_loader.cpp \
+    src/render/texture_streamer.cpp \
+    src/render/typed_vertex_buffer.cpp \
+    src/render/upload_scheduler.cpp \
     src/render/vertex_buffer.cpp \
+    src/render/vertex_transform.cpp \
+    src/res/dds.cpp \
     src/res/imagedata.cpp \
+    src/res/mapped_file.cpp \
+    src/res/pixel_convert.cpp \
+    src/res/tga_stream.cpp \
     src/window.cpp
 
 HEADERS += \
+    src/core/cpu_features.h \
+    src/core/job_system.h \
+    src/core/parallel.h \
     src/input/input.h \
     src/input/inputglfw.h \
     src/input/key_codes.h \
     src/render/AABB.h \
+    src/render/aabb_batch.h \
     src/render/render_states.h \
+    src/render/bvh.h \
+    src/render/dynamic_batch.h \
+    src/render/frustum.h \
+    src/render/mesh_bvh.h \
+    src/render/occlusion_culler.h \
+    src/render/occlusion_queries.h \
+    src/render/pixel_upload_ring.h \
+    src/render/readback_ring.h \
     src/render/renderer.h \
+    src/render/scene_picker.h \
+    src/render/static_batch.h \
     src/render/texture.h \
+    src/render/texture_loader.h \
+    src/render/texture_streamer.h \
+    src/render/typed_vertex_buffer.h \
+    src/render/upload_scheduler.h \
     src/render/vertex_buffer.h \
+    src/render/vertex_transform.h \
     src/res/imagedata.h \
+    src/res/mapped_file.h \
+    src/res/pixel_convert.h \
+    src/res/tga_stream.h \
     src/scene_data.h \
     src/window.h
 
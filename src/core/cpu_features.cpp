@@ -0,0 +1,20 @@
+#include "cpu_features.h"
+
+CpuFeatures const & GetCpuFeatures()
+{
+    static CpuFeatures const features = [] {
+        CpuFeatures f;
+#ifdef CPU_X86_DISPATCH
+        __builtin_cpu_init();
+        f.sse2  = __builtin_cpu_supports("sse2");
+        f.ssse3 = __builtin_cpu_supports("ssse3");
+        f.sse41 = __builtin_cpu_supports("sse4.1");
+        f.avx   = __builtin_cpu_supports("avx");
+        f.avx2  = __builtin_cpu_supports("avx2");
+        f.fma   = __builtin_cpu_supports("fma");
+#endif
+        return f;
+    }();
+
+    return features;
+}
@@ -0,0 +1,31 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// Runtime CPU dispatch support.
+// Kernels for wider instruction sets are compiled with per-function target attributes, so the
+// project itself is still built for the baseline (SSE2 on x86-64) and the best kernel is
+// selected at run time. A target only names the sets its dispatch checks: with "fma" in the target
+// GCC may fuse separate mul/add intrinsics, which faults on AVX2 CPUs without FMA.
+#if(defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#    define CPU_X86_DISPATCH    1
+#    define CPU_TARGET_SSSE3    __attribute__((target("ssse3")))
+#    define CPU_TARGET_SSE41    __attribute__((target("sse4.1")))
+#    define CPU_TARGET_AVX      __attribute__((target("avx")))
+#    define CPU_TARGET_AVX2     __attribute__((target("avx2")))
+#    define CPU_TARGET_AVX2_FMA __attribute__((target("avx2,fma")))   // dispatch on avx2 && fma
+#endif
+
+struct CpuFeatures
+{
+    bool sse2  = false;
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool avx   = false;
+    bool avx2  = false;
+    bool fma   = false;
+};
+
+// detected once, thread safe
+CpuFeatures const & GetCpuFeatures();
+
+#endif   // CPU_FEATURES_H
@@ -0,0 +1,339 @@
+#include "job_system.h"
+#include <assert.h>
+#include <algorithm>
+
+namespace
+{
+uint32_t const g_chunks_per_thread = 4;   // more chunks than threads, so stealing can even out the load
+uint32_t const g_invalid_index     = ~0u;
+
+thread_local JobSystem const * t_system = nullptr;
+thread_local uint32_t          t_index  = g_invalid_index;
+
+uint32_t NextRandom(uint32_t & state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+}   // namespace
+
+// Chase-Lev deque with the memory orders of Le et al., "Correct and Efficient Work-Stealing for Weak
+// Memory Models". The buffer doesn't grow, a full deque makes run() execute the job inline.
+bool JobSystem::WorkStealingDeque::push(Job * job)
+{
+    int64_t const bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t const top    = m_top.load(std::memory_order_acquire);
+    if(bottom - top >= static_cast<int64_t>(job_pool_size))
+        return false;
+
+    m_buffer[bottom & mask].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+    return true;
+}
+
+Job * JobSystem::WorkStealingDeque::pop()
+{
+    int64_t const bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if(top > bottom)
+    {
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);   // empty
+        return nullptr;
+    }
+
+    Job * job = m_buffer[bottom & mask].load(std::memory_order_relaxed);
+    if(top == bottom)
+    {
+        // last job, race against the thieves
+        if(!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+Job * JobSystem::WorkStealingDeque::steal()
+{
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t const bottom = m_bottom.load(std::memory_order_acquire);
+    if(top >= bottom)
+        return nullptr;
+
+    Job * job = m_buffer[top & mask].load(std::memory_order_relaxed);
+    if(!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;   // lost to the owner or another thief
+
+    return job;
+}
+
+JobSystem::JobSystem(uint32_t num_workers)
+{
+    assert(t_system == nullptr);
+
+    m_threads.resize(num_workers + 1);
+    for(uint32_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads[i]            = std::make_unique<ThreadData>();
+        m_threads[i]->rng_state = 0x9e3779b9u * (i + 1);
+    }
+
+    t_system = this;
+    t_index  = 0;
+
+    for(uint32_t i = 1; i < m_threads.size(); ++i)
+        m_threads[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+    m_io_thread = std::thread(&JobSystem::ioLoop, this);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_stop.store(true);
+    }
+    m_wake.notify_all();
+
+    // the I/O functions still queued are dropped, their owners wait for the ones they need
+    {
+        std::lock_guard<std::mutex> lock(m_io_mutex);
+        m_io_stop = true;
+    }
+    m_io_wake.notify_one();
+    m_io_thread.join();
+
+    for(auto & td : m_threads)
+    {
+        if(td->thread.joinable())
+            td->thread.join();
+    }
+
+    if(t_system == this)
+    {
+        t_system = nullptr;
+        t_index  = g_invalid_index;
+    }
+}
+
+bool JobSystem::isMainThread() const
+{
+    return t_system == this && t_index == 0;
+}
+
+bool JobSystem::isSystemThread() const
+{
+    return t_system == this;
+}
+
+Job * JobSystem::create(std::function<void()> func, Job * parent)
+{
+    assert(isSystemThread());
+
+    ThreadData & td  = *m_threads[t_index];
+    Job *        job = &td.pool[td.next_job++ % job_pool_size];
+    assert(isFinished(job));   // the ring wrapped around a job still in flight
+
+    job->func   = std::move(func);
+    job->parent = parent;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    if(parent != nullptr)
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+
+    return job;
+}
+
+void JobSystem::run(Job * job)
+{
+    assert(isSystemThread());
+
+    if(!m_threads[t_index]->deque.push(job))
+    {
+        execute(job);
+        return;
+    }
+
+    m_num_queued.fetch_add(1, std::memory_order_release);
+    wakeOne();
+}
+
+void JobSystem::runOnMainThread(Job * job)
+{
+    std::lock_guard<std::mutex> lock(m_main_mutex);
+    m_main_jobs.push_back(job);
+    m_num_main_jobs.fetch_add(1, std::memory_order_release);
+}
+
+void JobSystem::runIO(std::function<void()> func)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_io_mutex);
+        m_io_jobs.push_back(std::move(func));
+    }
+    m_io_wake.notify_one();
+}
+
+void JobSystem::wait(Job const * job)
+{
+    assert(isSystemThread());
+
+    bool const main_thread = isMainThread();
+    while(!isFinished(job))
+    {
+        // results handed to the main thread (uploads) go first, so they don't wait behind the workload
+        if(main_thread && m_num_main_jobs.load(std::memory_order_acquire) > 0)
+            processMainThreadJobs();
+        else if(Job * next = getJob(t_index))
+            execute(next);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::processMainThreadJobs()
+{
+    assert(isMainThread());
+
+    std::vector<Job *> jobs;
+    {
+        std::lock_guard<std::mutex> lock(m_main_mutex);
+        jobs.swap(m_main_jobs);
+        m_num_main_jobs.store(0, std::memory_order_relaxed);
+    }
+
+    for(Job * job : jobs)
+        execute(job);
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t grain, RangeFunc const & func)
+{
+    if(count == 0)
+        return;
+
+    grain = std::max(grain, 1u);
+    uint32_t const num_chunks = std::min((count + grain - 1) / grain, getNumThreads() * g_chunks_per_thread);
+    if(num_chunks <= 1 || getNumThreads() == 1 || !isSystemThread())
+    {
+        func(0, count);
+        return;
+    }
+
+    uint32_t const chunk_size = (count + num_chunks - 1) / num_chunks;
+
+    Job * root = create(nullptr);
+    for(uint32_t begin = 0; begin < count; begin += chunk_size)
+    {
+        uint32_t const end = std::min(begin + chunk_size, count);
+        run(create([&func, begin, end] { func(begin, end); }, root));
+    }
+
+    run(root);
+    wait(root);
+}
+
+void JobSystem::workerLoop(uint32_t index)
+{
+    t_system = this;
+    t_index  = index;
+
+    while(!m_stop.load(std::memory_order_relaxed))
+    {
+        if(Job * job = getJob(index))
+        {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_wake.wait(lock, [this] {
+            return m_stop.load(std::memory_order_relaxed) || m_num_queued.load(std::memory_order_acquire) > 0;
+        });
+    }
+}
+
+void JobSystem::ioLoop()
+{
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+    for(;;)
+    {
+        m_io_wake.wait(lock, [this] { return m_io_stop || !m_io_jobs.empty(); });
+        if(m_io_stop)
+            break;
+
+        std::function<void()> func = std::move(m_io_jobs.front());
+        m_io_jobs.pop_front();
+
+        lock.unlock();
+        func();
+        func = nullptr;   // the captures are released outside the lock too
+        lock.lock();
+    }
+}
+
+Job * JobSystem::getJob(uint32_t index)
+{
+    ThreadData & td  = *m_threads[index];
+    Job *        job = td.deque.pop();
+
+    if(job == nullptr)
+    {
+        auto const     num_threads = static_cast<uint32_t>(m_threads.size());
+        uint32_t const first       = NextRandom(td.rng_state) % num_threads;
+        for(uint32_t i = 0; i < num_threads && job == nullptr; ++i)
+        {
+            uint32_t const victim = (first + i) % num_threads;
+            if(victim != index)
+                job = m_threads[victim]->deque.steal();
+        }
+    }
+
+    if(job != nullptr)
+        m_num_queued.fetch_sub(1, std::memory_order_relaxed);
+
+    return job;
+}
+
+void JobSystem::execute(Job * job)
+{
+    if(job->func)
+    {
+        job->func();
+        job->func = nullptr;   // releases the captures now, not when the slot is reused
+    }
+    finish(job);
+}
+
+void JobSystem::finish(Job * job)
+{
+    // the parent is read first, a finished job may be reused by its thread at any time
+    while(job != nullptr)
+    {
+        Job * parent = job->parent;
+        if(job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            break;
+        job = parent;
+    }
+}
+
+void JobSystem::wakeOne()
+{
+    // taking the lock orders the count increment before a sleeper's predicate check, no lost wake up
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+    }
+    m_wake.notify_one();
+}
+
+JobSystem & GetJobSystem()
+{
+    static JobSystem system(std::max(1u, std::thread::hardware_concurrency()) - 1);
+
+    return system;
+}
@@ -0,0 +1,127 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Unit of work, created by JobSystem::create()
+/*!
+    A job is finished when its function and all its children are done. Jobs live in a ring
+    buffer of the thread that created them: a pointer stays valid until that thread has
+    created job_pool_size more jobs.
+*/
+struct alignas(64) Job
+{
+    std::function<void()> func;
+    Job *                 parent = nullptr;
+    std::atomic<int32_t>  unfinished{0};   // itself + unfinished children
+};
+
+//! Work stealing job scheduler
+/*!
+    Every thread (the main thread that creates the system and the workers) owns a Chase-Lev
+    deque: the owner pushes and pops at the bottom, idle threads steal from the top, so the
+    threads stay busy without a shared queue. Waiting threads run other jobs instead of blocking.
+    Jobs that must run on the main thread (GL calls) go to a separate queue drained by
+    processMainThreadJobs() and by wait() on the main thread. Blocking reads go to an I/O thread of
+    their own, so they never hold up the workers a frame is waiting for.
+*/
+class JobSystem
+{
+public:
+    constexpr static uint32_t job_pool_size = 4096;   // per thread, also the deque capacity
+
+    using RangeFunc = std::function<void(uint32_t begin, uint32_t end)>;
+
+    //! The calling thread becomes the main thread, num_workers threads are started
+    explicit JobSystem(uint32_t num_workers);
+    ~JobSystem();
+
+    JobSystem(JobSystem const &)             = delete;
+    JobSystem & operator=(JobSystem const &) = delete;
+
+    //! Only threads of the system create jobs; a parent isn't finished before its children
+    Job * create(std::function<void()> func, Job * parent = nullptr);
+    void  run(Job * job);
+    void  runOnMainThread(Job * job);
+    //! Runs other jobs until the job is finished, the main thread takes its own queue first
+    void  wait(Job const * job);
+    bool  isFinished(Job const * job) const { return job->unfinished.load(std::memory_order_acquire) == 0; }
+
+    //! Runs the queued main thread jobs, call once per frame on the main thread
+    void processMainThreadJobs();
+    /*! Runs the function on the I/O thread, one at a time in submission order; any thread may call it.
+        Takes a function rather than a job, a slow read may outlive the job ring of its creator.
+    */
+    void runIO(std::function<void()> func);
+
+    /*! Splits [0, count) into chunks of at least 'grain' items and runs them as jobs, the calling
+        thread takes part in the work. Runs inline for small ranges and threads outside the system.
+    */
+    void parallelFor(uint32_t count, uint32_t grain, RangeFunc const & func);
+
+    uint32_t getNumThreads() const { return static_cast<uint32_t>(m_threads.size()); }   // with the main one
+    bool     isMainThread() const;
+    bool     isSystemThread() const;
+
+private:
+    class WorkStealingDeque
+    {
+    public:
+        bool  push(Job * job);   // owner only, false if full
+        Job * pop();             // owner only
+        Job * steal();           // any thread
+
+    private:
+        constexpr static int64_t mask = job_pool_size - 1;
+
+        alignas(64) std::atomic<int64_t> m_top{0};
+        alignas(64) std::atomic<int64_t> m_bottom{0};
+        std::atomic<Job *> m_buffer[job_pool_size] = {};
+    };
+
+    struct ThreadData
+    {
+        WorkStealingDeque deque;
+        std::vector<Job>  pool = std::vector<Job>(job_pool_size);
+        uint32_t          next_job = 0;
+        uint32_t          rng_state;   // victim selection
+        std::thread       thread;      // empty for the main thread
+    };
+
+    std::vector<std::unique_ptr<ThreadData>> m_threads;   // [0] is the main thread
+    std::atomic<int32_t>                     m_num_queued{0};
+    std::atomic<bool>                        m_stop{false};
+    std::mutex                               m_sleep_mutex;
+    std::condition_variable                  m_wake;
+
+    std::mutex           m_main_mutex;
+    std::vector<Job *>   m_main_jobs;
+    std::atomic<int32_t> m_num_main_jobs{0};   // size of m_main_jobs, read without the lock
+
+    std::mutex                        m_io_mutex;
+    std::condition_variable           m_io_wake;
+    std::deque<std::function<void()>> m_io_jobs;
+    bool                              m_io_stop = false;
+    std::thread                       m_io_thread;
+
+    void  workerLoop(uint32_t index);
+    void  ioLoop();
+    Job * getJob(uint32_t index);
+    void  execute(Job * job);
+    void  finish(Job * job);
+    void  wakeOne();
+};
+
+//! Process wide job system with a worker per extra hardware thread, created by the first call,
+//! which must come from the main thread
+JobSystem & GetJobSystem();
+
+#endif   // JOB_SYSTEM_H
@@ -0,0 +1,12 @@
+#include "parallel.h"
+#include "job_system.h"
+
+uint32_t GetNumWorkerThreads()
+{
+    return GetJobSystem().getNumThreads();
+}
+
+void ParallelFor(uint32_t count, uint32_t grain, std::function<void(uint32_t, uint32_t)> const & func)
+{
+    GetJobSystem().parallelFor(count, grain, func);
+}
@@ -0,0 +1,15 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstdint>
+#include <functional>
+
+// Number of threads (including the calling one) used by ParallelFor
+uint32_t GetNumWorkerThreads();
+
+// Splits [0, count) into chunks of at least 'grain' items and calls func(begin, end) for every chunk
+// as jobs of the shared JobSystem. The calling thread takes part in the work, returns when all chunks
+// are done. Small ranges (count <= grain) and calls from threads outside the job system run inline.
+void ParallelFor(uint32_t count, uint32_t grain, std::function<void(uint32_t, uint32_t)> const & func);
+
+#endif   // PARALLEL_H
@@ -1,11 +1,14 @@
 #include <iostream>
 
 #include "window.h"
+#include "core/job_system.h"
 
 int main(void)
 {
     try
     {
+        GetJobSystem();   // created first, so this thread is the main one
+
         Window w{800, 600, "FBO test"};
         w.createWindow();
         w.initScene();
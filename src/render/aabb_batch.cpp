@@ -0,0 +1,508 @@
+#include "aabb_batch.h"
+#include "../core/cpu_features.h"
+#include "../core/parallel.h"
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define AB_USE_SSE
+#endif
+
+#ifdef CPU_X86_DISPATCH
+#    include <immintrin.h>
+#endif
+
+// Every kernel processes the items [i, count) it can handle with its vector width and returns the first
+// unprocessed index, so a call chain AVX2 -> SSE2 -> scalar covers any count.
+namespace
+{
+uint32_t const g_transform_grain = 8192;   // boxes per ParallelFor chunk
+
+struct BoxArrays
+{
+    float const * min[3];
+    float const * max[3];
+};
+
+struct OutBoxArrays
+{
+    float * min[3];
+    float * max[3];
+};
+
+// glm::mat4 is column major: m[col][row] is float col * 4 + row
+uint32_t TransformScalar(BoxArrays const & src, float const * mtx, OutBoxArrays const & dst, uint32_t i,
+                         uint32_t count)
+{
+    for(; i < count; ++i)
+    {
+        float const * m = mtx + i * 16;
+        for(uint32_t r = 0; r < 3; ++r)
+        {
+            float new_min = m[12 + r];
+            float new_max = new_min;
+            for(uint32_t c = 0; c < 3; ++c)
+            {
+                float const e = m[c * 4 + r] * src.min[c][i];
+                float const f = m[c * 4 + r] * src.max[c][i];
+
+                new_min += std::min(e, f);
+                new_max += std::max(e, f);
+            }
+            dst.min[r][i] = new_min;
+            dst.max[r][i] = new_max;
+        }
+    }
+
+    return i;
+}
+
+uint32_t MinMaxScalar(float const * data, uint32_t i, uint32_t count, float & min, float & max)
+{
+    for(; i < count; ++i)
+    {
+        min = std::min(min, data[i]);
+        max = std::max(max, data[i]);
+    }
+
+    return i;
+}
+
+// result[i] = lhs[k][i] <= rhs[k][i] for all k < 6
+uint32_t LessEqualScalar(float const * const * lhs, float const * const * rhs, uint8_t * result, uint32_t i,
+                         uint32_t count)
+{
+    for(; i < count; ++i)
+    {
+        bool le = true;
+        for(uint32_t k = 0; k < 6; ++k)
+            le = le && lhs[k][i] <= rhs[k][i];
+        result[i] = le ? 1 : 0;
+    }
+
+    return i;
+}
+
+uint32_t PointsScalar(float const * positions, uint32_t i, uint32_t count, AABB & bounds)
+{
+    for(; i < count; ++i)
+        bounds.expandBy(glm::vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]));
+
+    return i;
+}
+
+// Point kernels load xyz triples straight into registers without shuffles, lane k of the stored
+// registers holds component k % 3
+void FoldPointLanes(float const * min, float const * max, uint32_t num_floats, AABB & bounds)
+{
+    glm::vec3 new_min(max_float), new_max(min_float);
+    for(uint32_t k = 0; k < num_floats; ++k)
+    {
+        new_min[static_cast<int>(k % 3)] = std::min(new_min[static_cast<int>(k % 3)], min[k]);
+        new_max[static_cast<int>(k % 3)] = std::max(new_max[static_cast<int>(k % 3)], max[k]);
+    }
+    bounds.expandBy(AABB(new_min, new_max));
+}
+
+#ifdef AB_USE_SSE
+inline __m128 Gather4(float const * m)
+{
+    return _mm_setr_ps(m[0], m[16], m[32], m[48]);
+}
+
+uint32_t TransformSSE(BoxArrays const & src, float const * mtx, OutBoxArrays const & dst, uint32_t i,
+                      uint32_t count)
+{
+    for(; i + 4 <= count; i += 4)
+    {
+        float const * m = mtx + i * 16;
+
+        __m128 const box_min[3] = {_mm_loadu_ps(src.min[0] + i), _mm_loadu_ps(src.min[1] + i),
+                                   _mm_loadu_ps(src.min[2] + i)};
+        __m128 const box_max[3] = {_mm_loadu_ps(src.max[0] + i), _mm_loadu_ps(src.max[1] + i),
+                                   _mm_loadu_ps(src.max[2] + i)};
+
+        for(uint32_t r = 0; r < 3; ++r)
+        {
+            __m128 new_min = Gather4(m + 12 + r);
+            __m128 new_max = new_min;
+            for(uint32_t c = 0; c < 3; ++c)
+            {
+                __m128 const coef = Gather4(m + c * 4 + r);
+                __m128 const e    = _mm_mul_ps(coef, box_min[c]);
+                __m128 const f    = _mm_mul_ps(coef, box_max[c]);
+
+                new_min = _mm_add_ps(new_min, _mm_min_ps(e, f));
+                new_max = _mm_add_ps(new_max, _mm_max_ps(e, f));
+            }
+            _mm_storeu_ps(dst.min[r] + i, new_min);
+            _mm_storeu_ps(dst.max[r] + i, new_max);
+        }
+    }
+
+    return i;
+}
+
+uint32_t MinMaxSSE(float const * data, uint32_t i, uint32_t count, float & min, float & max)
+{
+    if(i + 4 > count)
+        return i;
+
+    __m128 vmin = _mm_loadu_ps(data + i);
+    __m128 vmax = vmin;
+    for(i += 4; i + 4 <= count; i += 4)
+    {
+        __m128 const v = _mm_loadu_ps(data + i);
+
+        vmin = _mm_min_ps(vmin, v);
+        vmax = _mm_max_ps(vmax, v);
+    }
+
+    float lanes_min[4], lanes_max[4];
+    _mm_storeu_ps(lanes_min, vmin);
+    _mm_storeu_ps(lanes_max, vmax);
+    MinMaxScalar(lanes_min, 0, 4, min, max);
+    MinMaxScalar(lanes_max, 0, 4, min, max);
+
+    return i;
+}
+
+uint32_t LessEqualSSE(float const * const * lhs, float const * const * rhs, uint8_t * result, uint32_t i,
+                      uint32_t count)
+{
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 le = _mm_cmple_ps(_mm_loadu_ps(lhs[0] + i), _mm_loadu_ps(rhs[0] + i));
+        for(uint32_t k = 1; k < 6; ++k)
+            le = _mm_and_ps(le, _mm_cmple_ps(_mm_loadu_ps(lhs[k] + i), _mm_loadu_ps(rhs[k] + i)));
+
+        int const bits = _mm_movemask_ps(le);
+        for(uint32_t l = 0; l < 4; ++l)
+            result[i + l] = static_cast<uint8_t>((bits >> l) & 1);
+    }
+
+    return i;
+}
+
+uint32_t PointsSSE(float const * positions, uint32_t i, uint32_t count, AABB & bounds)
+{
+    if(i + 4 > count)
+        return i;
+
+    __m128 min_a = _mm_loadu_ps(positions + i * 3 + 0), max_a = min_a;
+    __m128 min_b = _mm_loadu_ps(positions + i * 3 + 4), max_b = min_b;
+    __m128 min_c = _mm_loadu_ps(positions + i * 3 + 8), max_c = min_c;
+    for(i += 4; i + 4 <= count; i += 4)
+    {
+        __m128 const a = _mm_loadu_ps(positions + i * 3 + 0);
+        __m128 const b = _mm_loadu_ps(positions + i * 3 + 4);
+        __m128 const c = _mm_loadu_ps(positions + i * 3 + 8);
+
+        min_a = _mm_min_ps(min_a, a);
+        max_a = _mm_max_ps(max_a, a);
+        min_b = _mm_min_ps(min_b, b);
+        max_b = _mm_max_ps(max_b, b);
+        min_c = _mm_min_ps(min_c, c);
+        max_c = _mm_max_ps(max_c, c);
+    }
+
+    float lanes_min[12], lanes_max[12];
+    _mm_storeu_ps(lanes_min + 0, min_a);
+    _mm_storeu_ps(lanes_min + 4, min_b);
+    _mm_storeu_ps(lanes_min + 8, min_c);
+    _mm_storeu_ps(lanes_max + 0, max_a);
+    _mm_storeu_ps(lanes_max + 4, max_b);
+    _mm_storeu_ps(lanes_max + 8, max_c);
+    FoldPointLanes(lanes_min, lanes_max, 12, bounds);
+
+    return i;
+}
+#endif   // AB_USE_SSE
+
+#ifdef CPU_X86_DISPATCH
+CPU_TARGET_AVX2 uint32_t TransformAVX2(BoxArrays const & src, float const * mtx, OutBoxArrays const & dst,
+                                       uint32_t i, uint32_t count)
+{
+    __m256i const lanes = _mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112);   // one matrix per lane
+
+    for(; i + 8 <= count; i += 8)
+    {
+        float const * m = mtx + i * 16;
+
+        __m256 const box_min[3] = {_mm256_loadu_ps(src.min[0] + i), _mm256_loadu_ps(src.min[1] + i),
+                                   _mm256_loadu_ps(src.min[2] + i)};
+        __m256 const box_max[3] = {_mm256_loadu_ps(src.max[0] + i), _mm256_loadu_ps(src.max[1] + i),
+                                   _mm256_loadu_ps(src.max[2] + i)};
+
+        for(uint32_t r = 0; r < 3; ++r)
+        {
+            __m256 new_min = _mm256_i32gather_ps(m + 12 + r, lanes, 4);
+            __m256 new_max = new_min;
+            for(uint32_t c = 0; c < 3; ++c)
+            {
+                __m256 const coef = _mm256_i32gather_ps(m + c * 4 + r, lanes, 4);
+                __m256 const e    = _mm256_mul_ps(coef, box_min[c]);
+                __m256 const f    = _mm256_mul_ps(coef, box_max[c]);
+
+                new_min = _mm256_add_ps(new_min, _mm256_min_ps(e, f));
+                new_max = _mm256_add_ps(new_max, _mm256_max_ps(e, f));
+            }
+            _mm256_storeu_ps(dst.min[r] + i, new_min);
+            _mm256_storeu_ps(dst.max[r] + i, new_max);
+        }
+    }
+
+    return i;
+}
+
+CPU_TARGET_AVX2 uint32_t MinMaxAVX2(float const * data, uint32_t i, uint32_t count, float & min, float & max)
+{
+    if(i + 8 > count)
+        return i;
+
+    __m256 vmin = _mm256_loadu_ps(data + i);
+    __m256 vmax = vmin;
+    for(i += 8; i + 8 <= count; i += 8)
+    {
+        __m256 const v = _mm256_loadu_ps(data + i);
+
+        vmin = _mm256_min_ps(vmin, v);
+        vmax = _mm256_max_ps(vmax, v);
+    }
+
+    float lanes_min[8], lanes_max[8];
+    _mm256_storeu_ps(lanes_min, vmin);
+    _mm256_storeu_ps(lanes_max, vmax);
+    MinMaxScalar(lanes_min, 0, 8, min, max);
+    MinMaxScalar(lanes_max, 0, 8, min, max);
+
+    return i;
+}
+
+CPU_TARGET_AVX2 uint32_t LessEqualAVX2(float const * const * lhs, float const * const * rhs, uint8_t * result,
+                                       uint32_t i, uint32_t count)
+{
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256 le = _mm256_cmp_ps(_mm256_loadu_ps(lhs[0] + i), _mm256_loadu_ps(rhs[0] + i), _CMP_LE_OQ);
+        for(uint32_t k = 1; k < 6; ++k)
+        {
+            __m256 const l = _mm256_loadu_ps(lhs[k] + i);
+            __m256 const r = _mm256_loadu_ps(rhs[k] + i);
+
+            le = _mm256_and_ps(le, _mm256_cmp_ps(l, r, _CMP_LE_OQ));
+        }
+
+        int const bits = _mm256_movemask_ps(le);
+        for(uint32_t l = 0; l < 8; ++l)
+            result[i + l] = static_cast<uint8_t>((bits >> l) & 1);
+    }
+
+    return i;
+}
+
+CPU_TARGET_AVX2 uint32_t PointsAVX2(float const * positions, uint32_t i, uint32_t count, AABB & bounds)
+{
+    if(i + 8 > count)
+        return i;
+
+    __m256 min_a = _mm256_loadu_ps(positions + i * 3 + 0), max_a = min_a;
+    __m256 min_b = _mm256_loadu_ps(positions + i * 3 + 8), max_b = min_b;
+    __m256 min_c = _mm256_loadu_ps(positions + i * 3 + 16), max_c = min_c;
+    for(i += 8; i + 8 <= count; i += 8)
+    {
+        __m256 const a = _mm256_loadu_ps(positions + i * 3 + 0);
+        __m256 const b = _mm256_loadu_ps(positions + i * 3 + 8);
+        __m256 const c = _mm256_loadu_ps(positions + i * 3 + 16);
+
+        min_a = _mm256_min_ps(min_a, a);
+        max_a = _mm256_max_ps(max_a, a);
+        min_b = _mm256_min_ps(min_b, b);
+        max_b = _mm256_max_ps(max_b, b);
+        min_c = _mm256_min_ps(min_c, c);
+        max_c = _mm256_max_ps(max_c, c);
+    }
+
+    float lanes_min[24], lanes_max[24];
+    _mm256_storeu_ps(lanes_min + 0, min_a);
+    _mm256_storeu_ps(lanes_min + 8, min_b);
+    _mm256_storeu_ps(lanes_min + 16, min_c);
+    _mm256_storeu_ps(lanes_max + 0, max_a);
+    _mm256_storeu_ps(lanes_max + 8, max_b);
+    _mm256_storeu_ps(lanes_max + 16, max_c);
+    FoldPointLanes(lanes_min, lanes_max, 24, bounds);
+
+    return i;
+}
+#endif   // CPU_X86_DISPATCH
+
+void MinMax(float const * data, uint32_t count, float & min, float & max)
+{
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    if(GetCpuFeatures().avx2)
+        i = MinMaxAVX2(data, i, count, min, max);
+#endif
+#ifdef AB_USE_SSE
+    i = MinMaxSSE(data, i, count, min, max);
+#endif
+    MinMaxScalar(data, i, count, min, max);
+}
+
+void LessEqual(float const * const * lhs, float const * const * rhs, uint8_t * result, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    if(GetCpuFeatures().avx2)
+        i = LessEqualAVX2(lhs, rhs, result, i, count);
+#endif
+#ifdef AB_USE_SSE
+    i = LessEqualSSE(lhs, rhs, result, i, count);
+#endif
+    LessEqualScalar(lhs, rhs, result, i, count);
+}
+}   // namespace
+
+void AABBBatch::reserve(uint32_t count)
+{
+    for(uint32_t axis = 0; axis < 3; ++axis)
+    {
+        m_min[axis].reserve(count);
+        m_max[axis].reserve(count);
+    }
+}
+
+void AABBBatch::resize(uint32_t count)
+{
+    for(uint32_t axis = 0; axis < 3; ++axis)
+    {
+        m_min[axis].resize(count, max_float);
+        m_max[axis].resize(count, min_float);
+    }
+}
+
+void AABBBatch::clear()
+{
+    for(uint32_t axis = 0; axis < 3; ++axis)
+    {
+        m_min[axis].clear();
+        m_max[axis].clear();
+    }
+}
+
+uint32_t AABBBatch::add(AABB const & box)
+{
+    uint32_t const index = size();
+    for(uint32_t axis = 0; axis < 3; ++axis)
+    {
+        m_min[axis].push_back(box.min()[static_cast<int>(axis)]);
+        m_max[axis].push_back(box.max()[static_cast<int>(axis)]);
+    }
+
+    return index;
+}
+
+void AABBBatch::set(uint32_t index, AABB const & box)
+{
+    assert(index < size());
+
+    for(uint32_t axis = 0; axis < 3; ++axis)
+    {
+        m_min[axis][index] = box.min()[static_cast<int>(axis)];
+        m_max[axis][index] = box.max()[static_cast<int>(axis)];
+    }
+}
+
+AABB AABBBatch::get(uint32_t index) const
+{
+    assert(index < size());
+
+    return AABB(m_min[0][index], m_min[1][index], m_min[2][index], m_max[0][index], m_max[1][index],
+                m_max[2][index]);
+}
+
+void AABBBatch::transform(glm::mat4 const * matrices, AABBBatch & out) const
+{
+    assert(matrices != nullptr || empty());
+    assert(&out != this);
+
+    uint32_t const count = size();
+    out.resize(count);
+
+    BoxArrays const    src = {{m_min[0].data(), m_min[1].data(), m_min[2].data()},
+                              {m_max[0].data(), m_max[1].data(), m_max[2].data()}};
+    OutBoxArrays const dst = {{out.m_min[0].data(), out.m_min[1].data(), out.m_min[2].data()},
+                              {out.m_max[0].data(), out.m_max[1].data(), out.m_max[2].data()}};
+    float const *      mtx = reinterpret_cast<float const *>(matrices);
+
+    // large batches are bound by the memory bandwidth of a single core
+    [[maybe_unused]] bool const avx2 = GetCpuFeatures().avx2;
+    ParallelFor(count, g_transform_grain, [&](uint32_t begin, uint32_t end) {
+        uint32_t i = begin;
+#ifdef CPU_X86_DISPATCH
+        if(avx2)
+            i = TransformAVX2(src, mtx, dst, i, end);
+#endif
+#ifdef AB_USE_SSE
+        i = TransformSSE(src, mtx, dst, i, end);
+#endif
+        TransformScalar(src, mtx, dst, i, end);
+    });
+}
+
+AABB AABBBatch::getBounds() const
+{
+    glm::vec3 new_min(max_float), new_max(min_float);
+    for(uint32_t axis = 0; axis < 3; ++axis)
+    {
+        float unused = 0.0f;
+        MinMax(m_min[axis].data(), size(), new_min[static_cast<int>(axis)], unused);
+        MinMax(m_max[axis].data(), size(), unused, new_max[static_cast<int>(axis)]);
+    }
+
+    return AABB(new_min, new_max);
+}
+
+void AABBBatch::intersects(AABBBatch const & other, std::vector<uint8_t> & result) const
+{
+    assert(other.size() == size());
+
+    // a.min <= b.max && b.min <= a.max on every axis
+    float const * const lhs[6] = {m_min[0].data(),       m_min[1].data(),       m_min[2].data(),
+                                  other.m_min[0].data(), other.m_min[1].data(), other.m_min[2].data()};
+    float const * const rhs[6] = {other.m_max[0].data(), other.m_max[1].data(), other.m_max[2].data(),
+                                  m_max[0].data(),       m_max[1].data(),       m_max[2].data()};
+
+    result.resize(size());
+    LessEqual(lhs, rhs, result.data(), size());
+}
+
+void AABBBatch::contains(AABBBatch const & other, std::vector<uint8_t> & result) const
+{
+    assert(other.size() == size());
+
+    // a.min <= b.min && b.max <= a.max on every axis
+    float const * const lhs[6] = {m_min[0].data(),       m_min[1].data(),       m_min[2].data(),
+                                  other.m_max[0].data(), other.m_max[1].data(), other.m_max[2].data()};
+    float const * const rhs[6] = {other.m_min[0].data(), other.m_min[1].data(), other.m_min[2].data(),
+                                  m_max[0].data(),       m_max[1].data(),       m_max[2].data()};
+
+    result.resize(size());
+    LessEqual(lhs, rhs, result.data(), size());
+}
+
+AABB AABBBatch::ReducePoints(float const * positions, uint32_t count)
+{
+    AABB     bounds;
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    if(GetCpuFeatures().avx2)
+        i = PointsAVX2(positions, i, count, bounds);
+#endif
+#ifdef AB_USE_SSE
+    i = PointsSSE(positions, i, count, bounds);
+#endif
+    PointsScalar(positions, i, count, bounds);
+
+    return bounds;
+}
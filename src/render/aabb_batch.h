@@ -0,0 +1,57 @@
+#ifndef AABB_BATCH_H
+#define AABB_BATCH_H
+
+#include "AABB.h"
+#include <cstdint>
+#include <vector>
+
+//! Structure of arrays set of axis aligned bounding boxes
+/*!
+    Every coordinate of the boxes lives in its own array, so the batch kernels handle
+    4 (SSE2) or 8 (AVX2, selected at run time) boxes per instruction.
+    Box i of a result always corresponds to box i of the inputs.
+*/
+class AABBBatch
+{
+public:
+    void     reserve(uint32_t count);
+    void     resize(uint32_t count);
+    void     clear();
+    uint32_t size() const { return static_cast<uint32_t>(m_min[0].size()); }
+    bool     empty() const { return m_min[0].empty(); }
+
+    uint32_t add(AABB const & box);   // returns the box index
+    void     set(uint32_t index, AABB const & box);
+    AABB     get(uint32_t index) const;
+
+    float const * getMin(uint32_t axis) const { return m_min[axis].data(); }
+    float const * getMax(uint32_t axis) const { return m_max[axis].data(); }
+
+    /*! Transforms every box by its own matrix (Arvo's method)
+        \param[in] matrices size() matrices, box i is transformed by matrices[i]
+        \param[out] out transformed boxes, resized to size()
+    */
+    void transform(glm::mat4 const * matrices, AABBBatch & out) const;
+
+    //! Union of all boxes
+    AABB getBounds() const;
+
+    /*! Pairwise tests against a batch of the same size
+        \param[out] result result[i] is 1 if box i intersects (contains) other's box i, 0 otherwise
+    */
+    void intersects(AABBBatch const & other, std::vector<uint8_t> & result) const;
+    void contains(AABBBatch const & other, std::vector<uint8_t> & result) const;
+
+    /*! Bounds of a point set
+        \param[in] positions tightly packed xyz triples
+        \param[in] count number of points
+        \return the unset AABB for an empty set
+    */
+    static AABB ReducePoints(float const * positions, uint32_t count);
+
+private:
+    std::vector<float> m_min[3];
+    std::vector<float> m_max[3];
+};
+
+#endif   // AABB_BATCH_H
@@ -0,0 +1,669 @@
+#include "bvh.h"
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+uint32_t const g_sah_bins     = 16;
+float const    g_frame_margin = 0.25f;   // frame growth, fraction of the content extent
+float const    g_min_margin   = 1e-3f;
+float const    g_quant_max    = 65535.0f;
+
+float SurfaceArea(AABB const & box)
+{
+    glm::vec3 const d = box.max() - box.min();
+
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+AABB Union(AABB box, AABB const & other)
+{
+    box.expandBy(other);
+
+    return box;
+}
+
+bool Encloses(AABB const & outer, AABB const & inner)
+{
+    return outer.contains(inner.min()) && outer.contains(inner.max());
+}
+
+// Slab test, t_enter is the entry distance clamped to 0
+bool RayHitsBox(Ray const & ray, glm::vec3 const & inv_dir, AABB const & box, float max_dist, float & t_enter)
+{
+    glm::vec3 const t0   = (box.min() - ray.origin) * inv_dir;
+    glm::vec3 const t1   = (box.max() - ray.origin) * inv_dir;
+    glm::vec3 const tmin = glm::min(t0, t1);
+    glm::vec3 const tmax = glm::max(t0, t1);
+
+    t_enter          = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+    float const exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, max_dist));
+
+    return t_enter <= exit;
+}
+
+enum class Overlap
+{
+    OUTSIDE,
+    INTERSECT,
+    INSIDE
+};
+
+Overlap Classify(Frustum const & frustum, AABB const & box)
+{
+    glm::vec3 const center = (box.min() + box.max()) * 0.5f;
+    glm::vec3 const extent = (box.max() - box.min()) * 0.5f;
+
+    Overlap result = Overlap::INSIDE;
+    for(uint32_t p = 0; p < Frustum::QUANTITY; ++p)
+    {
+        glm::vec4 const & plane  = frustum.getPlane(static_cast<Frustum::Plane>(p));
+        glm::vec3 const   n      = glm::vec3(plane);
+        float const       dist   = glm::dot(n, center) + plane.w;
+        float const       radius = glm::dot(glm::abs(n), extent);
+
+        if(dist + radius < 0.0f)
+            return Overlap::OUTSIDE;
+        if(dist - radius < 0.0f)
+            result = Overlap::INTERSECT;
+    }
+
+    return result;
+}
+}   // namespace
+
+void BVH::build(AABB const * bounds, uint32_t count)
+{
+    assert(bounds != nullptr || count == 0);
+
+    m_objects.resize(count);
+    m_free_objects.clear();
+    for(uint32_t i = 0; i < count; ++i)
+        m_objects[i] = {bounds[i], 0};   // any leaf but null_index marks a live object until rebuild()
+    m_num_objects = count;
+
+    rebuild();
+}
+
+void BVH::rebuild()
+{
+    m_nodes.clear();
+    m_free_pairs.clear();
+    if(m_num_objects == 0)
+        return;
+
+    AABB                   content;
+    std::vector<uint32_t>  ids;
+    std::vector<glm::vec3> centroids(m_objects.size());
+    ids.reserve(m_num_objects);
+    for(uint32_t id = 0; id < m_objects.size(); ++id)
+    {
+        if(m_objects[id].leaf == null_index)
+            continue;   // free id
+
+        ids.push_back(id);
+        centroids[id] = (m_objects[id].bounds.min() + m_objects[id].bounds.max()) * 0.5f;
+        content.expandBy(m_objects[id].bounds);
+    }
+    assert(ids.size() == m_num_objects);
+
+    setFrame(content);
+    m_nodes.resize(2);
+    buildRange(0, null_index, ids.data(), m_num_objects, centroids);
+}
+
+void BVH::clear()
+{
+    m_nodes.clear();
+    m_free_pairs.clear();
+    m_objects.clear();
+    m_free_objects.clear();
+    m_num_objects = 0;
+}
+
+void BVH::buildRange(uint32_t node, uint32_t parent, uint32_t * ids, uint32_t count,
+                     std::vector<glm::vec3> const & centroids)
+{
+    assert(count > 0);
+
+    if(count == 1)
+    {
+        Node & leaf   = m_nodes[node];
+        leaf.parent   = parent;
+        leaf.child    = ids[0];
+        leaf.is_leaf  = 1;
+        setNodeBounds(leaf, m_objects[ids[0]].bounds);
+        m_objects[ids[0]].leaf = node;
+        return;
+    }
+
+    AABB bounds, centroid_bounds;
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        bounds.expandBy(m_objects[ids[i]].bounds);
+        centroid_bounds.expandBy(centroids[ids[i]]);
+    }
+
+    glm::vec3 const extent = centroid_bounds.max() - centroid_bounds.min();
+    int const       axis   = extent.x >= extent.y && extent.x >= extent.z ? 0
+                             : extent.y >= extent.z                     ? 1
+                                                                        : 2;
+    uint32_t        mid    = count / 2;
+
+    if(extent[axis] > 0.0f)
+    {
+        // Binned SAH: cost of splitting after bin i is N_left * A_left + N_right * A_right
+        float const cmin      = centroid_bounds.min()[axis];
+        float const bin_scale = static_cast<float>(g_sah_bins) / extent[axis];
+        auto        bin_of    = [&](uint32_t id) {
+            uint32_t const bin = static_cast<uint32_t>((centroids[id][axis] - cmin) * bin_scale);
+            return std::min(bin, g_sah_bins - 1);
+        };
+
+        AABB     bin_bounds[g_sah_bins];
+        uint32_t bin_count[g_sah_bins] = {};
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t const bin = bin_of(ids[i]);
+            bin_bounds[bin].expandBy(m_objects[ids[i]].bounds);
+            bin_count[bin]++;
+        }
+
+        float    right_area[g_sah_bins];
+        uint32_t right_count[g_sah_bins];
+        AABB     acc;
+        uint32_t acc_count = 0;
+        for(uint32_t b = g_sah_bins - 1; b > 0; --b)
+        {
+            acc.expandBy(bin_bounds[b]);
+            acc_count     += bin_count[b];
+            right_area[b]  = acc_count > 0 ? SurfaceArea(acc) : 0.0f;
+            right_count[b] = acc_count;
+        }
+
+        float    best_cost = max_float;
+        uint32_t best_bin  = 0;
+        acc                = AABB();
+        acc_count          = 0;
+        for(uint32_t b = 0; b + 1 < g_sah_bins; ++b)
+        {
+            acc.expandBy(bin_bounds[b]);
+            acc_count += bin_count[b];
+            if(acc_count == 0 || right_count[b + 1] == 0)
+                continue;
+
+            float const cost = static_cast<float>(acc_count) * SurfaceArea(acc)
+                               + static_cast<float>(right_count[b + 1]) * right_area[b + 1];
+            if(cost < best_cost)
+            {
+                best_cost = cost;
+                best_bin  = b;
+            }
+        }
+
+        if(best_cost < max_float)
+        {
+            uint32_t * split =
+                std::partition(ids, ids + count, [&](uint32_t id) { return bin_of(id) <= best_bin; });
+            mid = static_cast<uint32_t>(split - ids);
+        }
+    }
+
+    if(mid == 0 || mid == count || extent[axis] <= 0.0f)
+    {
+        mid = count / 2;
+        std::nth_element(ids, ids + mid, ids + count,
+                         [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+    }
+
+    uint32_t const first = allocPair();   // may reallocate m_nodes
+
+    Node & inner   = m_nodes[node];
+    inner.parent   = parent;
+    inner.child    = first;
+    inner.is_leaf  = 0;
+    setNodeBounds(inner, bounds);
+
+    buildRange(first, node, ids, mid, centroids);
+    buildRange(first + 1, node, ids + mid, count - mid, centroids);
+}
+
+uint32_t BVH::insert(AABB const & bounds)
+{
+    uint32_t id;
+    if(!m_free_objects.empty())
+    {
+        id = m_free_objects.back();
+        m_free_objects.pop_back();
+    }
+    else
+    {
+        id = static_cast<uint32_t>(m_objects.size());
+        m_objects.push_back({});
+    }
+    m_objects[id] = {bounds, null_index};
+    m_num_objects++;
+
+    if(m_num_objects == 1)
+    {
+        setFrame(bounds);
+        m_nodes.resize(2);
+
+        Node & root  = m_nodes[0];
+        root.parent  = null_index;
+        root.child   = id;
+        root.is_leaf = 1;
+        setNodeBounds(root, bounds);
+        m_objects[id].leaf = 0;
+        return id;
+    }
+
+    if(!Encloses(m_frame, bounds))
+    {
+        setFrame(Union(m_frame, bounds));
+        requantize();
+    }
+
+    // Descend towards the cheapest sibling, the cost of a new parent is its area plus the area
+    // increase inherited by the ancestors
+    uint32_t index = 0;
+    while(m_nodes[index].is_leaf == 0)
+    {
+        uint32_t const child    = m_nodes[index].child;
+        AABB const     box      = getNodeBounds(m_nodes[index]);
+        float const    combined = SurfaceArea(Union(box, bounds));
+        float const    cost     = 2.0f * combined;
+        float const    inherit  = 2.0f * (combined - SurfaceArea(box));
+
+        float child_cost[2];
+        for(uint32_t k = 0; k < 2; ++k)
+        {
+            AABB const  child_box = getNodeBounds(m_nodes[child + k]);
+            float const area      = SurfaceArea(Union(child_box, bounds));
+
+            child_cost[k] = inherit + (m_nodes[child + k].is_leaf ? area : area - SurfaceArea(child_box));
+        }
+
+        if(cost < child_cost[0] && cost < child_cost[1])
+            break;
+        index = child_cost[0] <= child_cost[1] ? child : child + 1;
+    }
+
+    // the sibling moves into a new pair together with the new leaf, its old slot becomes their parent
+    uint32_t const pair = allocPair();
+    moveNode(index, pair);
+    m_nodes[pair].parent = index;
+
+    Node & leaf  = m_nodes[pair + 1];
+    leaf.parent  = index;
+    leaf.child   = id;
+    leaf.is_leaf = 1;
+    setNodeBounds(leaf, bounds);
+    m_objects[id].leaf = pair + 1;
+
+    m_nodes[index].child   = pair;
+    m_nodes[index].is_leaf = 0;
+    refitUp(index);
+
+    return id;
+}
+
+void BVH::remove(uint32_t object)
+{
+    assert(object < m_objects.size() && m_objects[object].leaf != null_index);
+
+    uint32_t const leaf = m_objects[object].leaf;
+    m_objects[object].leaf = null_index;
+    m_free_objects.push_back(object);
+    m_num_objects--;
+
+    if(leaf == 0)
+    {
+        m_nodes.clear();
+        m_free_pairs.clear();
+        return;
+    }
+
+    // the sibling takes the place of the parent
+    uint32_t const parent  = m_nodes[leaf].parent;
+    uint32_t const pair    = m_nodes[parent].child;
+    uint32_t const sibling = leaf == pair ? pair + 1 : pair;
+    uint32_t const grand   = m_nodes[parent].parent;
+
+    moveNode(sibling, parent);
+    m_nodes[parent].parent = grand;
+    freePair(pair);
+
+    if(grand != null_index)
+        refitUp(grand);
+}
+
+void BVH::update(uint32_t object, AABB const & bounds)
+{
+    assert(object < m_objects.size() && m_objects[object].leaf != null_index);
+
+    m_objects[object].bounds = bounds;
+    if(!Encloses(m_frame, bounds))
+    {
+        setFrame(Union(m_frame, bounds));
+        requantize();
+        return;
+    }
+
+    uint32_t const leaf = m_objects[object].leaf;
+    setNodeBounds(m_nodes[leaf], bounds);
+    if(m_nodes[leaf].parent != null_index)
+        refitUp(m_nodes[leaf].parent);
+}
+
+AABB const & BVH::getBounds(uint32_t object) const
+{
+    assert(object < m_objects.size());
+
+    return m_objects[object].bounds;
+}
+
+uint32_t BVH::getNumNodes() const
+{
+    if(m_nodes.empty())
+        return 0;
+
+    return static_cast<uint32_t>(m_nodes.size() - 1 - 2 * m_free_pairs.size());
+}
+
+void BVH::query(Frustum const & frustum, std::vector<uint32_t> & result, FrustumScratch & scratch) const
+{
+    if(m_num_objects == 0)
+        return;
+
+    // nodes completely inside the frustum add their subtree without further tests, the leaves of the
+    // nodes crossing a plane are gathered and tested at once by the SIMD kernel of Frustum::cull()
+    AABBBatch &             leaf_bounds  = scratch.leaf_bounds;
+    std::vector<uint32_t> & leaf_objects = scratch.leaf_objects;
+    leaf_bounds.clear();
+    leaf_objects.clear();
+
+    auto & stack = scratch.stack;
+    stack.clear();
+    stack.emplace_back(0, false);
+    while(!stack.empty())
+    {
+        auto const [index, inside] = stack.back();
+        stack.pop_back();
+
+        Node const & node = m_nodes[index];
+        if(node.is_leaf)
+        {
+            if(inside)
+                result.push_back(node.child);
+            else
+            {
+                leaf_bounds.add(m_objects[node.child].bounds);
+                leaf_objects.push_back(node.child);
+            }
+            continue;
+        }
+
+        bool child_inside = inside;
+        if(!inside)
+        {
+            Overlap const overlap = Classify(frustum, getNodeBounds(node));
+            if(overlap == Overlap::OUTSIDE)
+                continue;
+            child_inside = overlap == Overlap::INSIDE;
+        }
+        stack.emplace_back(node.child + 1, child_inside);
+        stack.emplace_back(node.child, child_inside);
+    }
+
+    std::vector<uint32_t> & visible = scratch.visible;
+    frustum.cull(leaf_bounds, visible);
+    for(auto const i : visible)
+        result.push_back(leaf_objects[i]);
+}
+
+void BVH::query(AABB const & box, std::vector<uint32_t> & result) const
+{
+    if(m_num_objects == 0 || !box.intersects(m_frame))
+        return;
+
+    // the box is quantized outwards and compared to the nodes in integers
+    glm::vec3 const lo = (box.min() - m_frame.min()) * m_scale;
+    glm::vec3 const hi = (box.max() - m_frame.min()) * m_scale;
+    uint16_t        qmin[3], qmax[3];
+    for(int a = 0; a < 3; ++a)
+    {
+        qmin[a] = static_cast<uint16_t>(glm::clamp(std::floor(lo[a]), 0.0f, g_quant_max));
+        qmax[a] = static_cast<uint16_t>(glm::clamp(std::ceil(hi[a]), 0.0f, g_quant_max));
+    }
+
+    std::vector<uint32_t> stack = {0};
+    while(!stack.empty())
+    {
+        Node const & node = m_nodes[stack.back()];
+        stack.pop_back();
+
+        bool overlaps = true;
+        for(uint32_t a = 0; a < 3; ++a)
+            overlaps = overlaps && node.qmin[a] <= qmax[a] && node.qmax[a] >= qmin[a];
+        if(!overlaps)
+            continue;
+
+        if(node.is_leaf)
+        {
+            if(m_objects[node.child].bounds.intersects(box))
+                result.push_back(node.child);
+            continue;
+        }
+        stack.push_back(node.child + 1);
+        stack.push_back(node.child);
+    }
+}
+
+void BVH::query(Ray const & ray, float max_dist, std::vector<uint32_t> & result) const
+{
+    if(m_num_objects == 0)
+        return;
+
+    glm::vec3 const       inv_dir = glm::vec3(1.0f) / ray.direction;
+    std::vector<uint32_t> stack   = {0};
+    while(!stack.empty())
+    {
+        Node const & node = m_nodes[stack.back()];
+        stack.pop_back();
+
+        float      t_enter;
+        AABB const box = node.is_leaf ? m_objects[node.child].bounds : getNodeBounds(node);
+        if(!RayHitsBox(ray, inv_dir, box, max_dist, t_enter))
+            continue;
+
+        if(node.is_leaf)
+        {
+            result.push_back(node.child);
+            continue;
+        }
+        stack.push_back(node.child + 1);
+        stack.push_back(node.child);
+    }
+}
+
+uint32_t BVH::raycast(Ray const & ray, float max_dist, RayHitTest const & hit_test, float & hit_dist) const
+{
+    uint32_t hit = null_index;
+    hit_dist     = max_dist;
+    if(m_num_objects == 0)
+        return hit;
+
+    glm::vec3 const inv_dir = glm::vec3(1.0f) / ray.direction;
+    float           t_root;
+    if(!RayHitsBox(ray, inv_dir, getNodeBounds(m_nodes[0]), hit_dist, t_root))
+        return hit;
+
+    // (node, entry distance), the nearer child is visited first
+    std::vector<std::pair<uint32_t, float>> stack;
+    stack.emplace_back(0, t_root);
+    while(!stack.empty())
+    {
+        auto const [index, t_node] = stack.back();
+        stack.pop_back();
+        if(t_node > hit_dist)
+            continue;
+
+        Node const & node = m_nodes[index];
+        if(node.is_leaf)
+        {
+            float t_box;
+            if(!RayHitsBox(ray, inv_dir, m_objects[node.child].bounds, hit_dist, t_box))
+                continue;
+
+            float const t = hit_test(node.child, ray, hit_dist);
+            if(t >= 0.0f && t < hit_dist)
+            {
+                hit_dist = t;
+                hit      = node.child;
+            }
+            continue;
+        }
+
+        float      t_child[2];
+        bool const hit_child[2] = {
+            RayHitsBox(ray, inv_dir, getNodeBounds(m_nodes[node.child]), hit_dist, t_child[0]),
+            RayHitsBox(ray, inv_dir, getNodeBounds(m_nodes[node.child + 1]), hit_dist, t_child[1])};
+
+        uint32_t const closer  = t_child[1] < t_child[0] ? 1 : 0;
+        uint32_t const farther = 1 - closer;
+        if(hit_child[farther])
+            stack.emplace_back(node.child + farther, t_child[farther]);
+        if(hit_child[closer])
+            stack.emplace_back(node.child + closer, t_child[closer]);
+    }
+
+    return hit;
+}
+
+uint32_t BVH::allocPair()
+{
+    if(!m_free_pairs.empty())
+    {
+        uint32_t const first = m_free_pairs.back();
+        m_free_pairs.pop_back();
+        return first;
+    }
+
+    uint32_t const first = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.resize(m_nodes.size() + 2);
+
+    return first;
+}
+
+void BVH::freePair(uint32_t first)
+{
+    assert(first >= 2 && first % 2 == 0);
+
+    m_free_pairs.push_back(first);
+}
+
+// copies the node and redirects the references to it
+void BVH::moveNode(uint32_t from, uint32_t to)
+{
+    m_nodes[to] = m_nodes[from];
+
+    Node const & node = m_nodes[to];
+    if(node.is_leaf)
+    {
+        m_objects[node.child].leaf = to;
+    }
+    else
+    {
+        m_nodes[node.child].parent     = to;
+        m_nodes[node.child + 1].parent = to;
+    }
+}
+
+void BVH::setFrame(AABB const & bounds)
+{
+    glm::vec3 const margin = (bounds.max() - bounds.min()) * g_frame_margin + glm::vec3(g_min_margin);
+
+    m_frame = AABB(bounds.min() - margin, bounds.max() + margin);
+
+    glm::vec3 const extent = m_frame.max() - m_frame.min();
+    m_scale                = g_quant_max / extent;
+    m_inv_scale            = extent / g_quant_max;
+}
+
+void BVH::requantize()
+{
+    if(m_nodes.empty())
+        return;
+
+    // pre-order list, walked backwards the children come before their parents
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> stack = {0};
+    order.reserve(getNumNodes());
+    while(!stack.empty())
+    {
+        uint32_t const index = stack.back();
+        stack.pop_back();
+        order.push_back(index);
+        if(!m_nodes[index].is_leaf)
+        {
+            stack.push_back(m_nodes[index].child);
+            stack.push_back(m_nodes[index].child + 1);
+        }
+    }
+
+    std::vector<AABB> bounds(m_nodes.size());
+    for(auto it = order.rbegin(); it != order.rend(); ++it)
+    {
+        Node & node = m_nodes[*it];
+        bounds[*it] = node.is_leaf ? m_objects[node.child].bounds
+                                   : Union(bounds[node.child], bounds[node.child + 1]);
+        setNodeBounds(node, bounds[*it]);
+    }
+}
+
+// rounded outwards by one more step, so the float round trip can't shrink the box
+void BVH::setNodeBounds(Node & node, AABB const & bounds) const
+{
+    glm::vec3 const lo = (bounds.min() - m_frame.min()) * m_scale;
+    glm::vec3 const hi = (bounds.max() - m_frame.min()) * m_scale;
+    for(int a = 0; a < 3; ++a)
+    {
+        node.qmin[a] = static_cast<uint16_t>(glm::clamp(std::floor(lo[a]) - 1.0f, 0.0f, g_quant_max));
+        node.qmax[a] = static_cast<uint16_t>(glm::clamp(std::ceil(hi[a]) + 1.0f, 0.0f, g_quant_max));
+    }
+}
+
+AABB BVH::getNodeBounds(Node const & node) const
+{
+    glm::vec3 const qmin(node.qmin[0], node.qmin[1], node.qmin[2]);
+    glm::vec3 const qmax(node.qmax[0], node.qmax[1], node.qmax[2]);
+
+    return AABB(m_frame.min() + qmin * m_inv_scale, m_frame.min() + qmax * m_inv_scale);
+}
+
+void BVH::refitUp(uint32_t index)
+{
+    while(index != null_index)
+    {
+        Node &       node  = m_nodes[index];
+        Node const & left  = m_nodes[node.child];
+        Node const & right = m_nodes[node.child + 1];
+
+        bool changed = false;
+        for(int a = 0; a < 3; ++a)
+        {
+            uint16_t const qmin = std::min(left.qmin[a], right.qmin[a]);
+            uint16_t const qmax = std::max(left.qmax[a], right.qmax[a]);
+
+            changed      = changed || qmin != node.qmin[a] || qmax != node.qmax[a];
+            node.qmin[a] = qmin;
+            node.qmax[a] = qmax;
+        }
+
+        if(!changed)
+            break;
+        index = node.parent;
+    }
+}
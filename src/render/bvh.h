@@ -0,0 +1,112 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "AABB.h"
+#include "aabb_batch.h"
+#include "frustum.h"
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;   // not necessarily normalized, distances are in units of its length
+};
+
+//! Dynamic bounding volume hierarchy over object AABBs
+/*!
+    Every leaf holds one object. Node bounds are quantized to 16 bit relative to the frame box
+    (rounded outwards, so they always enclose the exact ones), which packs a node into 32 bytes.
+    The two children of a node are allocated as a pair of adjacent nodes, so a traversal step
+    reads one 64 byte block. build() and rebuild() use the binned SAH, insert() picks the sibling
+    with the SAH cost heuristic of incremental trees, update() refits the ancestors of a moved object.
+*/
+class BVH
+{
+public:
+    constexpr static uint32_t null_index = 0xFFFFFFFF;
+
+    // returns the distance to the object hit or a negative value if the ray misses the object
+    using RayHitTest = std::function<float(uint32_t object, Ray const & ray, float max_dist)>;
+
+    // Working memory of the frustum query, kept by the caller so per frame queries don't allocate
+    struct FrustumScratch
+    {
+        std::vector<std::pair<uint32_t, bool>> stack;   // node, inside the frustum
+        AABBBatch                              leaf_bounds;
+        std::vector<uint32_t>                  leaf_objects;
+        std::vector<uint32_t>                  visible;
+    };
+
+    //! Replaces the content, object ids are 0 .. count - 1
+    void build(AABB const * bounds, uint32_t count);
+    //! Rebuilds the tree over the current objects with the SAH, ids are kept
+    void rebuild();
+    void clear();
+
+    uint32_t insert(AABB const & bounds);   // returns the object id
+    void     remove(uint32_t object);
+    void     update(uint32_t object, AABB const & bounds);
+
+    AABB const & getBounds(uint32_t object) const;
+    uint32_t     getNumObjects() const { return m_num_objects; }
+    uint32_t     getNumNodes() const;
+
+    // Queries append the ids of the objects found to 'result'
+    void query(Frustum const & frustum, std::vector<uint32_t> & result, FrustumScratch & scratch) const;
+    void query(AABB const & box, std::vector<uint32_t> & result) const;
+    void query(Ray const & ray, float max_dist, std::vector<uint32_t> & result) const;
+
+    /*! Closest hit along the ray
+        \param[in] hit_test exact test, called front to back for the objects whose boxes are hit before the
+                   closest hit so far
+        \param[out] hit_dist distance to the closest hit
+        \return the id of the closest object hit or null_index
+    */
+    uint32_t raycast(Ray const & ray, float max_dist, RayHitTest const & hit_test, float & hit_dist) const;
+
+private:
+    struct Node
+    {
+        uint16_t qmin[3];
+        uint16_t qmax[3];
+        uint32_t parent;   // null_index for the root
+        uint32_t child;    // internal node: first node of the child pair, leaf: object id
+        uint32_t is_leaf;
+        uint32_t reserved[2];
+    };
+    static_assert(sizeof(Node) == 32, "BVH node must be 32 bytes");
+
+    struct Object
+    {
+        AABB     bounds;
+        uint32_t leaf;   // null_index for a free id
+    };
+
+    // m_nodes[0] is the root, m_nodes[1] is unused, children pairs start at even indices
+    std::vector<Node>     m_nodes;
+    std::vector<uint32_t> m_free_pairs;
+    std::vector<Object>   m_objects;
+    std::vector<uint32_t> m_free_objects;
+    uint32_t              m_num_objects = 0;
+
+    // quantization frame
+    AABB      m_frame;
+    glm::vec3 m_scale     = glm::vec3(0.0f);   // frame units -> quantized
+    glm::vec3 m_inv_scale = glm::vec3(0.0f);
+
+    uint32_t allocPair();
+    void     freePair(uint32_t first);
+    void     moveNode(uint32_t from, uint32_t to);
+    void     buildRange(uint32_t node, uint32_t parent, uint32_t * ids, uint32_t count,
+                        std::vector<glm::vec3> const & centroids);
+    void     setFrame(AABB const & bounds);
+    void     requantize();
+    void     setNodeBounds(Node & node, AABB const & bounds) const;
+    AABB     getNodeBounds(Node const & node) const;
+    void     refitUp(uint32_t node);
+};
+
+#endif   // BVH_H
@@ -0,0 +1,190 @@
+#include "dynamic_batch.h"
+#include "renderer.h"
+#include "vertex_transform.h"
+#include "../core/parallel.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace
+{
+constexpr float    g_ema_weight      = 0.1f;
+constexpr uint32_t g_probe_interval  = 64;   // frames between re-measurements of the rejected path
+constexpr uint32_t g_items_per_chunk = 32;   // ParallelFor grain
+
+using Clock = std::chrono::steady_clock;
+
+float ElapsedUs(Clock::time_point start)
+{
+    return std::chrono::duration<float, std::micro>(Clock::now() - start).count();
+}
+
+void UpdateAverage(float & avg, float sample)
+{
+    avg = avg < 0.0f ? sample : avg + g_ema_weight * (sample - avg);
+}
+}   // namespace
+
+DynamicBatcher::DynamicBatcher(VertexBuffer::ComponentsFlags format, uint32_t num_tex_channels,
+                               uint32_t max_mesh_vertices) :
+    m_max_mesh_vertices(max_mesh_vertices), m_stream(format, num_tex_channels)
+{}
+
+void DynamicBatcher::begin()
+{
+    for(auto & [material, items] : m_queues)
+        items.clear();
+
+    m_stats.batched_meshes = m_stats.batched_draws = m_stats.direct_draws = 0;
+    m_frame_num++;
+}
+
+bool DynamicBatcher::add(VertexBuffer const & mesh, glm::mat4 const & object2world, uint32_t material_id)
+{
+    if(mesh.getNumVertex() > m_max_mesh_vertices)
+        return false;
+
+    auto const format = m_stream.getComponentsFlags();
+    if((mesh.getComponentsFlags() & format) != format
+       || (format[VertexBuffer::ComponentsBitPos::tex]
+           && mesh.getNumTexChannels() < m_stream.getNumTexChannels()))
+    {
+        return false;
+    }
+
+    m_queues[material_id].push_back({&mesh, object2world});
+    return true;
+}
+
+void DynamicBatcher::flush(RendererBase & render, glm::mat4 const & view, uint32_t material_id)
+{
+    auto it = m_queues.find(material_id);
+    if(it == m_queues.end() || it->second.empty())
+        return;
+
+    auto const & items     = it->second;
+    uint32_t     num_verts = 0;
+    for(auto const & item : items)
+        num_verts += item.mesh->getNumVertex();
+
+    auto const start = Clock::now();
+    if(choosePath(items, num_verts) == Path::BATCHED)
+    {
+        drawBatched(render, view, items, num_verts);
+        UpdateAverage(m_us_per_vertex, ElapsedUs(start) / static_cast<float>(num_verts));
+    }
+    else
+    {
+        drawDirect(render, view, items);
+        UpdateAverage(m_us_per_draw, ElapsedUs(start) / static_cast<float>(items.size()));
+    }
+
+    m_stats.us_per_vertex = m_us_per_vertex;
+    m_stats.us_per_draw   = m_us_per_draw;
+}
+
+void DynamicBatcher::terminate(RendererBase & render)
+{
+    render.deleteBuffer(m_stream);
+}
+
+DynamicBatcher::Path DynamicBatcher::choosePath(std::vector<Item> const & items, uint32_t num_verts)
+{
+    if(items.size() == 1)
+        return Path::DIRECT;
+
+    // measure both paths before trusting the estimates
+    if(m_us_per_vertex < 0.0f)
+        return Path::BATCHED;
+    if(m_us_per_draw < 0.0f)
+        return Path::DIRECT;
+
+    float const batched_cost = m_us_per_vertex * static_cast<float>(num_verts);
+    float const direct_cost  = m_us_per_draw * static_cast<float>(items.size());
+    Path const  best         = batched_cost <= direct_cost ? Path::BATCHED : Path::DIRECT;
+
+    // periodically re-measure the rejected path, the costs change with the scene and the driver state
+    if(m_frame_num % g_probe_interval == 0)
+        return best == Path::BATCHED ? Path::DIRECT : Path::BATCHED;
+
+    return best;
+}
+
+void DynamicBatcher::drawBatched(RendererBase & render, glm::mat4 const & view,
+                                 std::vector<Item> const & items, uint32_t num_verts)
+{
+    auto const     format       = m_stream.getComponentsFlags();
+    bool const     has_norm     = format[VertexBuffer::ComponentsBitPos::normal];
+    bool const     has_tex      = format[VertexBuffer::ComponentsBitPos::tex];
+    uint32_t const num_channels = has_tex ? m_stream.getNumTexChannels() : 0;
+    uint32_t const num_items    = static_cast<uint32_t>(items.size());
+
+    // prefix sums, every item gets its own slice of the planar blocks
+    m_first_vertex.resize(num_items);
+    m_first_index.resize(num_items);
+    uint32_t num_indices = 0;
+    for(uint32_t i = 0, vstart = 0; i < num_items; ++i)
+    {
+        m_first_vertex[i] = vstart;
+        m_first_index[i]  = num_indices;
+        vstart += items[i].mesh->getNumVertex();
+        num_indices += static_cast<uint32_t>(items[i].mesh->getIndices().size());
+    }
+
+    m_dynamic_block.resize(num_verts * (has_norm ? 6 : 3));
+    m_static_block.resize(num_verts * 2 * num_channels);
+    m_indices.resize(num_indices);
+
+    ParallelFor(num_items, g_items_per_chunk, [&](uint32_t begin, uint32_t end) {
+        for(uint32_t i = begin; i < end; ++i)
+        {
+            VertexBuffer const & mesh   = *items[i].mesh;
+            uint32_t const       vcount = mesh.getNumVertex();
+            uint32_t const       vstart = m_first_vertex[i];
+
+            TransformPositions(items[i].model, mesh.getPositions(), m_dynamic_block.data() + vstart * 3,
+                               vcount);
+            if(has_norm)
+            {
+                TransformNormals(GetNormalMatrix(items[i].model), mesh.getNormals(),
+                                 m_dynamic_block.data() + (num_verts + vstart) * 3, vcount);
+            }
+
+            for(uint32_t ch = 0; ch < num_channels; ++ch)
+            {
+                float const * src = mesh.getTexCoords(ch);
+                std::copy(src, src + vcount * 2, m_static_block.begin() + (ch * num_verts + vstart) * 2);
+            }
+
+            auto const & src_indices = mesh.getIndices();
+            uint32_t *   dst_indices = m_indices.data() + m_first_index[i];
+            for(uint32_t j = 0; j < src_indices.size(); ++j)
+                dst_indices[j] = src_indices[j] + vstart;
+        }
+    });
+
+    m_stream.swapData(m_dynamic_block, m_static_block, m_indices, num_verts);
+    render.uploadBuffer(m_stream);
+
+    render.setMatrix(RendererBase::MatrixType::MODELVIEW, view);
+    render.bindVertexBuffer(&m_stream);
+    render.draw(m_stream);
+    render.unbindVertexBuffer();
+
+    m_stats.batched_meshes += num_items;
+    m_stats.batched_draws++;
+}
+
+void DynamicBatcher::drawDirect(RendererBase & render, glm::mat4 const & view,
+                                std::vector<Item> const & items)
+{
+    for(auto const & item : items)
+    {
+        render.setMatrix(RendererBase::MatrixType::MODELVIEW, view * item.model);
+        render.bindVertexBuffer(item.mesh);
+        render.draw(*item.mesh);
+        render.unbindVertexBuffer();
+    }
+
+    render.setMatrix(RendererBase::MatrixType::MODELVIEW, view);
+    m_stats.direct_draws += static_cast<uint32_t>(items.size());
+}
@@ -0,0 +1,83 @@
+#ifndef DYNAMIC_BATCH_H
+#define DYNAMIC_BATCH_H
+
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "vertex_buffer.h"
+
+class RendererBase;
+
+// Per-frame batching of small moving meshes. Queued meshes of one material are transformed on the
+// CPU (SIMD, worker threads) into a streaming VertexBuffer and drawn with a single call.
+// For every flush the batcher compares the measured cost of both submission paths and falls back
+// to individual draws when they are cheaper.
+//
+// Usage per frame:
+//      begin()
+//      add() for every small dynamic mesh
+//      for each material: bind slots, flush(material), unbind slots
+class DynamicBatcher
+{
+public:
+    enum class Path
+    {
+        BATCHED,
+        DIRECT
+    };
+
+    struct Stats   // of the last frame
+    {
+        uint32_t batched_meshes = 0;
+        uint32_t batched_draws  = 0;
+        uint32_t direct_draws   = 0;
+        float    us_per_vertex  = 0.0f;   // measured cost of the batched path
+        float    us_per_draw    = 0.0f;   // measured cost of the direct path
+    };
+
+    DynamicBatcher(VertexBuffer::ComponentsFlags format = VertexBuffer::pos_norm_tex,
+                   uint32_t num_tex_channels = 1, uint32_t max_mesh_vertices = 300);
+
+    void begin();
+    // returns false if the mesh is too big for batching, it must be drawn by the caller then
+    bool add(VertexBuffer const & mesh, glm::mat4 const & object2world, uint32_t material_id = 0);
+    // draws all meshes queued for the material, 'view' is the camera modelview matrix
+    void flush(RendererBase & render, glm::mat4 const & view, uint32_t material_id = 0);
+    void terminate(RendererBase & render);   // release the streaming buffer
+
+    Stats const & getStats() const { return m_stats; }
+
+private:
+    struct Item
+    {
+        VertexBuffer const * mesh = nullptr;
+        glm::mat4            model;
+    };
+
+    Path choosePath(std::vector<Item> const & items, uint32_t num_verts);
+    void drawBatched(RendererBase & render, glm::mat4 const & view, std::vector<Item> const & items,
+                     uint32_t num_verts);
+    void drawDirect(RendererBase & render, glm::mat4 const & view, std::vector<Item> const & items);
+
+    uint32_t const m_max_mesh_vertices;
+    uint32_t       m_frame_num = 0;
+
+    std::unordered_map<uint32_t, std::vector<Item>> m_queues;
+
+    // streaming geometry, blocks are swapped in and out of m_stream to keep the allocations
+    VertexBuffer          m_stream;
+    std::vector<float>    m_dynamic_block;
+    std::vector<float>    m_static_block;
+    std::vector<uint32_t> m_indices;
+    std::vector<uint32_t> m_first_vertex;   // per item offsets
+    std::vector<uint32_t> m_first_index;
+
+    // cost estimation, exponential moving averages in microseconds
+    float m_us_per_vertex = -1.0f;   // < 0 - not measured yet
+    float m_us_per_draw   = -1.0f;
+    Stats m_stats;
+};
+
+#endif   // DYNAMIC_BATCH_H
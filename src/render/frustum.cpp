@@ -0,0 +1,245 @@
+#include "frustum.h"
+#include "../core/cpu_features.h"
+#include "../core/parallel.h"
+#include <assert.h>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define FR_USE_SSE
+#endif
+
+#ifdef CPU_X86_DISPATCH
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+uint32_t const g_cull_block = 4096;   // boxes per parallel block
+
+// Plane coefficients in the form the kernels use: the box is outside a plane when
+// dot(n, center) + dot(|n|, extent) + d < 0
+struct CullPlanes
+{
+    float n[Frustum::QUANTITY][3];
+    float abs_n[Frustum::QUANTITY][3];
+    float d[Frustum::QUANTITY];
+};
+
+struct BoxArrays
+{
+    float const * min[3];
+    float const * max[3];
+};
+
+// Kernels test the boxes [i, end), append the visible indices to 'visible' and return the first
+// untested index
+uint32_t CullScalar(CullPlanes const & planes, BoxArrays const & boxes, uint32_t i, uint32_t end,
+                    uint32_t * visible, uint32_t & num_visible)
+{
+    for(; i < end; ++i)
+    {
+        bool inside = true;
+        for(uint32_t p = 0; p < Frustum::QUANTITY && inside; ++p)
+        {
+            float dist = planes.d[p];
+            for(uint32_t a = 0; a < 3; ++a)
+            {
+                float const center = (boxes.min[a][i] + boxes.max[a][i]) * 0.5f;
+                float const extent = (boxes.max[a][i] - boxes.min[a][i]) * 0.5f;
+
+                dist += planes.n[p][a] * center + planes.abs_n[p][a] * extent;
+            }
+            inside = dist >= 0.0f;
+        }
+
+        if(inside)
+            visible[num_visible++] = i;
+    }
+
+    return i;
+}
+
+void AppendMask(int bits, uint32_t first, uint32_t * visible, uint32_t & num_visible)
+{
+    while(bits != 0)
+    {
+        uint32_t lane = 0;
+        while(((bits >> lane) & 1) == 0)
+            ++lane;
+        visible[num_visible++] = first + lane;
+        bits &= bits - 1;
+    }
+}
+
+#ifdef FR_USE_SSE
+uint32_t CullSSE(CullPlanes const & planes, BoxArrays const & boxes, uint32_t i, uint32_t end,
+                 uint32_t * visible, uint32_t & num_visible)
+{
+    __m128 const half = _mm_set1_ps(0.5f);
+    __m128 const zero = _mm_setzero_ps();
+
+    for(; i + 4 <= end; i += 4)
+    {
+        __m128 center[3], extent[3];
+        for(uint32_t a = 0; a < 3; ++a)
+        {
+            __m128 const mn = _mm_loadu_ps(boxes.min[a] + i);
+            __m128 const mx = _mm_loadu_ps(boxes.max[a] + i);
+
+            center[a] = _mm_mul_ps(_mm_add_ps(mn, mx), half);
+            extent[a] = _mm_mul_ps(_mm_sub_ps(mx, mn), half);
+        }
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(uint32_t p = 0; p < Frustum::QUANTITY; ++p)
+        {
+            __m128 dist = _mm_set1_ps(planes.d[p]);
+            for(uint32_t a = 0; a < 3; ++a)
+            {
+                dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(planes.n[p][a]), center[a]));
+                dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(planes.abs_n[p][a]), extent[a]));
+            }
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, zero));
+        }
+
+        AppendMask(_mm_movemask_ps(inside), i, visible, num_visible);
+    }
+
+    return i;
+}
+#endif   // FR_USE_SSE
+
+#ifdef CPU_X86_DISPATCH
+CPU_TARGET_AVX2_FMA uint32_t CullAVX2(CullPlanes const & planes, BoxArrays const & boxes, uint32_t i,
+                                      uint32_t end, uint32_t * visible, uint32_t & num_visible)
+{
+    __m256 const half = _mm256_set1_ps(0.5f);
+    __m256 const zero = _mm256_setzero_ps();
+
+    for(; i + 8 <= end; i += 8)
+    {
+        __m256 center[3], extent[3];
+        for(uint32_t a = 0; a < 3; ++a)
+        {
+            __m256 const mn = _mm256_loadu_ps(boxes.min[a] + i);
+            __m256 const mx = _mm256_loadu_ps(boxes.max[a] + i);
+
+            center[a] = _mm256_mul_ps(_mm256_add_ps(mn, mx), half);
+            extent[a] = _mm256_mul_ps(_mm256_sub_ps(mx, mn), half);
+        }
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(uint32_t p = 0; p < Frustum::QUANTITY; ++p)
+        {
+            __m256 dist = _mm256_set1_ps(planes.d[p]);
+            for(uint32_t a = 0; a < 3; ++a)
+            {
+                dist = _mm256_fmadd_ps(_mm256_set1_ps(planes.n[p][a]), center[a], dist);
+                dist = _mm256_fmadd_ps(_mm256_set1_ps(planes.abs_n[p][a]), extent[a], dist);
+            }
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, zero, _CMP_GE_OQ));
+        }
+
+        AppendMask(_mm256_movemask_ps(inside), i, visible, num_visible);
+    }
+
+    return i;
+}
+#endif   // CPU_X86_DISPATCH
+
+uint32_t CullRange(CullPlanes const & planes, BoxArrays const & boxes, uint32_t begin, uint32_t end,
+                   uint32_t * visible)
+{
+    uint32_t num_visible = 0;
+    uint32_t i           = begin;
+#ifdef CPU_X86_DISPATCH
+    if(GetCpuFeatures().avx2 && GetCpuFeatures().fma)
+        i = CullAVX2(planes, boxes, i, end, visible, num_visible);
+#endif
+#ifdef FR_USE_SSE
+    i = CullSSE(planes, boxes, i, end, visible, num_visible);
+#endif
+    CullScalar(planes, boxes, i, end, visible, num_visible);
+
+    return num_visible;
+}
+}   // namespace
+
+void Frustum::set(glm::mat4 const & view_projection)
+{
+    glm::vec4 const row0 = glm::row(view_projection, 0);
+    glm::vec4 const row1 = glm::row(view_projection, 1);
+    glm::vec4 const row2 = glm::row(view_projection, 2);
+    glm::vec4 const row3 = glm::row(view_projection, 3);
+
+    m_planes[LEFT]   = row3 + row0;
+    m_planes[RIGHT]  = row3 - row0;
+    m_planes[BOTTOM] = row3 + row1;
+    m_planes[TOP]    = row3 - row1;
+    m_planes[ZNEAR]  = row3 + row2;
+    m_planes[ZFAR]   = row3 - row2;
+
+    for(auto & plane : m_planes)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+bool Frustum::intersects(AABB const & box) const
+{
+    glm::vec3 const center = (box.min() + box.max()) * 0.5f;
+    glm::vec3 const extent = (box.max() - box.min()) * 0.5f;
+
+    for(auto const & plane : m_planes)
+    {
+        glm::vec3 const n = glm::vec3(plane);
+        if(glm::dot(n, center) + glm::dot(glm::abs(n), extent) + plane.w < 0.0f)
+            return false;
+    }
+
+    return true;
+}
+
+void Frustum::cull(AABBBatch const & boxes, std::vector<uint32_t> & visible) const
+{
+    CullPlanes planes;
+    for(uint32_t p = 0; p < QUANTITY; ++p)
+    {
+        for(uint32_t a = 0; a < 3; ++a)
+        {
+            planes.n[p][a]     = m_planes[p][static_cast<int>(a)];
+            planes.abs_n[p][a] = std::abs(planes.n[p][a]);
+        }
+        planes.d[p] = m_planes[p].w;
+    }
+
+    BoxArrays const arrays = {{boxes.getMin(0), boxes.getMin(1), boxes.getMin(2)},
+                              {boxes.getMax(0), boxes.getMax(1), boxes.getMax(2)}};
+
+    uint32_t const count      = boxes.size();
+    uint32_t const num_blocks = (count + g_cull_block - 1) / g_cull_block;
+
+    // Every block writes its indices at its own offset, then the blocks are packed in order,
+    // so the result doesn't depend on the number of threads
+    visible.resize(count);
+    std::vector<uint32_t> block_visible(num_blocks);
+    ParallelFor(num_blocks, 1, [&](uint32_t begin, uint32_t end) {
+        for(uint32_t b = begin; b < end; ++b)
+        {
+            uint32_t const first = b * g_cull_block;
+            uint32_t const last  = std::min(first + g_cull_block, count);
+
+            block_visible[b] = CullRange(planes, arrays, first, last, visible.data() + first);
+        }
+    });
+
+    uint32_t num_visible = 0;
+    for(uint32_t b = 0; b < num_blocks; ++b)
+    {
+        if(num_visible != b * g_cull_block)
+            std::memmove(visible.data() + num_visible, visible.data() + b * g_cull_block,
+                         sizeof(uint32_t) * block_visible[b]);
+        num_visible += block_visible[b];
+    }
+    visible.resize(num_visible);
+}
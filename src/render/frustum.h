@@ -0,0 +1,50 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "AABB.h"
+#include "aabb_batch.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+//! View frustum as six planes
+/*!
+    Planes are extracted from a projection * modelview matrix (Gribb-Hartmann),
+    so they live in the space the modelview matrix transforms from: world space for
+    a camera view matrix, object space when the model matrix is included.
+    Plane normals point inside, a point p is inside when dot(n, p) + d >= 0 for all planes.
+*/
+class Frustum
+{
+public:
+    enum Plane : uint32_t
+    {
+        LEFT,
+        RIGHT,
+        BOTTOM,
+        TOP,
+        ZNEAR,
+        ZFAR,
+        QUANTITY
+    };
+
+    Frustum() = default;
+    explicit Frustum(glm::mat4 const & view_projection) { set(view_projection); }
+
+    void              set(glm::mat4 const & view_projection);
+    glm::vec4 const & getPlane(Plane plane) const { return m_planes[plane]; }
+
+    //! True if the box is inside or intersects the frustum
+    bool intersects(AABB const & box) const;
+
+    /*! Culls a batch of boxes
+        \param[in] boxes boxes in the frustum space
+        \param[out] visible indices of the boxes that are inside or intersect the frustum, in increasing order
+    */
+    void cull(AABBBatch const & boxes, std::vector<uint32_t> & visible) const;
+
+private:
+    std::array<glm::vec4, QUANTITY> m_planes = {};
+};
+
+#endif   // FRUSTUM_H
@@ -0,0 +1,518 @@
+#include "mesh_bvh.h"
+#include "vertex_buffer.h"
+#include "../core/cpu_features.h"
+#include <assert.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define MB_USE_SSE
+#endif
+
+#ifdef CPU_X86_DISPATCH
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+uint32_t const g_sah_bins  = 16;
+uint32_t const g_leaf_size = 4;   // triangles of one pack
+
+// xyz in the first three lanes, the fourth lane is 0
+struct RayData
+{
+    float origin[4];
+    float dir[4];
+    float inv_dir[4];
+};
+
+float SurfaceArea(AABB const & box)
+{
+    glm::vec3 const d = box.max() - box.min();
+
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// The kernels are templates on the node and pack types, which are private to MeshBVH
+
+// Slab test of a node box, t_enter is clamped to 0
+template<typename NodeT>
+bool RayHitsNodeScalar(NodeT const & node, RayData const & ray, float t_max, float & t_enter)
+{
+    float t0 = 0.0f;
+    float t1 = t_max;
+    for(uint32_t a = 0; a < 3; ++a)
+    {
+        float const ta = (node.min[a] - ray.origin[a]) * ray.inv_dir[a];
+        float const tb = (node.max[a] - ray.origin[a]) * ray.inv_dir[a];
+
+        t0 = std::max(t0, std::min(ta, tb));
+        t1 = std::min(t1, std::max(ta, tb));
+    }
+    t_enter = t0;
+
+    return t0 <= t1;
+}
+
+// Both children of a pair, bit c of the result is set if child c is hit
+template<typename NodeT>
+int RayHitsPairScalar(NodeT const * pair, RayData const & ray, float t_max, float t_enter[2])
+{
+    int mask = 0;
+    for(int c = 0; c < 2; ++c)
+    {
+        if(RayHitsNodeScalar(pair[c], ray, t_max, t_enter[c]))
+            mask |= 1 << c;
+    }
+
+    return mask;
+}
+
+#ifdef MB_USE_SSE
+// The node loads read the index word in the fourth lane, the masks replace it by the neutral values
+template<typename NodeT>
+int RayHitsPairSSE(NodeT const * pair, RayData const & ray, float t_max, float t_enter[2])
+{
+    __m128 const origin  = _mm_loadu_ps(ray.origin);
+    __m128 const inv_dir = _mm_loadu_ps(ray.inv_dir);
+    __m128 const xyz     = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 const far_w   = _mm_andnot_ps(xyz, _mm_set1_ps(t_max));
+
+    int mask = 0;
+    for(int c = 0; c < 2; ++c)
+    {
+        __m128 const ta = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pair[c].min), origin), inv_dir);
+        __m128 const tb = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pair[c].max), origin), inv_dir);
+
+        __m128 t0 = _mm_and_ps(_mm_min_ps(ta, tb), xyz);
+        __m128 t1 = _mm_or_ps(_mm_and_ps(_mm_max_ps(ta, tb), xyz), far_w);
+        t0        = _mm_max_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(1, 0, 3, 2)));
+        t0        = _mm_max_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(2, 3, 0, 1)));
+        t1        = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(1, 0, 3, 2)));
+        t1        = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        t_enter[c] = _mm_cvtss_f32(t0);
+        if(t_enter[c] <= _mm_cvtss_f32(t1))
+            mask |= 1 << c;
+    }
+
+    return mask;
+}
+#endif   // MB_USE_SSE
+
+#ifdef CPU_X86_DISPATCH
+// The pair is 64 contiguous bytes: min0 max0 min1 max1, each box is one 128 bit half
+template<typename NodeT>
+CPU_TARGET_AVX2 int RayHitsPairAVX2(NodeT const * pair, RayData const & ray, float t_max, float t_enter[2])
+{
+    static_assert(sizeof(NodeT) == 32, "the AVX2 kernel loads two 32 byte nodes");
+
+    __m128 const origin4  = _mm_loadu_ps(ray.origin);
+    __m128 const inv_dir4 = _mm_loadu_ps(ray.inv_dir);
+    __m256 const origin   = _mm256_insertf128_ps(_mm256_castps128_ps256(origin4), origin4, 1);
+    __m256 const inv_dir  = _mm256_insertf128_ps(_mm256_castps128_ps256(inv_dir4), inv_dir4, 1);
+    __m256 const xyz      = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0));
+    __m256 const far_w    = _mm256_andnot_ps(xyz, _mm256_set1_ps(t_max));
+
+    __m256 const node0 = _mm256_loadu_ps(pair[0].min);
+    __m256 const node1 = _mm256_loadu_ps(pair[1].min);
+    __m256 const mn    = _mm256_permute2f128_ps(node0, node1, 0x20);
+    __m256 const mx    = _mm256_permute2f128_ps(node0, node1, 0x31);
+
+    __m256 const ta = _mm256_mul_ps(_mm256_sub_ps(mn, origin), inv_dir);
+    __m256 const tb = _mm256_mul_ps(_mm256_sub_ps(mx, origin), inv_dir);
+
+    __m256 t0 = _mm256_and_ps(_mm256_min_ps(ta, tb), xyz);
+    __m256 t1 = _mm256_or_ps(_mm256_and_ps(_mm256_max_ps(ta, tb), xyz), far_w);
+    t0        = _mm256_max_ps(t0, _mm256_permute_ps(t0, _MM_SHUFFLE(1, 0, 3, 2)));
+    t0        = _mm256_max_ps(t0, _mm256_permute_ps(t0, _MM_SHUFFLE(2, 3, 0, 1)));
+    t1        = _mm256_min_ps(t1, _mm256_permute_ps(t1, _MM_SHUFFLE(1, 0, 3, 2)));
+    t1        = _mm256_min_ps(t1, _mm256_permute_ps(t1, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    float const enter0 = _mm_cvtss_f32(_mm256_castps256_ps128(t0));
+    float const enter1 = _mm_cvtss_f32(_mm256_extractf128_ps(t0, 1));
+    float const exit0  = _mm_cvtss_f32(_mm256_castps256_ps128(t1));
+    float const exit1  = _mm_cvtss_f32(_mm256_extractf128_ps(t1, 1));
+
+    t_enter[0] = enter0;
+    t_enter[1] = enter1;
+
+    return (enter0 <= exit0 ? 1 : 0) | (enter1 <= exit1 ? 2 : 0);
+}
+#endif   // CPU_X86_DISPATCH
+
+// Moller-Trumbore against the lanes of a pack, returns the lane of the closest hit before t_max or
+// g_leaf_size. t_max, u and v are updated on a hit
+template<typename PackT>
+uint32_t IntersectPackScalar(PackT const & pack, RayData const & ray, float & t_max, float & u, float & v)
+{
+    uint32_t result = g_leaf_size;
+    for(uint32_t l = 0; l < g_leaf_size; ++l)
+    {
+        glm::vec3 const d(ray.dir[0], ray.dir[1], ray.dir[2]);
+        glm::vec3 const e1(pack.e1[0][l], pack.e1[1][l], pack.e1[2][l]);
+        glm::vec3 const e2(pack.e2[0][l], pack.e2[1][l], pack.e2[2][l]);
+        glm::vec3 const p0(pack.p0[0][l], pack.p0[1][l], pack.p0[2][l]);
+
+        glm::vec3 const pvec = glm::cross(d, e2);
+        float const     det  = glm::dot(e1, pvec);
+        if(det == 0.0f)
+            continue;
+
+        float const     inv_det = 1.0f / det;
+        glm::vec3 const tvec    = glm::vec3(ray.origin[0], ray.origin[1], ray.origin[2]) - p0;
+        glm::vec3 const qvec    = glm::cross(tvec, e1);
+        float const     lu      = glm::dot(tvec, pvec) * inv_det;
+        float const     lv      = glm::dot(d, qvec) * inv_det;
+        float const     lt      = glm::dot(e2, qvec) * inv_det;
+
+        if(lu >= 0.0f && lv >= 0.0f && lu + lv <= 1.0f && lt >= 0.0f && lt < t_max)
+        {
+            t_max  = lt;
+            u      = lu;
+            v      = lv;
+            result = l;
+        }
+    }
+
+    return result;
+}
+
+#ifdef MB_USE_SSE
+template<typename PackT>
+uint32_t IntersectPackSSE(PackT const & pack, RayData const & ray, float & t_max, float & u, float & v)
+{
+    __m128 const zero = _mm_setzero_ps();
+    __m128 const one  = _mm_set1_ps(1.0f);
+
+    __m128 d[3], e1[3], e2[3], tvec[3];
+    for(uint32_t a = 0; a < 3; ++a)
+    {
+        d[a]    = _mm_set1_ps(ray.dir[a]);
+        e1[a]   = _mm_loadu_ps(pack.e1[a]);
+        e2[a]   = _mm_loadu_ps(pack.e2[a]);
+        tvec[a] = _mm_sub_ps(_mm_set1_ps(ray.origin[a]), _mm_loadu_ps(pack.p0[a]));
+    }
+
+    auto cross = [](__m128 const * a, __m128 const * b, __m128 * out) {
+        out[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+        out[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+        out[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+    };
+    auto dot = [](__m128 const * a, __m128 const * b) {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+    };
+
+    __m128 pvec[3], qvec[3];
+    cross(d, e2, pvec);
+    cross(tvec, e1, qvec);
+
+    __m128 const det     = dot(e1, pvec);
+    __m128 const inv_det = _mm_div_ps(one, det);
+    __m128 const lu      = _mm_mul_ps(dot(tvec, pvec), inv_det);
+    __m128 const lv      = _mm_mul_ps(dot(d, qvec), inv_det);
+    __m128 const lt      = _mm_mul_ps(dot(e2, qvec), inv_det);
+
+    // unused lanes have det == 0
+    __m128 valid = _mm_cmpneq_ps(det, zero);
+    valid        = _mm_and_ps(valid, _mm_cmpge_ps(lu, zero));
+    valid        = _mm_and_ps(valid, _mm_cmpge_ps(lv, zero));
+    valid        = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(lu, lv), one));
+    valid        = _mm_and_ps(valid, _mm_cmpge_ps(lt, zero));
+    valid        = _mm_and_ps(valid, _mm_cmplt_ps(lt, _mm_set1_ps(t_max)));
+
+    int const bits = _mm_movemask_ps(valid);
+    if(bits == 0)
+        return g_leaf_size;
+
+    float t[4], bu[4], bv[4];
+    _mm_storeu_ps(t, lt);
+    _mm_storeu_ps(bu, lu);
+    _mm_storeu_ps(bv, lv);
+
+    uint32_t result = g_leaf_size;
+    for(uint32_t l = 0; l < g_leaf_size; ++l)
+    {
+        if(((bits >> l) & 1) != 0 && t[l] < t_max)
+        {
+            t_max  = t[l];
+            u      = bu[l];
+            v      = bv[l];
+            result = l;
+        }
+    }
+
+    return result;
+}
+#endif   // MB_USE_SSE
+
+template<typename PackT>
+uint32_t IntersectPack(PackT const & pack, RayData const & ray, float & t_max, float & u, float & v)
+{
+#ifdef MB_USE_SSE
+    return IntersectPackSSE(pack, ray, t_max, u, v);
+#else
+    return IntersectPackScalar(pack, ray, t_max, u, v);
+#endif
+}
+}   // namespace
+
+struct MeshBVH::BuildData
+{
+    float const *          positions;
+    uint32_t const *       indices;
+    std::vector<AABB>      bounds;   // per triangle
+    std::vector<glm::vec3> centroids;
+};
+
+void MeshBVH::build(VertexBuffer const & vb)
+{
+    assert(vb.hasCpuData());
+
+    build(vb.getPositions(), vb.getIndices().data(), vb.getNumTriangles());
+}
+
+void MeshBVH::build(float const * positions, uint32_t const * indices, uint32_t num_triangles)
+{
+    clear();
+    if(num_triangles == 0)
+        return;
+
+    assert(positions != nullptr && indices != nullptr);
+
+    BuildData data;
+    data.positions = positions;
+    data.indices   = indices;
+    data.bounds.resize(num_triangles);
+    data.centroids.resize(num_triangles);
+
+    std::vector<uint32_t> ids(num_triangles);
+    for(uint32_t i = 0; i < num_triangles; ++i)
+    {
+        AABB & box = data.bounds[i];
+        for(uint32_t k = 0; k < 3; ++k)
+        {
+            float const * p = positions + 3 * indices[3 * i + k];
+            box.expandBy(glm::vec3(p[0], p[1], p[2]));
+        }
+        data.centroids[i] = (box.min() + box.max()) * 0.5f;
+        ids[i]            = i;
+    }
+
+    m_num_triangles = num_triangles;
+    m_nodes.reserve(2 * ((num_triangles + g_leaf_size - 1) / g_leaf_size) + 2);
+    m_packs.reserve((num_triangles + g_leaf_size - 1) / g_leaf_size);
+    m_nodes.resize(2);
+    buildRange(data, 0, ids.data(), num_triangles);
+
+    m_bounds = AABB(glm::vec3(m_nodes[0].min[0], m_nodes[0].min[1], m_nodes[0].min[2]),
+                    glm::vec3(m_nodes[0].max[0], m_nodes[0].max[1], m_nodes[0].max[2]));
+}
+
+void MeshBVH::clear()
+{
+    m_nodes.clear();
+    m_packs.clear();
+    m_bounds        = AABB();
+    m_num_triangles = 0;
+}
+
+void MeshBVH::buildRange(BuildData & data, uint32_t node, uint32_t * ids, uint32_t count)
+{
+    assert(count > 0);
+
+    AABB bounds, centroid_bounds;
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        bounds.expandBy(data.bounds[ids[i]]);
+        centroid_bounds.expandBy(data.centroids[ids[i]]);
+    }
+
+    for(int a = 0; a < 3; ++a)
+    {
+        m_nodes[node].min[a] = bounds.min()[a];
+        m_nodes[node].max[a] = bounds.max()[a];
+    }
+
+    if(count <= g_leaf_size)
+    {
+        TrianglePack pack = {};
+        for(uint32_t l = 0; l < count; ++l)
+        {
+            uint32_t const * tri = data.indices + 3 * ids[l];
+            float const *    p0  = data.positions + 3 * tri[0];
+            float const *    p1  = data.positions + 3 * tri[1];
+            float const *    p2  = data.positions + 3 * tri[2];
+            for(uint32_t a = 0; a < 3; ++a)
+            {
+                pack.p0[a][l] = p0[a];
+                pack.e1[a][l] = p1[a] - p0[a];
+                pack.e2[a][l] = p2[a] - p0[a];
+            }
+            pack.triangle[l] = ids[l];
+        }
+
+        m_nodes[node].first = static_cast<uint32_t>(m_packs.size());
+        m_nodes[node].count = count;
+        m_packs.push_back(pack);
+        return;
+    }
+
+    glm::vec3 const extent = centroid_bounds.max() - centroid_bounds.min();
+    int const       axis   = extent.x >= extent.y && extent.x >= extent.z ? 0
+                             : extent.y >= extent.z                     ? 1
+                                                                        : 2;
+    uint32_t        mid    = count / 2;
+
+    if(extent[axis] > 0.0f)
+    {
+        // Binned SAH: cost of splitting after bin i is N_left * A_left + N_right * A_right
+        float const cmin      = centroid_bounds.min()[axis];
+        float const bin_scale = static_cast<float>(g_sah_bins) / extent[axis];
+        auto        bin_of    = [&](uint32_t id) {
+            uint32_t const bin = static_cast<uint32_t>((data.centroids[id][axis] - cmin) * bin_scale);
+            return std::min(bin, g_sah_bins - 1);
+        };
+
+        AABB     bin_bounds[g_sah_bins];
+        uint32_t bin_count[g_sah_bins] = {};
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t const bin = bin_of(ids[i]);
+            bin_bounds[bin].expandBy(data.bounds[ids[i]]);
+            bin_count[bin]++;
+        }
+
+        float    right_area[g_sah_bins];
+        uint32_t right_count[g_sah_bins];
+        AABB     acc;
+        uint32_t acc_count = 0;
+        for(uint32_t b = g_sah_bins - 1; b > 0; --b)
+        {
+            acc.expandBy(bin_bounds[b]);
+            acc_count     += bin_count[b];
+            right_area[b]  = acc_count > 0 ? SurfaceArea(acc) : 0.0f;
+            right_count[b] = acc_count;
+        }
+
+        float    best_cost = max_float;
+        uint32_t best_bin  = 0;
+        acc                = AABB();
+        acc_count          = 0;
+        for(uint32_t b = 0; b + 1 < g_sah_bins; ++b)
+        {
+            acc.expandBy(bin_bounds[b]);
+            acc_count += bin_count[b];
+            if(acc_count == 0 || right_count[b + 1] == 0)
+                continue;
+
+            float const cost = static_cast<float>(acc_count) * SurfaceArea(acc)
+                               + static_cast<float>(right_count[b + 1]) * right_area[b + 1];
+            if(cost < best_cost)
+            {
+                best_cost = cost;
+                best_bin  = b;
+            }
+        }
+
+        if(best_cost < max_float)
+        {
+            uint32_t * split =
+                std::partition(ids, ids + count, [&](uint32_t id) { return bin_of(id) <= best_bin; });
+            mid = static_cast<uint32_t>(split - ids);
+        }
+    }
+
+    if(mid == 0 || mid == count || extent[axis] <= 0.0f)
+    {
+        mid = count / 2;
+        std::nth_element(ids, ids + mid, ids + count, [&](uint32_t a, uint32_t b) {
+            return data.centroids[a][axis] < data.centroids[b][axis];
+        });
+    }
+
+    uint32_t const first = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.resize(m_nodes.size() + 2);
+    m_nodes[node].first = first;
+    m_nodes[node].count = 0;
+
+    buildRange(data, first, ids, mid);
+    buildRange(data, first + 1, ids + mid, count - mid);
+}
+
+bool MeshBVH::intersect(Ray const & ray, float max_dist, MeshHit & hit) const
+{
+    if(m_nodes.empty())
+        return false;
+
+    RayData r;
+    for(int a = 0; a < 3; ++a)
+    {
+        r.origin[a]  = ray.origin[a];
+        r.dir[a]     = ray.direction[a];
+        r.inv_dir[a] = 1.0f / ray.direction[a];
+    }
+    r.origin[3] = r.dir[3] = r.inv_dir[3] = 0.0f;
+
+    float t_root;
+    if(!RayHitsNodeScalar(m_nodes[0], r, max_dist, t_root))
+        return false;
+
+    [[maybe_unused]] bool const avx2 = GetCpuFeatures().avx2;
+
+    float    closest = max_dist;
+    uint32_t hit_tri = BVH::null_index;
+    float    u = 0.0f, v = 0.0f;
+
+    std::vector<std::pair<uint32_t, float>> stack;
+    stack.reserve(64);
+    stack.emplace_back(0, t_root);
+    while(!stack.empty())
+    {
+        auto const [index, t_enter] = stack.back();
+        stack.pop_back();
+        if(t_enter >= closest)
+            continue;   // a closer hit was found after the push
+
+        Node const & node = m_nodes[index];
+        if(node.count > 0)
+        {
+            TrianglePack const & pack = m_packs[node.first];
+            uint32_t const       lane = IntersectPack(pack, r, closest, u, v);
+            if(lane < g_leaf_size)
+                hit_tri = pack.triangle[lane];
+            continue;
+        }
+
+        float t_child[2];
+        int   mask;
+#ifdef CPU_X86_DISPATCH
+        if(avx2)
+            mask = RayHitsPairAVX2(&m_nodes[node.first], r, closest, t_child);
+        else
+#endif
+#ifdef MB_USE_SSE
+            mask = RayHitsPairSSE(&m_nodes[node.first], r, closest, t_child);
+#else
+            mask = RayHitsPairScalar(&m_nodes[node.first], r, closest, t_child);
+#endif
+
+        // the closer child is popped first
+        uint32_t const closer  = (mask == 3 && t_child[1] < t_child[0]) || mask == 2 ? 1 : 0;
+        uint32_t const farther = 1 - closer;
+        if((mask >> farther) & 1)
+            stack.emplace_back(node.first + farther, t_child[farther]);
+        if((mask >> closer) & 1)
+            stack.emplace_back(node.first + closer, t_child[closer]);
+    }
+
+    if(hit_tri == BVH::null_index)
+        return false;
+
+    hit.triangle = hit_tri;
+    hit.u        = u;
+    hit.v        = v;
+    hit.distance = closest;
+
+    return true;
+}
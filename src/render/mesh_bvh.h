@@ -0,0 +1,71 @@
+#ifndef MESH_BVH_H
+#define MESH_BVH_H
+
+#include "AABB.h"
+#include "bvh.h"
+#include <cstdint>
+#include <vector>
+
+class VertexBuffer;
+
+struct MeshHit
+{
+    uint32_t triangle = 0;
+    float    u        = 0.0f;   // barycentrics: p = (1 - u - v) * p0 + u * p1 + v * p2
+    float    v        = 0.0f;
+    float    distance = 0.0f;   // in units of the ray direction length
+};
+
+//! Static triangle BVH of a mesh for ray queries
+/*!
+    Built with the binned SAH over triangle centroids. A leaf holds up to 4 triangles stored as one
+    structure of arrays pack, which the SSE2 kernel intersects at once (Moller-Trumbore); the two children
+    of a node are adjacent 32 byte nodes, tested with one AVX2 slab test when it is available.
+    The tree refers to no vertex data after the build.
+*/
+class MeshBVH
+{
+public:
+    //! Needs the positions and the indices on the CPU (Retention::ALL)
+    void build(VertexBuffer const & vb);
+    void build(float const * positions, uint32_t const * indices, uint32_t num_triangles);
+    void clear();
+
+    bool         empty() const { return m_nodes.empty(); }
+    AABB const & getBounds() const { return m_bounds; }
+    uint32_t     getNumTriangles() const { return m_num_triangles; }
+    uint32_t     getNumNodes() const { return static_cast<uint32_t>(m_nodes.size()); }
+
+    //! Closest hit, both triangle sides count. Returns false if nothing is hit before max_dist
+    bool intersect(Ray const & ray, float max_dist, MeshHit & hit) const;
+
+private:
+    struct Node
+    {
+        float    min[3];
+        uint32_t first;   // internal node: first node of the child pair, leaf: pack index
+        float    max[3];
+        uint32_t count;   // number of triangles of a leaf, 0 for internal nodes
+    };
+    static_assert(sizeof(Node) == 32, "MeshBVH node must be 32 bytes");
+
+    // p0 and the two edges of 4 triangles, unused lanes have zero edges
+    struct TrianglePack
+    {
+        float    p0[3][4];
+        float    e1[3][4];
+        float    e2[3][4];
+        uint32_t triangle[4];
+    };
+
+    // m_nodes[0] is the root, m_nodes[1] is unused, children pairs start at even indices
+    std::vector<Node>         m_nodes;
+    std::vector<TrianglePack> m_packs;
+    AABB                      m_bounds;
+    uint32_t                  m_num_triangles = 0;
+
+    struct BuildData;
+    void buildRange(BuildData & data, uint32_t node, uint32_t * ids, uint32_t count);
+};
+
+#endif   // MESH_BVH_H
@@ -0,0 +1,417 @@
+#include "occlusion_culler.h"
+#include "frustum.h"
+#include "vertex_buffer.h"
+#include "vertex_transform.h"
+#include "../core/cpu_features.h"
+#include "../core/parallel.h"
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define OC_USE_SSE
+#endif
+
+#ifdef CPU_X86_DISPATCH
+#    include <immintrin.h>
+#endif
+
+// The row kernels only use separate multiplies and adds, the 8 wide one is compiled for AVX without FMA
+// so the compiler can't contract them: every path computes bit identical depths and the buffer doesn't
+// depend on the CPU either.
+namespace
+{
+uint32_t const g_test_grain = 256;   // boxes per ParallelFor chunk
+
+// One row of a triangle: e_i(x) = edge_a[i] * x + edge_row[i], z(x) = dzdx * x + z_row
+struct RowSetup
+{
+    float edge_a[3];
+    float edge_row[3];
+    float dzdx;
+    float z_row;
+    float zmax;
+};
+
+// Kernels update the pixels [x, end) of the row and return the first unprocessed one
+uint32_t RasterRowScalar(RowSetup const & r, float * row, uint32_t x, uint32_t end)
+{
+    for(; x < end; ++x)
+    {
+        float const fx = static_cast<float>(x) + 0.5f;
+        if(r.edge_a[0] * fx + r.edge_row[0] >= 0.0f && r.edge_a[1] * fx + r.edge_row[1] >= 0.0f
+           && r.edge_a[2] * fx + r.edge_row[2] >= 0.0f)
+        {
+            float const z = std::min(r.dzdx * fx + r.z_row, r.zmax);
+            row[x]        = std::min(row[x], z);
+        }
+    }
+
+    return x;
+}
+
+#ifdef OC_USE_SSE
+uint32_t RasterRowSSE(RowSetup const & r, float * row, uint32_t x, uint32_t end)
+{
+    __m128 const zero = _mm_setzero_ps();
+    __m128 const step = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 const zmax = _mm_set1_ps(r.zmax);
+
+    for(; x + 4 <= end; x += 4)
+    {
+        __m128 const fx = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), step);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(uint32_t i = 0; i < 3; ++i)
+        {
+            __m128 const e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(r.edge_a[i]), fx), _mm_set1_ps(r.edge_row[i]));
+            inside         = _mm_and_ps(inside, _mm_cmpge_ps(e, zero));
+        }
+        if(_mm_movemask_ps(inside) == 0)
+            continue;
+
+        __m128 const z     = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(r.dzdx), fx), _mm_set1_ps(r.z_row));
+        __m128 const old   = _mm_loadu_ps(row + x);
+        __m128 const depth = _mm_min_ps(old, _mm_min_ps(z, zmax));
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, depth), _mm_andnot_ps(inside, old)));
+    }
+
+    return x;
+}
+#endif   // OC_USE_SSE
+
+#ifdef CPU_X86_DISPATCH
+CPU_TARGET_AVX uint32_t RasterRowAVX(RowSetup const & r, float * row, uint32_t x, uint32_t end)
+{
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const step = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    __m256 const zmax = _mm256_set1_ps(r.zmax);
+
+    for(; x + 8 <= end; x += 8)
+    {
+        __m256 const fx = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), step);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(uint32_t i = 0; i < 3; ++i)
+        {
+            __m256 const e =
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r.edge_a[i]), fx), _mm256_set1_ps(r.edge_row[i]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(e, zero, _CMP_GE_OQ));
+        }
+        if(_mm256_movemask_ps(inside) == 0)
+            continue;
+
+        __m256 const z   = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r.dzdx), fx), _mm256_set1_ps(r.z_row));
+        __m256 const old = _mm256_loadu_ps(row + x);
+        _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, _mm256_min_ps(z, zmax)), inside));
+    }
+
+    return x;
+}
+#endif   // CPU_X86_DISPATCH
+
+// Any pixel of [x, end) whose depth is behind zmin
+bool RowHasFartherDepth(float const * row, uint32_t x, uint32_t end, float zmin)
+{
+#ifdef OC_USE_SSE
+    __m128 const z = _mm_set1_ps(zmin);
+    for(; x + 4 <= end; x += 4)
+    {
+        if(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), z)) != 0)
+            return true;
+    }
+#endif
+    for(; x < end; ++x)
+    {
+        if(row[x] >= zmin)
+            return true;
+    }
+
+    return false;
+}
+}   // namespace
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height) : m_width(width), m_height(height)
+{
+    assert(width > 0 && width % 8 == 0);
+    assert(height > 0 && height % tile_size == 0);
+
+    m_depth.assign(m_width * m_height, 1.0f);
+    m_tile_depth.assign((m_width / tile_size) * (m_height / tile_size), 1.0f);
+}
+
+uint32_t OcclusionCuller::addOccluder(VertexBuffer const & vb, glm::mat4 const & model)
+{
+    assert(vb.hasCpuData());
+
+    Occluder occluder;
+    occluder.positions.resize(3 * vb.getNumVertex());
+    TransformPositions(model, vb.getPositions(), occluder.positions.data(), vb.getNumVertex());
+    occluder.indices = vb.getIndices();
+    occluder.bounds  = AABBBatch::ReducePoints(occluder.positions.data(), vb.getNumVertex());
+
+    m_occluders.push_back(std::move(occluder));
+
+    return static_cast<uint32_t>(m_occluders.size() - 1);
+}
+
+void OcclusionCuller::setOccluderEnabled(uint32_t occluder, bool enabled)
+{
+    assert(occluder < m_occluders.size());
+
+    m_occluders[occluder].enabled = enabled;
+}
+
+void OcclusionCuller::clearOccluders()
+{
+    m_occluders.clear();
+    m_triangles.clear();
+}
+
+void OcclusionCuller::render(glm::mat4 const & view_projection)
+{
+    m_view_projection = view_projection;
+    m_triangles.clear();
+
+    Frustum const frustum(view_projection);
+    for(auto const & occluder : m_occluders)
+    {
+        if(occluder.enabled && frustum.intersects(occluder.bounds))
+            setupTriangles(occluder);
+    }
+    m_num_rasterized = static_cast<uint32_t>(m_triangles.size());
+
+    ParallelFor(m_height / tile_size, 1, [this](uint32_t begin, uint32_t end) {
+        for(uint32_t band = begin; band < end; ++band)
+            rasterizeBand(band);
+    });
+}
+
+void OcclusionCuller::setupTriangles(Occluder const & occluder)
+{
+    uint32_t const         num_vertices = static_cast<uint32_t>(occluder.positions.size() / 3);
+    std::vector<glm::vec4> clip(num_vertices);
+    for(uint32_t i = 0; i < num_vertices; ++i)
+    {
+        float const * p = occluder.positions.data() + 3 * i;
+        clip[i]         = m_view_projection * glm::vec4(p[0], p[1], p[2], 1.0f);
+    }
+
+    for(size_t t = 0; t + 2 < occluder.indices.size(); t += 3)
+    {
+        glm::vec4 const v[3] = {clip[occluder.indices[t]], clip[occluder.indices[t + 1]],
+                                clip[occluder.indices[t + 2]]};
+
+        // all vertices outside one of the side or far planes
+        bool outside = false;
+        for(int a = 0; a < 3 && !outside; ++a)
+        {
+            outside = (v[0][a] > v[0].w && v[1][a] > v[1].w && v[2][a] > v[2].w)
+                      || (a < 2 && v[0][a] < -v[0].w && v[1][a] < -v[1].w && v[2][a] < -v[2].w);
+        }
+        if(outside)
+            continue;
+
+        // clip by the near plane z + w >= 0, a triangle becomes at most a quad
+        glm::vec4 poly[4];
+        uint32_t  count = 0;
+        for(uint32_t i = 0; i < 3; ++i)
+        {
+            glm::vec4 const & cur  = v[i];
+            glm::vec4 const & next = v[(i + 1) % 3];
+            float const       dc   = cur.z + cur.w;
+            float const       dn   = next.z + next.w;
+
+            if(dc >= 0.0f)
+                poly[count++] = cur;
+            if((dc >= 0.0f) != (dn >= 0.0f))
+                poly[count++] = cur + (next - cur) * (dc / (dc - dn));
+        }
+
+        for(uint32_t i = 2; i < count; ++i)
+            addTriangle(poly[0], poly[i - 1], poly[i]);
+    }
+}
+
+void OcclusionCuller::addTriangle(glm::vec4 const & a, glm::vec4 const & b, glm::vec4 const & c)
+{
+    float const w = static_cast<float>(m_width);
+    float const h = static_cast<float>(m_height);
+
+    // pixel space, y goes up as in the window coordinates of GL
+    glm::vec3 p[3];
+    glm::vec4 const * clip[3] = {&a, &b, &c};
+    for(int i = 0; i < 3; ++i)
+    {
+        glm::vec3 const ndc = glm::vec3(*clip[i]) / clip[i]->w;
+        p[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * w, (ndc.y * 0.5f + 0.5f) * h, ndc.z * 0.5f + 0.5f);
+    }
+
+    float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+    if(area == 0.0f || !std::isfinite(area))
+        return;
+    if(area < 0.0f)
+    {
+        // occluders are two sided
+        std::swap(p[1], p[2]);
+        area = -area;
+    }
+
+    // pixel centers are at +0.5
+    float const xmin = std::max(std::ceil(std::min({p[0].x, p[1].x, p[2].x}) - 0.5f), 0.0f);
+    float const xmax = std::min(std::floor(std::max({p[0].x, p[1].x, p[2].x}) - 0.5f), w - 1.0f);
+    float const ymin = std::max(std::ceil(std::min({p[0].y, p[1].y, p[2].y}) - 0.5f), 0.0f);
+    float const ymax = std::min(std::floor(std::max({p[0].y, p[1].y, p[2].y}) - 0.5f), h - 1.0f);
+    if(xmin > xmax || ymin > ymax)
+        return;
+
+    Triangle tri;
+    for(int i = 0; i < 3; ++i)
+    {
+        glm::vec3 const & p0 = p[i];
+        glm::vec3 const & p1 = p[(i + 1) % 3];
+
+        tri.edge[i][0] = p0.y - p1.y;
+        tri.edge[i][1] = p1.x - p0.x;
+        tri.edge[i][2] = -(tri.edge[i][0] * p0.x + tri.edge[i][1] * p0.y);
+    }
+
+    float const dz1 = p[1].z - p[0].z;
+    float const dz2 = p[2].z - p[0].z;
+    tri.dzdx        = (dz1 * (p[2].y - p[0].y) - dz2 * (p[1].y - p[0].y)) / area;
+    tri.dzdy        = (dz2 * (p[1].x - p[0].x) - dz1 * (p[2].x - p[0].x)) / area;
+    // the plane is evaluated at pixel centers, the offset moves it to the farthest pixel corner
+    tri.z0 = p[0].z - tri.dzdx * p[0].x - tri.dzdy * p[0].y;
+    tri.z0 += 0.5f * (std::abs(tri.dzdx) + std::abs(tri.dzdy));
+    tri.zmax = std::max({p[0].z, p[1].z, p[2].z});
+    tri.xmin = static_cast<uint32_t>(xmin);
+    tri.xmax = static_cast<uint32_t>(xmax);
+    tri.ymin = static_cast<uint32_t>(ymin);
+    tri.ymax = static_cast<uint32_t>(ymax);
+
+    m_triangles.push_back(tri);
+}
+
+void OcclusionCuller::rasterizeBand(uint32_t band)
+{
+    uint32_t const y0 = band * tile_size;
+    uint32_t const y1 = y0 + tile_size;   // exclusive
+
+    std::fill(m_depth.begin() + y0 * m_width, m_depth.begin() + y1 * m_width, 1.0f);
+
+    [[maybe_unused]] bool const avx = GetCpuFeatures().avx;
+    for(auto const & tri : m_triangles)
+    {
+        if(tri.ymax < y0 || tri.ymin >= y1)
+            continue;
+
+        // whole vector groups, the edge functions reject the pixels outside the triangle
+        uint32_t const x_begin = tri.xmin & ~7u;
+        uint32_t const x_end   = std::min((tri.xmax + 8) & ~7u, m_width);
+        for(uint32_t y = std::max(tri.ymin, y0); y <= std::min(tri.ymax, y1 - 1); ++y)
+        {
+            float const fy = static_cast<float>(y) + 0.5f;
+
+            RowSetup r;
+            for(int i = 0; i < 3; ++i)
+            {
+                r.edge_a[i]   = tri.edge[i][0];
+                r.edge_row[i] = tri.edge[i][1] * fy + tri.edge[i][2];
+            }
+            r.dzdx  = tri.dzdx;
+            r.z_row = tri.dzdy * fy + tri.z0;
+            r.zmax  = tri.zmax;
+
+            float *  row = m_depth.data() + y * m_width;
+            uint32_t x   = x_begin;
+#ifdef CPU_X86_DISPATCH
+            if(avx)
+                x = RasterRowAVX(r, row, x, x_end);
+#endif
+#ifdef OC_USE_SSE
+            x = RasterRowSSE(r, row, x, x_end);
+#endif
+            RasterRowScalar(r, row, x, x_end);
+        }
+    }
+
+    uint32_t const tiles_x = m_width / tile_size;
+    for(uint32_t tx = 0; tx < tiles_x; ++tx)
+    {
+        float farthest = 0.0f;
+        for(uint32_t y = y0; y < y1; ++y)
+        {
+            float const * row = m_depth.data() + y * m_width + tx * tile_size;
+            farthest          = std::max(farthest, *std::max_element(row, row + tile_size));
+        }
+        m_tile_depth[band * tiles_x + tx] = farthest;
+    }
+}
+
+bool OcclusionCuller::isVisible(AABB const & box) const
+{
+    glm::vec3 const corners[2] = {box.min(), box.max()};
+
+    glm::vec3 ndc_min(max_float), ndc_max(min_float);
+    for(int i = 0; i < 8; ++i)
+    {
+        glm::vec4 const corner(corners[i & 1].x, corners[(i >> 1) & 1].y, corners[(i >> 2) & 1].z, 1.0f);
+        glm::vec4 const clip = m_view_projection * corner;
+        if(clip.z < -clip.w)
+            return true;   // crosses the near plane
+
+        glm::vec3 const ndc = glm::vec3(clip) / clip.w;
+        ndc_min             = glm::min(ndc_min, ndc);
+        ndc_max             = glm::max(ndc_max, ndc);
+    }
+
+    if(ndc_max.x < -1.0f || ndc_min.x > 1.0f || ndc_max.y < -1.0f || ndc_min.y > 1.0f)
+        return false;
+
+    float const w  = static_cast<float>(m_width);
+    float const h  = static_cast<float>(m_height);
+    float const x0 = std::max(std::floor((ndc_min.x * 0.5f + 0.5f) * w), 0.0f);
+    float const x1 = std::min(std::ceil((ndc_max.x * 0.5f + 0.5f) * w) - 1.0f, w - 1.0f);
+    float const y0 = std::max(std::floor((ndc_min.y * 0.5f + 0.5f) * h), 0.0f);
+    float const y1 = std::min(std::ceil((ndc_max.y * 0.5f + 0.5f) * h) - 1.0f, h - 1.0f);
+    if(x0 > x1 || y0 > y1)
+        return false;
+
+    return testRect(static_cast<uint32_t>(x0), static_cast<uint32_t>(y0), static_cast<uint32_t>(x1),
+                    static_cast<uint32_t>(y1), ndc_min.z * 0.5f + 0.5f);
+}
+
+bool OcclusionCuller::testRect(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, float zmin) const
+{
+    uint32_t const tiles_x = m_width / tile_size;
+    for(uint32_t ty = y0 / tile_size; ty <= y1 / tile_size; ++ty)
+    {
+        for(uint32_t tx = x0 / tile_size; tx <= x1 / tile_size; ++tx)
+        {
+            if(zmin > m_tile_depth[ty * tiles_x + tx])
+                continue;   // hidden in the whole tile
+
+            uint32_t const px0 = std::max(x0, tx * tile_size);
+            uint32_t const px1 = std::min(x1 + 1, (tx + 1) * tile_size);
+            uint32_t const py0 = std::max(y0, ty * tile_size);
+            uint32_t const py1 = std::min(y1 + 1, (ty + 1) * tile_size);
+            for(uint32_t y = py0; y < py1; ++y)
+            {
+                if(RowHasFartherDepth(m_depth.data() + y * m_width, px0, px1, zmin))
+                    return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void OcclusionCuller::test(AABBBatch const & boxes, std::vector<uint8_t> & visible) const
+{
+    visible.resize(boxes.size());
+    ParallelFor(boxes.size(), g_test_grain, [&](uint32_t begin, uint32_t end) {
+        for(uint32_t i = begin; i < end; ++i)
+            visible[i] = isVisible(boxes.get(i)) ? 1 : 0;
+    });
+}
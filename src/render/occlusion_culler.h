@@ -0,0 +1,79 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include "AABB.h"
+#include "aabb_batch.h"
+#include <cstdint>
+#include <vector>
+
+class VertexBuffer;
+
+//! Software occlusion culling
+/*!
+    The registered occluder meshes are rasterized on the CPU into a small depth buffer, then object
+    boxes are tested against it before they are submitted to the renderer. The buffer keeps the
+    depth ([0, 1], larger is farther) rounded to the farthest value over the pixel area, and every
+    8x8 tile keeps the farthest depth of its pixels: a box whose nearest depth is behind it is hidden
+    in the whole tile. Rows are rendered in bands of one tile row on the worker threads; a pixel only
+    takes the minimum of the depths written to it, so the result doesn't depend on the thread count.
+*/
+class OcclusionCuller
+{
+public:
+    constexpr static uint32_t tile_size = 8;
+
+    //! width must be a multiple of 8, height of tile_size
+    OcclusionCuller(uint32_t width = 256, uint32_t height = 128);
+
+    //! Copies the world space triangles, the buffer needs its positions and indices on the CPU
+    uint32_t addOccluder(VertexBuffer const & vb, glm::mat4 const & model);
+    void     setOccluderEnabled(uint32_t occluder, bool enabled);
+    void     clearOccluders();
+
+    //! Rasterizes the enabled occluders seen through the camera
+    void render(glm::mat4 const & view_projection);
+
+    //! True if a part of the world space box may be seen, boxes crossing the near plane always are
+    bool isVisible(AABB const & box) const;
+    //! visible[i] is 1 if box i may be seen
+    void test(AABBBatch const & boxes, std::vector<uint8_t> & visible) const;
+
+    uint32_t      getWidth() const { return m_width; }
+    uint32_t      getHeight() const { return m_height; }
+    float const * getDepth() const { return m_depth.data(); }
+    uint32_t      getNumRasterizedTriangles() const { return m_num_rasterized; }
+
+private:
+    struct Occluder
+    {
+        std::vector<float>    positions;   // world space
+        std::vector<uint32_t> indices;
+        AABB                  bounds;
+        bool                  enabled = true;
+    };
+
+    // Screen space triangle: edge functions a * x + b * y + c >= 0 inside, depth z0 + dzdx * x + dzdy * y
+    struct Triangle
+    {
+        float    edge[3][3];
+        float    z0, dzdx, dzdy;
+        float    zmax;
+        uint32_t xmin, xmax, ymin, ymax;   // pixel bounds, inclusive
+    };
+
+    uint32_t const        m_width;
+    uint32_t const        m_height;
+    std::vector<float>    m_depth;
+    std::vector<float>    m_tile_depth;   // farthest depth of every tile
+    std::vector<Occluder> m_occluders;
+    std::vector<Triangle> m_triangles;
+    glm::mat4             m_view_projection = glm::mat4(1.0f);
+    uint32_t              m_num_rasterized  = 0;
+
+    void setupTriangles(Occluder const & occluder);
+    void addTriangle(glm::vec4 const & a, glm::vec4 const & b, glm::vec4 const & c);   // clip space
+    void rasterizeBand(uint32_t band);
+    bool testRect(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, float zmin) const;
+};
+
+#endif   // OCCLUSION_CULLER_H
@@ -0,0 +1,114 @@
+#include "occlusion_queries.h"
+#include "renderer.h"
+#include <assert.h>
+#include <algorithm>
+
+namespace
+{
+float const g_proxy_margin = 0.01f;   // box growth, fraction of the size, keeps flat boxes from z-fighting
+float const g_min_margin   = 1e-3f;
+
+// The proxy is clipped by the near plane when the camera is inside or close to the box, the query could
+// then miss a visible object
+bool CrossesNearPlane(glm::mat4 const & view_projection, AABB const & box)
+{
+    glm::vec3 const corners[2] = {box.min(), box.max()};
+    for(int i = 0; i < 8; ++i)
+    {
+        glm::vec4 const corner(corners[i & 1].x, corners[(i >> 1) & 1].y, corners[(i >> 2) & 1].z, 1.0f);
+        glm::vec4 const clip = view_projection * corner;
+        if(clip.z < -clip.w)
+            return true;
+    }
+
+    return false;
+}
+}   // namespace
+
+OcclusionQueries::OcclusionQueries(Settings const & settings) : m_settings(settings)
+{
+    assert(m_settings.visible_interval > 0 && m_settings.occluded_interval > 0);
+}
+
+void OcclusionQueries::resize(uint32_t num_objects)
+{
+    m_objects.resize(num_objects);   // release() first when shrinking
+}
+
+void OcclusionQueries::release(RendererBase const & render)
+{
+    for(auto & obj : m_objects)
+    {
+        render.deleteQuery(obj.query);
+        obj = ObjectState();
+    }
+}
+
+void OcclusionQueries::reset()
+{
+    for(auto & obj : m_objects)
+        obj = ObjectState();
+}
+
+void OcclusionQueries::beginFrame(RendererBase const & render)
+{
+    ++m_frame;
+    m_num_issued = 0;
+
+    for(auto & obj : m_objects)
+    {
+        uint32_t samples;
+        if(obj.pending && render.getQueryResult(obj.query, samples))
+        {
+            obj.pending = false;
+            if(!obj.stale)
+                obj.visible = samples > 0;
+            obj.stale = false;
+        }
+    }
+}
+
+void OcclusionQueries::issue(RendererBase const & render, uint32_t object, AABB const & bounds)
+{
+    assert(object < m_objects.size());
+
+    ObjectState & obj = m_objects[object];
+    if(obj.pending)
+        return;   // the previous result is still on its way
+
+    uint32_t const interval = obj.visible ? m_settings.visible_interval : m_settings.occluded_interval;
+    if((m_frame + object) % interval != 0)
+        return;
+
+    glm::vec3 const margin = (bounds.max() - bounds.min()) * g_proxy_margin + glm::vec3(g_min_margin);
+    AABB const      proxy(bounds.min() - margin, bounds.max() + margin);
+
+    glm::mat4 const view_projection = render.getMatrix(RendererBase::MatrixType::PROJECTION)
+                                      * render.getMatrix(RendererBase::MatrixType::MODELVIEW);
+    if(CrossesNearPlane(view_projection, proxy))
+    {
+        obj.visible = true;
+        return;
+    }
+
+    if(obj.query == 0)
+        obj.query = render.createQuery();
+    render.drawBBoxQuery(obj.query, proxy);
+    obj.pending = true;
+    ++m_num_issued;
+}
+
+void OcclusionQueries::forget(uint32_t object)
+{
+    assert(object < m_objects.size());
+
+    ObjectState & obj = m_objects[object];
+    obj.visible       = true;
+    obj.stale         = obj.pending;
+}
+
+uint32_t OcclusionQueries::getNumPending() const
+{
+    return static_cast<uint32_t>(
+        std::count_if(m_objects.begin(), m_objects.end(), [](ObjectState const & s) { return s.pending; }));
+}
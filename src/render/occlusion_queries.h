@@ -0,0 +1,62 @@
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include "AABB.h"
+#include <cstdint>
+#include <vector>
+
+class RendererBase;
+
+//! Hardware occlusion queries with temporal coherence
+/*!
+    Every object keeps its last known visibility. Queries draw the object box after the scene and
+    their results are collected the next frame (or later), so the CPU never waits for the GPU:
+    objects visible last time are drawn right away, occluded ones are skipped until a query says
+    otherwise. Visible objects are rechecked every visible_interval frames and occluded ones every
+    occluded_interval frames, staggered by the object id.
+*/
+class OcclusionQueries
+{
+public:
+    struct Settings
+    {
+        uint32_t visible_interval  = 4;
+        uint32_t occluded_interval = 1;
+    };
+
+    OcclusionQueries() = default;
+    explicit OcclusionQueries(Settings const & settings);
+
+    void resize(uint32_t num_objects);
+    void release(RendererBase const & render);   // deletes the GL queries
+    void reset();                                // forgets the queries of a destroyed context
+
+    //! Collects the results that are available, never waits
+    void beginFrame(RendererBase const & render);
+    //! Last known result, objects never tested are visible
+    bool isVisible(uint32_t object) const { return m_objects[object].visible; }
+    //! Issues the query of the object if it is due, call after the visible objects are drawn
+    void issue(RendererBase const & render, uint32_t object, AABB const & bounds);
+    //! For objects rejected by the CPU tests: they are visible again when they come back, a pending
+    //! result is dropped
+    void forget(uint32_t object);
+
+    uint32_t getNumIssued() const { return m_num_issued; }   // in the current frame
+    uint32_t getNumPending() const;
+
+private:
+    struct ObjectState
+    {
+        uint32_t query   = 0;
+        bool     pending = false;
+        bool     visible = true;
+        bool     stale   = false;   // the pending result is dropped
+    };
+
+    Settings                 m_settings;
+    std::vector<ObjectState> m_objects;
+    uint32_t                 m_frame      = 0;
+    uint32_t                 m_num_issued = 0;
+};
+
+#endif   // OCCLUSION_QUERIES_H
@@ -0,0 +1,99 @@
+#include "pixel_upload_ring.h"
+#include <assert.h>
+
+PixelUploadRing::~PixelUploadRing()
+{
+    assert(m_slots.empty());
+}
+
+void PixelUploadRing::init(RendererBase const & render, uint32_t num_slots, size_t slot_size)
+{
+    assert(m_slots.empty() && num_slots > 0 && slot_size > 0);
+
+    if(!render.hasPixelBuffers())
+        return;
+
+    m_slot_size = slot_size;
+    m_slots.resize(num_slots);
+    for(Slot & slot : m_slots)
+        slot.buffer = render.createPixelBuffer(slot_size, false);
+}
+
+void PixelUploadRing::release(RendererBase const & render)
+{
+    for(Slot & slot : m_slots)
+    {
+        if(slot.state == Slot::State::MAPPED)
+            render.unmapPixelBuffer(slot.buffer, false);
+
+        render.deleteFence(slot.fence);
+        render.deletePixelBuffer(slot.buffer);
+    }
+
+    m_slots.clear();
+    m_slot_size = 0;
+}
+
+PixelUploadRing::Slot * PixelUploadRing::acquire(RendererBase const & render, size_t size)
+{
+    if(size > m_slot_size)
+        return nullptr;
+
+    for(uint32_t i = 0; i < m_slots.size(); ++i)
+    {
+        uint32_t const index = (m_next + i) % static_cast<uint32_t>(m_slots.size());
+        Slot &         slot  = m_slots[index];
+
+        if(slot.state == Slot::State::FENCED && render.isFenceSignalled(slot.fence))
+        {
+            render.deleteFence(slot.fence);
+            slot.state = Slot::State::FREE;
+        }
+
+        if(slot.state != Slot::State::FREE)
+            continue;
+
+        slot.data = render.mapPixelBuffer(slot.buffer, size, false);
+        if(slot.data == nullptr)
+            return nullptr;
+
+        slot.state = Slot::State::MAPPED;
+        m_next     = index + 1;
+
+        return &slot;
+    }
+
+    return nullptr;
+}
+
+bool PixelUploadRing::unmap(RendererBase const & render, Slot * slot)
+{
+    assert(slot != nullptr && slot->state == Slot::State::MAPPED);
+
+    slot->data = nullptr;
+    if(!render.unmapPixelBuffer(slot->buffer, false))
+    {
+        slot->state = Slot::State::FREE;
+        return false;
+    }
+
+    slot->state = Slot::State::FILLED;
+    return true;
+}
+
+void PixelUploadRing::retire(RendererBase const & render, Slot * slot)
+{
+    assert(slot != nullptr && slot->state != Slot::State::FREE && slot->state != Slot::State::FENCED);
+
+    if(slot->state == Slot::State::MAPPED)
+    {
+        // nothing was uploaded from it
+        render.unmapPixelBuffer(slot->buffer, false);
+        slot->data  = nullptr;
+        slot->state = Slot::State::FREE;
+        return;
+    }
+
+    slot->fence = render.insertFence();
+    slot->state = Slot::State::FENCED;
+}
@@ -0,0 +1,60 @@
+#ifndef PIXEL_UPLOAD_RING_H
+#define PIXEL_UPLOAD_RING_H
+
+#include "renderer.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! Ring of pixel unpack buffers for texture uploads
+/*!
+    A slot is mapped on the context thread, filled by any thread (decoders write straight into it)
+    and unmapped again on the context thread; the uploads then read it with glTexSubImage2D, so the
+    driver doesn't copy client memory on the calling thread. A retired slot is reused once the fence
+    behind its uploads has passed. All calls are for the context thread.
+*/
+class PixelUploadRing
+{
+public:
+    struct Slot
+    {
+        enum class State
+        {
+            FREE,
+            MAPPED,   // being filled
+            FILLED,   // unmapped, uploads pending
+            FENCED    // uploads issued, waiting for the GPU
+        };
+
+        uint32_t            buffer = 0;
+        uint8_t *           data   = nullptr;   // while mapped
+        RendererBase::Fence fence  = nullptr;
+        State               state  = State::FREE;
+    };
+
+    constexpr static uint32_t default_num_slots = 4;
+    constexpr static size_t   default_slot_size = 4u << 20;   // a 1024x1024 RGBA image
+
+    ~PixelUploadRing();   // release() must have been called while the context was alive
+
+    //! Does nothing when the renderer has no pixel buffers, acquire() then always fails
+    void init(RendererBase const & render, uint32_t num_slots = default_num_slots,
+              size_t slot_size = default_slot_size);
+    void release(RendererBase const & render);
+
+    //! A free slot mapped for writing, nullptr if the size doesn't fit or all slots are busy
+    Slot * acquire(RendererBase const & render, size_t size);
+    //! Ends the writing, false if the contents were lost (the slot is free again)
+    bool   unmap(RendererBase const & render, Slot * slot);
+    //! After the last upload from the slot, also takes mapped slots back
+    void   retire(RendererBase const & render, Slot * slot);
+
+    size_t getSlotSize() const { return m_slot_size; }
+
+private:
+    std::vector<Slot> m_slots;
+    size_t            m_slot_size = 0;
+    uint32_t          m_next      = 0;   // round robin start of the free slot search
+};
+
+#endif   // PIXEL_UPLOAD_RING_H
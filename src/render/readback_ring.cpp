@@ -0,0 +1,130 @@
+#include "readback_ring.h"
+#include <assert.h>
+#include <algorithm>
+#include <cstring>
+
+ReadbackRing::~ReadbackRing()
+{
+    assert(m_slots.empty());
+}
+
+void ReadbackRing::init(RendererBase const & render, uint32_t num_slots)
+{
+    assert(m_slots.empty() && num_slots > 0);
+
+    m_use_buffers = render.hasPixelBuffers();
+    m_slots.resize(num_slots);
+}
+
+void ReadbackRing::release(RendererBase const & render)
+{
+    for(Slot & slot : m_slots)
+    {
+        render.deleteFence(slot.fence);
+        render.deletePixelBuffer(slot.buffer);
+    }
+
+    m_slots.clear();
+    m_pending.clear();
+}
+
+bool ReadbackRing::read(RendererBase const & render, Texture const & tex, Callback on_ready,
+                        Texture::CubeFace face)
+{
+    return readInto(render, tex, nullptr, std::move(on_ready), face);
+}
+
+bool ReadbackRing::readInto(RendererBase const & render, Texture const & tex, uint8_t * dst,
+                            Callback on_ready, Texture::CubeFace face)
+{
+    auto const free_slot =
+        std::find_if(m_slots.begin(), m_slots.end(), [](Slot const & slot) { return !slot.busy; });
+    if(free_slot == m_slots.end())
+        return false;
+
+    Slot &       slot = *free_slot;
+    size_t const size = static_cast<size_t>(tex.m_width) * tex.m_height * 4;
+
+    slot.image           = {};
+    slot.image.width     = tex.m_width;
+    slot.image.height    = tex.m_height;
+    slot.image.data_size = static_cast<uint32_t>(size);
+    slot.image.type      = tex::ImageData::PixelType::pt_bgra;
+    slot.dst             = dst;
+    slot.on_ready        = std::move(on_ready);
+    slot.busy            = true;
+
+    if(m_use_buffers)
+    {
+        if(slot.capacity < size)
+        {
+            render.deletePixelBuffer(slot.buffer);
+            slot.buffer   = render.createPixelBuffer(size, true);
+            slot.capacity = size;
+        }
+
+        render.readTextureData(tex, slot.buffer, nullptr, face);
+        slot.fence = render.insertFence();
+    }
+    else
+    {
+        if(dst == nullptr)
+        {
+            slot.image.data = std::make_unique<uint8_t[]>(size);
+            dst             = slot.image.data.get();
+        }
+        render.readTextureData(tex, 0, dst, face);
+    }
+
+    m_pending.push_back(static_cast<uint32_t>(free_slot - m_slots.begin()));
+
+    return true;
+}
+
+void ReadbackRing::update(RendererBase const & render)
+{
+    while(!m_pending.empty())
+    {
+        Slot & slot = m_slots[m_pending.front()];
+
+        if(slot.fence != nullptr)
+        {
+            // the fences pass in order, the newer reads aren't done either
+            if(!render.isFenceSignalled(slot.fence))
+                break;
+            render.deleteFence(slot.fence);
+
+            size_t const    size = slot.image.data_size;
+            uint8_t const * src  = render.mapPixelBuffer(slot.buffer, size, true);
+            if(src != nullptr)
+            {
+                uint8_t * dst = slot.dst;
+                if(dst == nullptr)
+                {
+                    slot.image.data = std::make_unique<uint8_t[]>(size);
+                    dst             = slot.image.data.get();
+                }
+                std::memcpy(dst, src, size);
+            }
+
+            // a failed map leaves nothing to unmap, the image has no pixels either way
+            if(src == nullptr || !render.unmapPixelBuffer(slot.buffer, true))
+            {
+                slot.image.data.reset();
+                slot.dst = nullptr;
+            }
+        }
+
+        if(slot.dst != nullptr)
+            slot.image.view = slot.dst;
+
+        // the callback may start new reads
+        tex::ImageData image    = std::move(slot.image);
+        Callback       on_ready = std::move(slot.on_ready);
+        slot.busy               = false;
+        m_pending.pop_front();
+
+        if(on_ready)
+            on_ready(image);
+    }
+}
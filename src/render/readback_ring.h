@@ -0,0 +1,60 @@
+#ifndef READBACK_RING_H
+#define READBACK_RING_H
+
+#include "renderer.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+//! Texture readbacks that don't stall the pipeline
+/*!
+    A read copies the texture into a pixel pack buffer and puts a fence behind the copy; update()
+    maps the buffer once the fence has passed, usually one or two frames later, and hands the pixels
+    to the callback. Each slot holds one read in flight, the buffers grow to the largest image read.
+    Without pixel buffer support the copy is made at once and only the callback is deferred.
+    All calls are for the context thread.
+*/
+class ReadbackRing
+{
+public:
+    //! Gets 8 bit BGRA pixels, bottom-up rows; the image owns them or views the caller's memory.
+    //! Lost buffer contents give an image without pixels.
+    using Callback = std::function<void(tex::ImageData & image)>;
+
+    constexpr static uint32_t default_num_slots = 3;
+
+    ~ReadbackRing();   // release() must have been called while the context was alive
+
+    void init(RendererBase const & render, uint32_t num_slots = default_num_slots);
+    void release(RendererBase const & render);   // the pending callbacks aren't called
+
+    //! Starts copying level 0 of the texture, false if all slots are busy
+    bool read(RendererBase const & render, Texture const & tex, Callback on_ready,
+              Texture::CubeFace face = Texture::CubeFace::POS_X);
+    //! As read(), the pixels go to dst (width * height * 4 bytes) which must stay valid until the callback
+    bool readInto(RendererBase const & render, Texture const & tex, uint8_t * dst, Callback on_ready,
+                  Texture::CubeFace face = Texture::CubeFace::POS_X);
+
+    //! Calls the callbacks of the finished reads in request order, once per frame; never waits
+    void     update(RendererBase const & render);
+    uint32_t getNumPending() const { return static_cast<uint32_t>(m_pending.size()); }
+
+private:
+    struct Slot
+    {
+        uint32_t            buffer   = 0;
+        size_t              capacity = 0;
+        RendererBase::Fence fence    = nullptr;
+        bool                busy     = false;
+        uint8_t *           dst      = nullptr;   // caller's memory
+        tex::ImageData      image;                // the pixels when there's no pack buffer
+        Callback            on_ready;
+    };
+
+    std::vector<Slot>    m_slots;
+    std::deque<uint32_t> m_pending;   // slot indices, oldest first
+    bool                 m_use_buffers = false;
+};
+
+#endif   // READBACK_RING_H
@@ -1,6 +1,7 @@
 #include "renderer.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <GL/glew.h>
+#include <algorithm>
 #include <array>
 #include <stdlib.h>
 #include <stdexcept>
@@ -77,6 +78,8 @@ static std::array<GLTextureFormatMapping, static_cast<uint32_t>(Texture::Format:
          {0, 0, 0},                                                 // NOFORMAT
             {GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE},                       // R8G8B8
             {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE},                     // R8G8B8A8
+            {GL_RGB8, GL_BGR, GL_UNSIGNED_BYTE},                       // B8G8R8
+            {GL_RGBA8, GL_BGRA, GL_UNSIGNED_BYTE},                     // B8G8R8A8
             {GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 0, GL_UNSIGNED_BYTE},   // DXT1
             {GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 0, GL_UNSIGNED_BYTE},   // DXT3
             {GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, GL_UNSIGNED_BYTE},   // DXT5
@@ -126,6 +129,7 @@ bool RendererBase::init()
     glEnable(GL_NORMALIZE);
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    m_has_pixel_buffers = GLEW_ARB_pixel_buffer_object && GLEW_ARB_map_buffer_range && GLEW_ARB_sync;
 
     GLint default_fbo = 0;
     glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &default_fbo);
@@ -145,7 +149,12 @@ bool RendererBase::init()
         0.5f,  1.0f,  0.5f,  0.5f,  0.5f, 1.0f,  -0.5f, 0.5f, 0.5f, 1.0f,
     };
 
-    uint16_t elements[] = {0, 1, 2, 3, 4, 5, 6, 7, 0, 4, 1, 5, 2, 6, 3, 7};
+    uint16_t elements[] = {
+        0, 1, 2, 3, 4, 5, 6, 7, 0, 4, 1, 5, 2, 6, 3, 7,   // edges
+        0, 3, 2, 0, 2, 1, 4, 5, 6, 4, 6, 7,               // -z +z faces, counterclockwise seen from outside
+        0, 1, 5, 0, 5, 4, 3, 7, 6, 3, 6, 2,               // -y +y
+        0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5                // -x +x
+    };
 
     glGenBuffers(1, &m_bbox_vbo_vertices);
     glGenBuffers(1, &m_bbox_ibo_elements);
@@ -244,6 +253,10 @@ bool RendererBase::checkExtensions() const
     {
         return false;
     }
+    else if(!GLEW_ARB_occlusion_query)
+    {
+        return false;
+    }
 
     return true;
 }
@@ -254,6 +267,8 @@ void RendererBase::setMatrix(MatrixType type, glm::mat4 const & matrix) const
 
     glMatrixMode(matrix_type);
     glLoadMatrixf(glm::value_ptr(matrix));
+
+    (type == MatrixType::PROJECTION ? m_projection_matrix : m_modelview_matrix) = matrix;
 }
 
 void RendererBase::setIdentityMatrix(MatrixType type) const
@@ -262,40 +277,154 @@ void RendererBase::setIdentityMatrix(MatrixType type) const
 
     glMatrixMode(matrix_type);
     glLoadIdentity();
+
+    (type == MatrixType::PROJECTION ? m_projection_matrix : m_modelview_matrix) = glm::mat4(1.0f);
+}
+
+glm::mat4 const & RendererBase::getMatrix(MatrixType type) const
+{
+    return type == MatrixType::PROJECTION ? m_projection_matrix : m_modelview_matrix;
+}
+
+Frustum RendererBase::getFrustum() const
+{
+    return Frustum(m_projection_matrix * m_modelview_matrix);
+}
+
+// Uploads planar blocks (num_blocks blocks of vcount * comps floats). The GPU storage is reallocated only
+// when it is too small or much too large, otherwise just the dirty vertices are rewritten. A changed vertex
+// count moves every block after the first one, so those are rewritten completely.
+static void UploadPlanarBlocks(GLenum target, std::vector<float> const & data, size_t & gpu_size,
+                               GLenum usage, uint32_t num_blocks, uint32_t comps, uint32_t vcount,
+                               bool count_changed, uint32_t dirty_first, uint32_t dirty_last)
+{
+    size_t const size = sizeof(float) * data.size();
+    if(size > gpu_size || size * 2 < gpu_size)
+    {
+        glBufferData(target, static_cast<GLsizeiptr>(size), data.data(), usage);
+        gpu_size = size;
+        return;
+    }
+
+    auto sub_data = [&](size_t first, size_t last) {
+        if(last > first)
+            glBufferSubData(target, static_cast<GLintptr>(sizeof(float) * first),
+                            static_cast<GLsizeiptr>(sizeof(float) * (last - first)), data.data() + first);
+    };
+
+    if(count_changed)
+    {
+        sub_data(static_cast<size_t>(dirty_first) * comps, data.size());
+        return;
+    }
+
+    for(uint32_t b = 0; b < num_blocks; ++b)
+    {
+        size_t const block_start = static_cast<size_t>(b) * vcount * comps;
+        sub_data(block_start + dirty_first * comps, block_start + dirty_last * comps);
+    }
 }
 
 void RendererBase::uploadBuffer(VertexBuffer & geo) const
 {
     assert(geo.m_state == VertexBuffer::State::INITDATA);
 
+    bool const has_tex = geo.m_components[VertexBuffer::ComponentsBitPos::tex];
     if(!geo.m_is_generated)
+    {
         glGenBuffers(1, &geo.m_dynamic_buffer_id);
-    glBindBuffer(GL_ARRAY_BUFFER_ARB, geo.m_dynamic_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * geo.m_dynamic_buffer.size(), &geo.m_dynamic_buffer[0],
-                 GL_DYNAMIC_DRAW);
+        if(has_tex)
+            glGenBuffers(1, &geo.m_static_bufffer_id);
+        glGenBuffers(1, &geo.m_indices_id);
 
-    if(geo.m_components[VertexBuffer::ComponentsBitPos::tex])
+        geo.m_is_generated     = true;
+        geo.m_gpu_dynamic_size = 0;
+        geo.m_gpu_static_size  = 0;
+        geo.m_gpu_indices_size = 0;
+    }
+
+    uint32_t const vcount        = geo.m_vertex_count;
+    bool const     count_changed = vcount != geo.m_committed_vertex_count;
+    uint32_t const dirty_last    = std::min(geo.m_dirty_last, vcount);
+    uint32_t const dirty_first   = std::min(geo.m_dirty_first, dirty_last);
+
+    glBindBuffer(GL_ARRAY_BUFFER, geo.m_dynamic_buffer_id);
+    UploadPlanarBlocks(GL_ARRAY_BUFFER, geo.m_dynamic_buffer, geo.m_gpu_dynamic_size, GL_DYNAMIC_DRAW,
+                       geo.m_components[VertexBuffer::ComponentsBitPos::normal] ? 2 : 1, 3, vcount,
+                       count_changed, dirty_first, dirty_last);
+
+    if(has_tex)
     {
-        if(!geo.m_is_generated)
-            glGenBuffers(1, &geo.m_static_bufffer_id);
-        glBindBuffer(GL_ARRAY_BUFFER_ARB, geo.m_static_bufffer_id);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * geo.m_static_bufffer.size(), &geo.m_static_bufffer[0],
+        glBindBuffer(GL_ARRAY_BUFFER, geo.m_static_bufffer_id);
+        UploadPlanarBlocks(GL_ARRAY_BUFFER, geo.m_static_bufffer, geo.m_gpu_static_size, GL_STATIC_DRAW,
+                           geo.m_tex_channels_count, 2, vcount, count_changed, dirty_first, dirty_last);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    size_t const indices_size = sizeof(uint32_t) * geo.m_indices.size();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.m_indices_id);
+    if(indices_size > geo.m_gpu_indices_size || indices_size * 2 < geo.m_gpu_indices_size)
+    {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices_size), geo.m_indices.data(),
                      GL_STATIC_DRAW);
+        geo.m_gpu_indices_size = indices_size;
+    }
+    else if(geo.m_indices_dirty)
+    {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(indices_size),
+                        geo.m_indices.data());
     }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    if(!geo.m_is_generated)
+    geo.m_committed_vertex_count = vcount;
+    geo.m_dirty_first            = 0;
+    geo.m_dirty_last             = 0;
+    geo.m_indices_dirty          = false;
+    geo.m_state                  = VertexBuffer::State::COMITTED;
+    geo.releaseCpuData();
+}
+
+bool RendererBase::readbackBuffer(VertexBuffer & geo) const
+{
+    if(!geo.m_is_generated || geo.m_state != VertexBuffer::State::COMITTED)
+        return false;
+
+    if(geo.hasCpuData())
+        return true;
+
+    bool const     has_norm    = geo.m_components[VertexBuffer::ComponentsBitPos::normal];
+    uint32_t const vcount      = geo.m_vertex_count;
+    uint32_t const dyn_floats  = vcount * (has_norm ? 6 : 3);
+    uint32_t const index_count = geo.m_committed_index_count;
+
+    geo.m_dynamic_buffer.resize(dyn_floats);
+    glBindBuffer(GL_ARRAY_BUFFER, geo.m_dynamic_buffer_id);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(sizeof(float) * dyn_floats),
+                       geo.m_dynamic_buffer.data());
+
+    if(geo.m_components[VertexBuffer::ComponentsBitPos::tex])
     {
-        glGenBuffers(1, &geo.m_indices_id);
-        geo.m_is_generated = true;
+        uint32_t const tex_floats = vcount * geo.m_tex_channels_count * 2;
+
+        geo.m_static_bufffer.resize(tex_floats);
+        glBindBuffer(GL_ARRAY_BUFFER, geo.m_static_bufffer_id);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(sizeof(float) * tex_floats),
+                           geo.m_static_bufffer.data());
     }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    geo.m_indices.resize(index_count);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.m_indices_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * geo.m_indices.size(), &geo.m_indices[0],
-                 GL_STATIC_DRAW);
+    glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(sizeof(uint32_t) * index_count),
+                       geo.m_indices.data());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    geo.m_state = VertexBuffer::State::COMITTED;
+    geo.m_resident = VertexBuffer::Retention::ALL;
+
+    return true;
 }
 
-void RendererBase::unloadBuffer(VertexBuffer const & geo) const
+void RendererBase::unloadBuffer(VertexBuffer & geo) const
 {
     if(geo.m_is_generated)
     {
@@ -309,6 +438,18 @@ void RendererBase::unloadBuffer(VertexBuffer const & geo) const
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.m_indices_id);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, 0, 0, GL_STATIC_DRAW);
+
+        geo.m_gpu_dynamic_size = 0;
+        geo.m_gpu_static_size  = 0;
+        geo.m_gpu_indices_size = 0;
+
+        // the storage is gone, so the buffer isn't drawn or read back until it is uploaded again;
+        // without full CPU copies nothing is left to upload
+        if(geo.hasCpuData())
+            geo.m_state = geo.m_vertex_count > 0 ? VertexBuffer::State::INITDATA
+                                                 : VertexBuffer::State::NODATA;
+        else
+            geo.clear();
     }
 }
 
@@ -328,6 +469,10 @@ void RendererBase::deleteBuffer(VertexBuffer & geo) const
 
         geo.m_is_generated = false;
         geo.m_state        = VertexBuffer::State::NODATA;
+
+        // without full CPU copies nothing is left to upload again
+        if(!geo.hasCpuData())
+            geo.clear();
     }
 }
 
@@ -374,8 +519,78 @@ void RendererBase::bindVertexBuffer(VertexBuffer const * geo) const
     }
 }
 
+void RendererBase::uploadBuffer(TypedVertexBufferBase & geo) const
+{
+    assert(geo.m_state == VertexBuffer::State::INITDATA);
+
+    if(!geo.m_is_generated)
+    {
+        glGenBuffers(1, &geo.m_vertex_buffer_id);
+        glGenBuffers(1, &geo.m_indices_id);
+        geo.m_is_generated = true;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, geo.m_vertex_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(float) * geo.m_vertices.size()),
+                 geo.m_vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.m_indices_id);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(uint32_t) * geo.m_indices.size()),
+                 geo.m_indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    geo.m_state = VertexBuffer::State::COMITTED;
+}
+
+void RendererBase::unloadBuffer(TypedVertexBufferBase const & geo) const
+{
+    if(geo.m_is_generated)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, geo.m_vertex_buffer_id);
+        glBufferData(GL_ARRAY_BUFFER, 0, 0, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo.m_indices_id);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, 0, 0, GL_STATIC_DRAW);
+    }
+}
+
+void RendererBase::deleteBuffer(TypedVertexBufferBase & geo) const
+{
+    if(geo.m_is_generated)
+    {
+        glDeleteBuffers(1, &geo.m_vertex_buffer_id);
+        glDeleteBuffers(1, &geo.m_indices_id);
+        geo.m_vertex_buffer_id = geo.m_indices_id = 0;
+
+        geo.m_is_generated = false;
+        geo.m_state        = VertexBuffer::State::NODATA;
+    }
+}
+
+void RendererBase::bindVertexBuffer(VertexBufferView const & view) const
+{
+    assert(view.buffer != nullptr && view.bind != nullptr);
+    assert(static_cast<TypedVertexBufferBase const *>(view.buffer)->m_state == VertexBuffer::State::COMITTED);
+
+    view.bind(view.buffer);
+    m_last_binded_view_unbind = view.unbind;
+}
+
+void RendererBase::draw(VertexBufferView const & view) const
+{
+    auto const * geo = static_cast<TypedVertexBufferBase const *>(view.buffer);
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(geo->getNumIndices()), GL_UNSIGNED_INT,
+                   static_cast<char *>(nullptr));
+}
+
 void RendererBase::unbindVertexBuffer() const
 {
+    if(m_last_binded_view_unbind != nullptr)
+    {
+        m_last_binded_view_unbind();
+        m_last_binded_view_unbind = nullptr;
+    }
+
     if(m_last_binded_vbo_components != VertexBuffer::null)
     {
         glDisableClientState(GL_VERTEX_ARRAY);
@@ -403,15 +618,104 @@ void RendererBase::unbindVertexBuffer() const
 
 void RendererBase::draw(VertexBuffer const & geo) const
 {
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(geo.m_indices.size()), GL_UNSIGNED_INT,
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(geo.getNumIndices()), GL_UNSIGNED_INT,
                    static_cast<char *>(nullptr));
 }
 
 void RendererBase::drawIndexed(uint32_t first_index, uint32_t num_indices, uint32_t first_vert,
                                uint32_t num_verts) const
 {
-    glDrawRangeElements(GL_TRIANGLES, first_vert, first_vert + num_verts, num_indices, GL_UNSIGNED_INT,
-                        reinterpret_cast<char *>(first_index));
+    assert(num_verts > 0);
+
+    // 'end' is inclusive, indices offset is in bytes
+    glDrawRangeElements(GL_TRIANGLES, first_vert, first_vert + num_verts - 1,
+                        static_cast<GLsizei>(num_indices), GL_UNSIGNED_INT,
+                        reinterpret_cast<char *>(sizeof(uint32_t) * first_index));
+}
+
+void RendererBase::drawRanges(DrawRange const * ranges, uint32_t count) const
+{
+    m_multi_draw_counts.clear();
+    m_multi_draw_offsets.clear();
+
+    uint32_t run_first = 0;
+    uint32_t run_count = 0;
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        if(ranges[i].num_indices == 0)
+            continue;
+
+        if(run_count > 0 && run_first + run_count == ranges[i].first_index)
+        {
+            run_count += ranges[i].num_indices;   // adjacent in the index buffer
+            continue;
+        }
+
+        if(run_count > 0)
+        {
+            m_multi_draw_counts.push_back(static_cast<int32_t>(run_count));
+            m_multi_draw_offsets.push_back(reinterpret_cast<void const *>(sizeof(uint32_t) * run_first));
+        }
+        run_first = ranges[i].first_index;
+        run_count = ranges[i].num_indices;
+    }
+
+    if(run_count > 0)
+    {
+        m_multi_draw_counts.push_back(static_cast<int32_t>(run_count));
+        m_multi_draw_offsets.push_back(reinterpret_cast<void const *>(sizeof(uint32_t) * run_first));
+    }
+
+    if(m_multi_draw_counts.empty())
+        return;
+
+    if(m_multi_draw_counts.size() == 1)
+        glDrawElements(GL_TRIANGLES, m_multi_draw_counts[0], GL_UNSIGNED_INT, m_multi_draw_offsets[0]);
+    else
+        glMultiDrawElements(GL_TRIANGLES, m_multi_draw_counts.data(), GL_UNSIGNED_INT,
+                            m_multi_draw_offsets.data(), static_cast<GLsizei>(m_multi_draw_counts.size()));
+
+    m_submit_stats.draw_calls++;
+}
+
+void RendererBase::submit(RenderItem const * items, uint32_t count, MaterialSetup const & setup_material)
+{
+    // the caller's slots stay, only the ones added by setup_material are removed after their run
+    size_t const caller_slots = m_texture_slots.size();
+
+    uint32_t run_start = 0;
+    while(run_start < count)
+    {
+        RenderItem const & first   = items[run_start];
+        uint32_t           run_end = run_start + 1;
+        while(run_end < count && items[run_end].geo == first.geo
+              && items[run_end].material_id == first.material_id)
+        {
+            run_end++;
+        }
+
+        m_submit_ranges.clear();
+        for(uint32_t i = run_start; i < run_end; ++i)
+            if(items[i].range.num_indices > 0)
+                m_submit_ranges.push_back(items[i].range);
+
+        if(setup_material)
+            setup_material(*this, first.material_id);
+
+        uint32_t const draw_calls = m_submit_stats.draw_calls;
+        bindSlots();
+        bindVertexBuffer(first.geo);
+        drawRanges(m_submit_ranges.data(), static_cast<uint32_t>(m_submit_ranges.size()));
+        unbindVertexBuffer();
+        unbindSlots();
+        m_texture_slots.resize(caller_slots);
+
+        m_submit_stats.items += run_end - run_start;
+        m_submit_stats.merged_draws +=
+            static_cast<uint32_t>(m_submit_ranges.size()) - (m_submit_stats.draw_calls - draw_calls);
+
+        run_start = run_end;
+    }
 }
 
 void RendererBase::createTexture(Texture & tex) const
@@ -432,11 +736,11 @@ void RendererBase::uploadTextureData(Texture & tex, tex::ImageData const & tex_d
                                      Texture::CubeFace face) const
 {
     assert(tex.m_render_id != 0 && tex.m_type != Texture::Type::TEXTURE_NOTYPE);
-    assert(tex_data.data.get() != nullptr);
+    assert(tex_data.pixels() != nullptr);
     assert(tex.m_width == tex_data.width && tex.m_height == tex_data.height && tex.m_depth == tex_data.depth);
 
     uint32_t const  tex_type  = g_texture_gl_types[static_cast<uint32_t>(tex.m_type)];
-    uint8_t const * data      = tex_data.data.get();
+    uint8_t const * data      = tex_data.pixels();
     GLsizei const   data_size = static_cast<GLsizei>(tex_data.data_size);
 
     glBindTexture(tex_type, tex.m_render_id);
@@ -448,7 +752,39 @@ void RendererBase::uploadTextureData(Texture & tex, tex::ImageData const & tex_d
     uint32_t const input_format = g_texture_gl_formats[static_cast<uint32_t>(tex.m_format)].gl_input_format;
     uint32_t const input_type = g_texture_gl_formats[static_cast<uint32_t>(tex.m_format)].gl_input_data_type;
 
-    if(tex.m_type == Texture::Type::TEXTURE_2D || tex.m_type == Texture::Type::TEXTURE_CUBE)
+    if(tex_data.hasLevels())
+    {
+        // mip chains and whole cube maps go level by level, compressed blocks as they are in the file
+        assert(tex_data.num_faces == 1 || tex.m_type == Texture::Type::TEXTURE_CUBE);
+        assert(tex.m_type == Texture::Type::TEXTURE_2D || tex.m_type == Texture::Type::TEXTURE_CUBE);
+
+        for(uint32_t i = 0; i < tex_data.num_faces; ++i)
+        {
+            uint32_t target = tex_type;
+            if(tex.m_type == Texture::Type::TEXTURE_CUBE)
+                target = GL_TEXTURE_CUBE_MAP_POSITIVE_X
+                         + (tex_data.num_faces == 6 ? i : static_cast<uint32_t>(face));
+
+            for(uint32_t mip = 0; mip < tex_data.num_mips; ++mip)
+            {
+                tex::ImageData::Level const level = tex_data.getLevel(i, mip);
+                auto const                  w     = static_cast<GLsizei>(level.width);
+                auto const                  h     = static_cast<GLsizei>(level.height);
+                auto const                  lod   = static_cast<GLint>(mip);
+
+                if(compressed)
+                    glCompressedTexImage2D(target, lod, internal_format, w, h, 0,
+                                           static_cast<GLsizei>(level.size), level.pixels);
+                else
+                    glTexImage2D(target, lod, internal_format, w, h, 0, input_format, input_type,
+                                 level.pixels);
+            }
+        }
+
+        if(tex_data.num_mips > 1)
+            glTexParameteri(tex_type, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(tex_data.num_mips - 1));
+    }
+    else if(tex.m_type == Texture::Type::TEXTURE_2D || tex.m_type == Texture::Type::TEXTURE_CUBE)
     {
         uint32_t const target = (tex.m_type == Texture::Type::TEXTURE_2D)
                                     ? tex_type
@@ -470,7 +806,8 @@ void RendererBase::uploadTextureData(Texture & tex, tex::ImageData const & tex_d
                          input_format, input_type, data);
     }
 
-    if(tex.m_gen_mips && (tex.m_type != Texture::Type::TEXTURE_CUBE || face == Texture::CubeFace::NEG_Z))
+    bool const last_face = face == Texture::CubeFace::NEG_Z || tex_data.num_faces == 6;
+    if(tex.m_gen_mips && (tex.m_type != Texture::Type::TEXTURE_CUBE || last_face))
     {
         // Note: for cube maps mips are only generated when the side with the highest index is uploaded
         glEnable(tex_type);
@@ -483,6 +820,71 @@ void RendererBase::uploadTextureData(Texture & tex, tex::ImageData const & tex_d
     tex.m_comitted = true;
 }
 
+void RendererBase::allocateTextureData(Texture & tex) const
+{
+    assert(tex.m_render_id != 0 && tex.m_type == Texture::Type::TEXTURE_2D);
+    assert(!IsCompressedTextureFormat(tex.m_format));
+
+    auto const & gl_format = g_texture_gl_formats[static_cast<uint32_t>(tex.m_format)];
+
+    glBindTexture(GL_TEXTURE_2D, tex.m_render_id);
+    glTexImage2D(GL_TEXTURE_2D, 0, gl_format.gl_internal_format, static_cast<int32_t>(tex.m_width),
+                 static_cast<int32_t>(tex.m_height), 0, gl_format.gl_input_format,
+                 gl_format.gl_input_data_type, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void RendererBase::uploadTextureRows(Texture & tex, tex::ImageData const & tex_data, uint32_t first_row,
+                                     uint32_t num_rows) const
+{
+    assert(tex.m_render_id != 0 && tex.m_type == Texture::Type::TEXTURE_2D);
+    assert(tex.m_width == tex_data.width && tex.m_height == tex_data.height);
+    assert(first_row + num_rows <= tex.m_height && tex_data.pixels() != nullptr);
+
+    auto const &    gl_format = g_texture_gl_formats[static_cast<uint32_t>(tex.m_format)];
+    size_t const    row_size  = tex_data.data_size / tex_data.height;
+    uint8_t const * rows      = tex_data.pixels() + row_size * first_row;
+
+    glBindTexture(GL_TEXTURE_2D, tex.m_render_id);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, static_cast<int32_t>(first_row), static_cast<int32_t>(tex.m_width),
+                    static_cast<int32_t>(num_rows), gl_format.gl_input_format, gl_format.gl_input_data_type,
+                    rows);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void RendererBase::uploadTextureRows(Texture & tex, uint32_t unpack_buffer, size_t offset, uint32_t first_row,
+                                     uint32_t num_rows) const
+{
+    assert(tex.m_render_id != 0 && tex.m_type == Texture::Type::TEXTURE_2D && unpack_buffer != 0);
+    assert(first_row + num_rows <= tex.m_height);
+
+    auto const & gl_format = g_texture_gl_formats[static_cast<uint32_t>(tex.m_format)];
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer);
+    glBindTexture(GL_TEXTURE_2D, tex.m_render_id);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, static_cast<int32_t>(first_row), static_cast<int32_t>(tex.m_width),
+                    static_cast<int32_t>(num_rows), gl_format.gl_input_format, gl_format.gl_input_data_type,
+                    reinterpret_cast<GLvoid const *>(offset));
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void RendererBase::finishTextureData(Texture & tex) const
+{
+    assert(tex.m_render_id != 0 && tex.m_type == Texture::Type::TEXTURE_2D);
+
+    if(tex.m_gen_mips)
+    {
+        glBindTexture(GL_TEXTURE_2D, tex.m_render_id);
+        glEnable(GL_TEXTURE_2D);
+        glGenerateMipmapEXT(GL_TEXTURE_2D);
+        glDisable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    tex.m_comitted = true;
+}
+
 void RendererBase::destroyTexture(Texture & tex) const
 {
     assert(tex.m_render_id != 0);
@@ -547,6 +949,30 @@ bool RendererBase::get2DTextureData(Texture const & tex, tex::ImageData & tex_da
     return true;
 }
 
+void RendererBase::readTextureData(Texture const & tex, uint32_t pack_buffer, uint8_t * dst,
+                                   Texture::CubeFace face) const
+{
+    assert(tex.m_render_id != 0
+           && (tex.m_type == Texture::Type::TEXTURE_2D || tex.m_type == Texture::Type::TEXTURE_CUBE));
+    assert(pack_buffer != 0 || dst != nullptr);
+
+    uint32_t const bind_type = g_texture_gl_types[static_cast<uint32_t>(tex.m_type)];
+    uint32_t const target    = tex.m_type == Texture::Type::TEXTURE_CUBE
+                                   ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<uint32_t>(face)
+                                   : GL_TEXTURE_2D;
+
+    if(pack_buffer != 0)
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer);
+    glBindTexture(bind_type, tex.m_render_id);
+
+    // BGRA is the native order of most drivers, the copy needs no swizzle
+    glGetTexImage(target, 0, GL_BGRA, GL_UNSIGNED_BYTE, pack_buffer != 0 ? nullptr : dst);
+
+    glBindTexture(bind_type, 0);
+    if(pack_buffer != 0)
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
 void RendererBase::applySamplerState(Texture const & tex) const
 {
     uint32_t const target = g_texture_gl_types[static_cast<uint32_t>(tex.m_type)];
@@ -678,6 +1104,15 @@ TextureSlot & RendererBase::getTextureSlot(uint32_t slot_num)
     return m_texture_slots[slot_num];
 }
 
+uint32_t RendererBase::getBindId(Texture const & tex) const
+{
+    // 2D textures still being streamed in show the default one
+    if(tex.m_render_id == 0 && tex.m_type == Texture::Type::TEXTURE_2D)
+        return m_default_texture;
+
+    return tex.m_render_id;
+}
+
 void RendererBase::bindSlots() const
 {
     for(uint32_t i = 0; i < m_texture_slots.size(); ++i)
@@ -689,7 +1124,7 @@ void RendererBase::bindSlots() const
                 g_texture_gl_types[static_cast<uint32_t>(m_texture_slots[i].texture->m_type)];
             glActiveTexture(texture_slot_id);
             glEnable(target);
-            glBindTexture(target, m_texture_slots[i].texture->m_render_id);
+            glBindTexture(target, getBindId(*m_texture_slots[i].texture));
         }
         else
         {
@@ -746,7 +1181,7 @@ void RendererBase::enableTextureCoordGeneration(std::uint32_t slot_num, uint32_t
 
     glActiveTexture(GL_TEXTURE0 + slot_num);
     glEnable(target);
-    glBindTexture(target, slot.projector->projected_texture->m_render_id);
+    glBindTexture(target, getBindId(*slot.projector->projected_texture));
 
     if(!slot.projector->is_cube_map)
     {
@@ -1096,6 +1531,147 @@ void RendererBase::drawBBox(AABB const & bbox, glm::mat4 const & object2world, g
     glPopMatrix();
 }
 
+uint32_t RendererBase::createQuery() const
+{
+    GLuint query = 0;
+    glGenQueries(1, &query);
+
+    return query;
+}
+
+void RendererBase::deleteQuery(uint32_t & query) const
+{
+    if(query != 0)
+    {
+        glDeleteQueries(1, &query);
+        query = 0;
+    }
+}
+
+void RendererBase::drawBBoxQuery(uint32_t query, AABB const & bbox) const
+{
+    assert(query != 0);
+
+    glm::vec3 const size      = bbox.max() - bbox.min();
+    glm::vec3 const center    = (bbox.min() + bbox.max()) / 2.0f;
+    glm::mat4 const transform = glm::translate(glm::mat4(1), center) * glm::scale(glm::mat4(1), size);
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glMultMatrixf(glm::value_ptr(transform));
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_DEPTH_TEST);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_bbox_vbo_vertices);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(4, GL_FLOAT, 0, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bbox_ibo_elements);
+
+    glBeginQuery(GL_SAMPLES_PASSED, query);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, reinterpret_cast<GLvoid *>(16 * sizeof(GLushort)));
+    glEndQuery(GL_SAMPLES_PASSED);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    commitDepthState();
+
+    glPopMatrix();
+}
+
+bool RendererBase::getQueryResult(uint32_t query, uint32_t & samples) const
+{
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(available == GL_FALSE)
+        return false;
+
+    GLuint result = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &result);
+    samples = result;
+
+    return true;
+}
+
+uint32_t RendererBase::createPixelBuffer(size_t size, bool pack) const
+{
+    assert(m_has_pixel_buffers);
+
+    uint32_t const target = pack ? GL_PIXEL_PACK_BUFFER : GL_PIXEL_UNPACK_BUFFER;
+
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferData(target, static_cast<GLsizeiptr>(size), nullptr, pack ? GL_STREAM_READ : GL_STREAM_DRAW);
+    glBindBuffer(target, 0);
+
+    return buffer;
+}
+
+void RendererBase::deletePixelBuffer(uint32_t & buffer) const
+{
+    if(buffer != 0)
+    {
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+}
+
+uint8_t * RendererBase::mapPixelBuffer(uint32_t buffer, size_t size, bool pack) const
+{
+    assert(buffer != 0);
+
+    uint32_t const   target = pack ? GL_PIXEL_PACK_BUFFER : GL_PIXEL_UNPACK_BUFFER;
+    GLbitfield const access = pack ? GL_MAP_READ_BIT : GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+
+    glBindBuffer(target, buffer);
+    void * data = glMapBufferRange(target, 0, static_cast<GLsizeiptr>(size), access);
+    glBindBuffer(target, 0);
+
+    return static_cast<uint8_t *>(data);
+}
+
+bool RendererBase::unmapPixelBuffer(uint32_t buffer, bool pack) const
+{
+    assert(buffer != 0);
+
+    uint32_t const target = pack ? GL_PIXEL_PACK_BUFFER : GL_PIXEL_UNPACK_BUFFER;
+
+    glBindBuffer(target, buffer);
+    GLboolean const result = glUnmapBuffer(target);
+    glBindBuffer(target, 0);
+
+    return result == GL_TRUE;
+}
+
+RendererBase::Fence RendererBase::insertFence() const
+{
+    return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool RendererBase::isFenceSignalled(Fence fence) const
+{
+    assert(fence != nullptr);
+
+    // the flush makes sure the fence gets to the GPU, without it polling could wait forever
+    GLenum const result = glClientWaitSync(static_cast<GLsync>(fence), GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+void RendererBase::deleteFence(Fence & fence) const
+{
+    if(fence != nullptr)
+    {
+        glDeleteSync(static_cast<GLsync>(fence));
+        fence = nullptr;
+    }
+}
+
 void RendererBase::clearColorBuffer() const
 {
     glClearColor(m_clear_color[0], m_clear_color[1], m_clear_color[2], m_clear_color[3]);
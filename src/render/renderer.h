@@ -1,9 +1,13 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+#include <functional>
+
 #include "AABB.h"
+#include "frustum.h"
 #include "render_states.h"
 #include "vertex_buffer.h"
+#include "typed_vertex_buffer.h"
 #include "texture.h"
 #include "../res/imagedata.h"
 
@@ -29,24 +33,81 @@ public:
 
     void setMatrix(MatrixType type, glm::mat4 const & matrix) const;
     void setIdentityMatrix(MatrixType type) const;
+    // last matrices set, culling for the current pass uses the frustum of projection * modelview
+    glm::mat4 const & getMatrix(MatrixType type) const;
+    Frustum           getFrustum() const;
 
     // Vertex buffer functions
     void uploadBuffer(VertexBuffer & geo) const;
-    void unloadBuffer(VertexBuffer const & geo) const;
+    void unloadBuffer(VertexBuffer & geo) const;   // GPU storage only, clears buffers without CPU copies
+    bool readbackBuffer(VertexBuffer & geo) const;   // restores CPU copies dropped by the retention policy
     void deleteBuffer(VertexBuffer & geo) const;
     void bindVertexBuffer(VertexBuffer const * geo) const;   // must be called after bindSlots()
     void unbindVertexBuffer() const;                         // must be called before clearSlots()
     void draw(VertexBuffer const & geo) const;
+    // TypedVertexBuffer, bound through its type erased view; the tex coords go to the units of its
+    // Units map, whatever tex_channel_num the slots have
+    void uploadBuffer(TypedVertexBufferBase & geo) const;
+    void unloadBuffer(TypedVertexBufferBase const & geo) const;
+    void deleteBuffer(TypedVertexBufferBase & geo) const;
+    void bindVertexBuffer(VertexBufferView const & view) const;
+    void draw(VertexBufferView const & view) const;
     void drawIndexed(uint32_t first_index, uint32_t num_indices, uint32_t first_vert,
                      uint32_t num_verts) const;
 
+    // Multi-draw submission
+    struct DrawRange
+    {
+        uint32_t first_index = 0;
+        uint32_t num_indices = 0;
+    };
+
+    struct RenderItem
+    {
+        VertexBuffer const * geo         = nullptr;
+        uint32_t             material_id = 0;
+        DrawRange            range       = {};
+    };
+
+    struct SubmitStats
+    {
+        uint32_t items        = 0;   // submitted render items
+        uint32_t draw_calls   = 0;   // issued GL draw calls
+        uint32_t merged_draws = 0;   // non-empty ranges that didn't need their own draw call
+    };
+
+    // adds the texture slots of the material, called once for every run of items with the same material;
+    // they are removed after the run, the slots added by the caller stay for every run
+    using MaterialSetup = std::function<void(RendererBase & render, uint32_t material_id)>;
+
+    // draws index ranges of the bound vertex buffer, adjacent ranges are joined and the rest is
+    // submitted with one glMultiDrawElements call
+    void drawRanges(DrawRange const * ranges, uint32_t count) const;
+    // consecutive items sharing a vertex buffer and a material are gathered into one drawRanges() call
+    void submit(RenderItem const * items, uint32_t count, MaterialSetup const & setup_material);
+
+    SubmitStats const & getSubmitStats() const { return m_submit_stats; }
+    void                resetSubmitStats() { m_submit_stats = {}; }
+
     // Textures
     void          createTexture(Texture & tex) const;
     void          uploadTextureData(Texture & tex, tex::ImageData const & tex_data,
                                     Texture::CubeFace face = Texture::CubeFace::POS_X) const;
+    // uncompressed 2D textures in row bands: storage first, then the rows in any order, then the mips
+    void          allocateTextureData(Texture & tex) const;
+    void          uploadTextureRows(Texture & tex, tex::ImageData const & tex_data, uint32_t first_row,
+                                    uint32_t num_rows) const;
+    // the rows come from an unpack pixel buffer, 'offset' is the first byte of first_row
+    void          uploadTextureRows(Texture & tex, uint32_t unpack_buffer, size_t offset, uint32_t first_row,
+                                    uint32_t num_rows) const;
+    void          finishTextureData(Texture & tex) const;
     void          destroyTexture(Texture & tex) const;
     bool          get2DTextureData(Texture const & tex, tex::ImageData & tex_data,
                                    Texture::CubeFace face = Texture::CubeFace::POS_X) const;
+    // level 0 as 8 bit BGRA, width * height * 4 bytes; into the pack buffer when it isn't 0, the copy then
+    // runs asynchronously, else into dst
+    void          readTextureData(Texture const & tex, uint32_t pack_buffer, uint8_t * dst,
+                                  Texture::CubeFace face = Texture::CubeFace::POS_X) const;
     void          applySamplerState(Texture const & tex) const;
     void          applyCombineStage(CombineStage const & combine) const;
     uint32_t      addTextureSlot(TextureSlot slot);
@@ -76,6 +137,30 @@ public:
     // debug draw
     void drawBBox(AABB const & bbox, glm::mat4 const & object2world, glm::vec3 const & color);
 
+    // Occlusion queries, the proxy is the solid unit cube of drawBBox()
+    uint32_t createQuery() const;
+    void     deleteQuery(uint32_t & query) const;
+    // draws the box with color and depth writes off, the query counts the samples that pass the depth test
+    void drawBBoxQuery(uint32_t query, AABB const & bbox) const;
+    // never waits, returns false while the result isn't available
+    bool getQueryResult(uint32_t query, uint32_t & samples) const;
+
+    // Pixel buffers: unpack buffers feed texture uploads, pack buffers take readbacks. They need
+    // ARB_pixel_buffer_object, ARB_map_buffer_range and ARB_sync, check hasPixelBuffers().
+    using Fence = void *;   // GLsync
+
+    bool      hasPixelBuffers() const { return m_has_pixel_buffers; }
+    uint32_t  createPixelBuffer(size_t size, bool pack) const;
+    void      deletePixelBuffer(uint32_t & buffer) const;
+    // unpack buffers are mapped write only with the old contents dropped, pack buffers read only; the
+    // memory may be used by any thread until the buffer is unmapped
+    uint8_t * mapPixelBuffer(uint32_t buffer, size_t size, bool pack) const;
+    bool      unmapPixelBuffer(uint32_t buffer, bool pack) const;   // false if the contents were lost
+    // signalled when the GPU has finished the commands issued before it
+    Fence insertFence() const;
+    bool  isFenceSignalled(Fence fence) const;   // never waits
+    void  deleteFence(Fence & fence) const;
+
     // Access to the current clearing parameters for the color, depth, and
     // stencil buffers.
     void              setClearColor(glm::vec4 const & clear_color) { m_clear_color = clear_color; }
@@ -116,7 +201,10 @@ private:
     void commitWireState() const;
     void commitAllStates() const;
 
-    bool m_initialized = false;
+    uint32_t getBindId(Texture const & tex) const;   // GL texture to bind for tex
+
+    bool m_initialized       = false;
+    bool m_has_pixel_buffers = false;
 
     glm::ivec2 m_viewport_pos  = {0, 0};
     glm::ivec2 m_viewport_size = {0, 0};
@@ -142,7 +230,7 @@ private:
 
     // bbox vbo
     uint32_t m_bbox_vbo_vertices = 0;
-    uint32_t m_bbox_ibo_elements = 0;
+    uint32_t m_bbox_ibo_elements = 0;   // 16 line indices, then 36 triangle indices
 
     // default texture
     uint32_t m_default_texture = 0;
@@ -159,8 +247,15 @@ private:
     uint32_t m_max_clip_planes = 0;
 
     // mutables
+    mutable glm::mat4                     m_projection_matrix          = glm::mat4(1.0f);
+    mutable glm::mat4                     m_modelview_matrix           = glm::mat4(1.0f);
     mutable VertexBuffer::ComponentsFlags m_last_binded_vbo_components = {};
+    mutable void                          (*m_last_binded_view_unbind)() = nullptr;
     mutable bool                          m_fbo_color_attached         = false;
+    mutable SubmitStats                   m_submit_stats               = {};
+    mutable std::vector<int32_t>          m_multi_draw_counts;
+    mutable std::vector<void const *>     m_multi_draw_offsets;
+    std::vector<DrawRange>                m_submit_ranges;   // scratch of submit()
 };
 
 #endif
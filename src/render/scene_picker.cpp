@@ -0,0 +1,73 @@
+#include "scene_picker.h"
+#include <assert.h>
+
+void ScenePicker::setObject(uint32_t object, MeshBVH const * mesh, glm::mat4 const & model)
+{
+    if(object >= m_instances.size())
+        m_instances.resize(object + 1);
+
+    m_instances[object].mesh      = mesh;
+    m_instances[object].inv_model = glm::inverse(model);
+}
+
+void ScenePicker::removeObject(uint32_t object)
+{
+    if(object < m_instances.size())
+        m_instances[object].mesh = nullptr;
+}
+
+bool ScenePicker::pick(BVH const & scene, Ray const & ray, PickResult & result, float max_dist) const
+{
+    // the object space ray keeps the parameterization of the world ray, so distances compare directly
+    MeshHit  closest;
+    uint32_t closest_object = BVH::null_index;
+    auto     hit_test       = [&](uint32_t object, Ray const & world_ray, float dist) {
+        if(object >= m_instances.size() || m_instances[object].mesh == nullptr)
+            return -1.0f;
+
+        Instance const & inst = m_instances[object];
+        Ray const        local_ray{glm::vec3(inst.inv_model * glm::vec4(world_ray.origin, 1.0f)),
+                            glm::vec3(inst.inv_model * glm::vec4(world_ray.direction, 0.0f))};
+
+        MeshHit hit;
+        if(!inst.mesh->intersect(local_ray, dist, hit))
+            return -1.0f;
+
+        // raycast() only asks for hits closer than the current one
+        closest        = hit;
+        closest_object = object;
+
+        return hit.distance;
+    };
+
+    float          hit_dist;
+    uint32_t const object = scene.raycast(ray, max_dist, hit_test, hit_dist);
+    if(object == BVH::null_index)
+        return false;
+
+    assert(object == closest_object);
+
+    result.object   = object;
+    result.triangle = closest.triangle;
+    result.u        = closest.u;
+    result.v        = closest.v;
+    result.distance = hit_dist;
+
+    return true;
+}
+
+Ray UnprojectRay(glm::vec2 const & window_pos, glm::ivec2 const & viewport_size, glm::mat4 const & projection,
+                 glm::mat4 const & modelview)
+{
+    // pixel centers, window y goes down
+    float const x = 2.0f * (window_pos.x + 0.5f) / static_cast<float>(viewport_size.x) - 1.0f;
+    float const y = 1.0f - 2.0f * (window_pos.y + 0.5f) / static_cast<float>(viewport_size.y);
+
+    glm::mat4 const inv      = glm::inverse(projection * modelview);
+    glm::vec4       near_pos = inv * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4       far_pos  = inv * glm::vec4(x, y, 1.0f, 1.0f);
+    near_pos /= near_pos.w;
+    far_pos /= far_pos.w;
+
+    return {glm::vec3(near_pos), glm::normalize(glm::vec3(far_pos - near_pos))};
+}
@@ -0,0 +1,51 @@
+#ifndef SCENE_PICKER_H
+#define SCENE_PICKER_H
+
+#include "bvh.h"
+#include "mesh_bvh.h"
+#include <vector>
+
+struct PickResult
+{
+    uint32_t object   = BVH::null_index;
+    uint32_t triangle = 0;
+    float    u        = 0.0f;   // barycentrics of the hit point, see MeshHit
+    float    v        = 0.0f;
+    float    distance = 0.0f;   // along the world space ray
+};
+
+//! Two level ray picking
+/*!
+    The top level is the scene BVH over the world bounds of the objects, the bottom level the
+    triangle BVH of every object mesh, queried with the ray moved to the object space.
+    Object ids are the ids of the scene BVH, the meshes must outlive the picker.
+*/
+class ScenePicker
+{
+public:
+    void setObject(uint32_t object, MeshBVH const * mesh, glm::mat4 const & model);
+    void removeObject(uint32_t object);
+    void clear() { m_instances.clear(); }
+
+    //! Objects without a mesh are skipped
+    bool pick(BVH const & scene, Ray const & ray, PickResult & result, float max_dist = max_float) const;
+
+private:
+    struct Instance
+    {
+        MeshBVH const * mesh = nullptr;
+        glm::mat4       inv_model;
+    };
+
+    std::vector<Instance> m_instances;   // indexed by object id
+};
+
+/*! World space ray through a window position
+    \param[in] window_pos position in window pixels, the origin is the top left corner
+    \param[in] viewport_size window size in pixels
+    \return the ray from the near plane with a unit length direction
+*/
+Ray UnprojectRay(glm::vec2 const & window_pos, glm::ivec2 const & viewport_size, glm::mat4 const & projection,
+                 glm::mat4 const & modelview);
+
+#endif   // SCENE_PICKER_H
@@ -0,0 +1,135 @@
+#include "static_batch.h"
+#include "renderer.h"
+#include "vertex_transform.h"
+#include <algorithm>
+#include <assert.h>
+
+StaticBatch::StaticBatch(VertexBuffer::ComponentsFlags format, uint32_t num_tex_channels) :
+    m_merged(format, num_tex_channels)
+{}
+
+void StaticBatch::addMesh(VertexBuffer const & mesh, glm::mat4 const & object2world, uint32_t material_id)
+{
+    auto const format = m_merged.getComponentsFlags();
+    // the source mesh must provide every component of the merged buffer
+    assert((mesh.getComponentsFlags() & format) == format);
+    assert(!format[VertexBuffer::ComponentsBitPos::tex]
+           || mesh.getNumTexChannels() >= m_merged.getNumTexChannels());
+    (void)format;
+
+    m_instances.push_back({&mesh, object2world, material_id});
+    m_baked = false;
+}
+
+void StaticBatch::bake()
+{
+    bool const     has_norm     = m_merged.getComponentsFlags()[VertexBuffer::ComponentsBitPos::normal];
+    bool const     has_tex      = m_merged.getComponentsFlags()[VertexBuffer::ComponentsBitPos::tex];
+    uint32_t const num_channels = has_tex ? m_merged.getNumTexChannels() : 0;
+
+    m_merged.clear();
+    m_ranges.clear();
+
+    // group meshes by material, vertices of a material are contiguous too so every range can be drawn
+    // with glDrawRangeElements
+    std::stable_sort(m_instances.begin(), m_instances.end(),
+                     [](Instance const & a, Instance const & b) { return a.material_id < b.material_id; });
+
+    uint32_t total_verts   = 0;
+    uint32_t total_indices = 0;
+    for(auto const & inst : m_instances)
+    {
+        total_verts += inst.mesh->getNumVertex();
+        total_indices += static_cast<uint32_t>(inst.mesh->getIndices().size());
+    }
+
+    if(total_verts == 0)
+    {
+        m_baked = true;
+        return;
+    }
+
+    std::vector<float>              pos(total_verts * 3);
+    std::vector<float>              norm(has_norm ? total_verts * 3 : 0);
+    std::vector<std::vector<float>> tex(num_channels, std::vector<float>(total_verts * 2));
+    std::vector<uint32_t>           indices;
+    indices.reserve(total_indices);
+
+    uint32_t vstart = 0;
+    for(auto const & inst : m_instances)
+    {
+        VertexBuffer const & mesh   = *inst.mesh;
+        uint32_t const       vcount = mesh.getNumVertex();
+
+        if(m_ranges.empty() || m_ranges.back().material_id != inst.material_id)
+        {
+            MaterialRange range;
+            range.material_id = inst.material_id;
+            range.first_index = static_cast<uint32_t>(indices.size());
+            range.first_vert  = vstart;
+            m_ranges.push_back(range);
+        }
+
+        TransformPositions(inst.model, mesh.getPositions(), pos.data() + vstart * 3, vcount);
+        if(has_norm)
+        {
+            TransformNormals(GetNormalMatrix(inst.model), mesh.getNormals(), norm.data() + vstart * 3,
+                             vcount);
+        }
+
+        for(uint32_t ch = 0; ch < num_channels; ++ch)
+        {
+            float const * src = mesh.getTexCoords(ch);
+            std::copy(src, src + vcount * 2, tex[ch].begin() + vstart * 2);
+        }
+
+        for(uint32_t ind : mesh.getIndices())
+            indices.push_back(ind + vstart);
+
+        vstart += vcount;
+
+        MaterialRange & range = m_ranges.back();
+        range.num_indices     = static_cast<uint32_t>(indices.size()) - range.first_index;
+        range.num_verts       = vstart - range.first_vert;
+    }
+
+    std::vector<float const *> tex_ptrs;
+    for(auto const & channel : tex)
+        tex_ptrs.push_back(channel.data());
+
+    m_merged.pushBack(pos.data(), tex_ptrs, has_norm ? norm.data() : nullptr, total_verts, indices.data(),
+                      static_cast<uint32_t>(indices.size()));
+
+    m_baked = true;
+}
+
+void StaticBatch::clear()
+{
+    m_instances.clear();
+    m_ranges.clear();
+    m_merged.clear();
+    m_baked = false;
+}
+
+StaticBatch::MaterialRange const * StaticBatch::findMaterialRange(uint32_t material_id) const
+{
+    auto it = std::find_if(m_ranges.begin(), m_ranges.end(),
+                           [material_id](MaterialRange const & r) { return r.material_id == material_id; });
+
+    return it != m_ranges.end() ? &(*it) : nullptr;
+}
+
+void StaticBatch::draw(RendererBase const & render, uint32_t material_id) const
+{
+    assert(m_baked);
+
+    if(auto const * range = findMaterialRange(material_id); range != nullptr)
+        render.drawIndexed(range->first_index, range->num_indices, range->first_vert, range->num_verts);
+}
+
+void StaticBatch::drawAll(RendererBase const & render) const
+{
+    assert(m_baked);
+
+    render.draw(m_merged);
+}
@@ -0,0 +1,58 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "vertex_buffer.h"
+
+class RendererBase;
+
+// Static geometry batch: meshes that never move are pre-transformed into world space once and
+// merged into a single VertexBuffer. Indices are grouped by material, so every material of the
+// group is drawn with one call.
+class StaticBatch
+{
+public:
+    struct MaterialRange
+    {
+        uint32_t material_id = 0;
+        uint32_t first_index = 0;
+        uint32_t num_indices = 0;
+        uint32_t first_vert  = 0;
+        uint32_t num_verts   = 0;
+    };
+
+    // format of the merged buffer, every added mesh must provide all of its components
+    StaticBatch(VertexBuffer::ComponentsFlags format = VertexBuffer::pos_norm_tex,
+                uint32_t                      num_tex_channels = 1);
+
+    void addMesh(VertexBuffer const & mesh, glm::mat4 const & object2world, uint32_t material_id = 0);
+    void bake();    // transform and merge all added meshes, the merged buffer must be uploaded after
+    void clear();   // remove meshes and merged data
+
+    bool                               isBaked() const { return m_baked; }
+    VertexBuffer &                     getVertexBuffer() { return m_merged; }
+    VertexBuffer const &               getVertexBuffer() const { return m_merged; }
+    std::vector<MaterialRange> const & getMaterialRanges() const { return m_ranges; }
+    MaterialRange const *              findMaterialRange(uint32_t material_id) const;
+
+    // the merged buffer must be bound with RendererBase::bindVertexBuffer()
+    void draw(RendererBase const & render, uint32_t material_id) const;
+    void drawAll(RendererBase const & render) const;
+
+private:
+    struct Instance
+    {
+        VertexBuffer const * mesh        = nullptr;
+        glm::mat4            model       = glm::mat4(1.0f);
+        uint32_t             material_id = 0;
+    };
+
+    std::vector<Instance>      m_instances;
+    std::vector<MaterialRange> m_ranges;
+    VertexBuffer               m_merged;
+    bool                       m_baked = false;
+};
+
+#endif   // STATIC_BATCH_H
@@ -3,29 +3,79 @@
 #include "../res/imagedata.h"
 #include <glm/gtc/matrix_transform.hpp>
 
+namespace
+{
+Texture::Format GetImageFormat(tex::ImageData const & image)
+{
+    switch(image.type)
+    {
+        case tex::ImageData::PixelType::pt_rgb:
+            return Texture::Format::R8G8B8;
+        case tex::ImageData::PixelType::pt_bgr:
+            return Texture::Format::B8G8R8;
+        case tex::ImageData::PixelType::pt_bgra:
+            return Texture::Format::B8G8R8A8;
+        case tex::ImageData::PixelType::pt_dxt1:
+            return Texture::Format::DXT1;
+        case tex::ImageData::PixelType::pt_dxt3:
+            return Texture::Format::DXT3;
+        case tex::ImageData::PixelType::pt_dxt5:
+            return Texture::Format::DXT5;
+        default:
+            return Texture::Format::R8G8B8A8;
+    }
+}
+}   // namespace
+
 bool Texture::loadImageDataFromFile(std::string const & fname, RendererBase const & render)
 {
     tex::ImageData image;
-    if(!tex::ReadTGA(fname, image))
+    if(!tex::ReadImage(fname, image, true))   // uploads straight from the file mapping when it can
         return false;
 
+    createFromImage(image, render);
+
+    return true;
+}
+
+bool Texture::loadCubeMapFromFiles(std::array<char const *, 6> const & fnames, RendererBase const & render)
+{
+    createCubeMap(render);
+
+    tex::ImageData image;
+    for(uint32_t i = 0; i < fnames.size(); ++i)
+    {
+        if(!tex::ReadImage(fnames[i], image, true))
+            return false;
+
+        uploadCubeFace(image, static_cast<CubeFace>(i), render);
+    }
+
+    return true;
+}
+
+void Texture::setImageDesc(tex::ImageData const & image)
+{
     m_comitted    = false;
-    m_gen_mips    = true;
-    m_type        = Type::TEXTURE_2D;
-    m_format      = image.type == tex::ImageData::PixelType::pt_rgb ? Format::R8G8B8 : Format::R8G8B8A8;
+    m_gen_mips    = image.num_mips == 1;   // a file with a mip chain brings its own
+    m_type        = image.num_faces == 6 ? Type::TEXTURE_CUBE : Type::TEXTURE_2D;
+    m_format      = GetImageFormat(image);
     m_width       = image.width;
     m_height      = image.height;
     m_depth       = 0;
     m_sampler.max = Filter::LINEAR;
     m_sampler.min = Filter::LINEAR_MIPMAP_LINEAR;
+}
+
+void Texture::createFromImage(tex::ImageData const & image, RendererBase const & render)
+{
+    setImageDesc(image);
 
     render.createTexture(*this);
     render.uploadTextureData(*this, image);
-
-    return true;
 }
 
-bool Texture::loadCubeMapFromFiles(std::array<char const *, 6> const & fnames, RendererBase const & render)
+void Texture::createCubeMap(RendererBase const & render)
 {
     m_comitted    = false;
     m_gen_mips    = false;
@@ -35,21 +85,17 @@ bool Texture::loadCubeMapFromFiles(std::array<char const *, 6> const & fnames, R
     m_sampler.min = Filter::LINEAR;
 
     render.createTexture(*this);
+}
 
-    tex::ImageData image;
-    for(uint32_t i = 0; i < fnames.size(); ++i)
-    {
-        if(!tex::ReadTGA(fnames[i], image))
-            return false;
-
-        m_format = image.type == tex::ImageData::PixelType::pt_rgb ? Format::R8G8B8 : Format::R8G8B8A8;
-        m_width  = image.width;
-        m_height = image.height;
+void Texture::uploadCubeFace(tex::ImageData const & image, CubeFace face, RendererBase const & render)
+{
+    assert(m_type == Type::TEXTURE_CUBE && m_render_id != 0);
 
-        render.uploadTextureData(*this, image, static_cast<CubeFace>(i));
-    }
+    m_format = GetImageFormat(image);
+    m_width  = image.width;
+    m_height = image.height;
 
-    return true;
+    render.uploadTextureData(*this, image, face);
 }
 
 glm::mat4 TextureProjector::getTransformMatrix() const
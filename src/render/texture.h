@@ -5,6 +5,11 @@
 #include <string>
 #include <array>
 
+namespace tex
+{
+struct ImageData;
+}
+
 class RendererBase;
 class Texture
 {
@@ -35,6 +40,8 @@ public:
         NOFORMAT,
         R8G8B8,
         R8G8B8A8,
+        B8G8R8,     // stored as RGB, the source pixels are in BGR order
+        B8G8R8A8,
         DXT1,
         DXT3,
         DXT5,
@@ -78,6 +85,12 @@ public:
     bool loadImageDataFromFile(std::string const & fname, RendererBase const & render);
     bool loadCubeMapFromFiles(std::array<char const *, 6> const & fnames, RendererBase const & render);
 
+    // GL side of the loaders above, for images decoded elsewhere; context thread only
+    void setImageDesc(tex::ImageData const & image);   // fields of createFromImage(), no GL
+    void createFromImage(tex::ImageData const & image, RendererBase const & render);
+    void createCubeMap(RendererBase const & render);
+    void uploadCubeFace(tex::ImageData const & image, CubeFace face, RendererBase const & render);
+
     // protected:
     bool         m_comitted = false;
     bool         m_gen_mips = true;
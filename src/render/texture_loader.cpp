@@ -0,0 +1,81 @@
+#include "texture_loader.h"
+#include "renderer.h"
+#include "../core/job_system.h"
+#include <assert.h>
+#include <chrono>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+float ElapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
+}   // namespace
+
+void TextureBatchLoader::add(Texture & texture, std::string const & file_name)
+{
+    m_requests.push_back({&texture, file_name, false, Texture::CubeFace::POS_X, {}});
+}
+
+void TextureBatchLoader::addCubeMap(Texture & texture, std::array<char const *, 6> const & file_names)
+{
+    for(uint32_t i = 0; i < file_names.size(); ++i)
+        m_requests.push_back({&texture, file_names[i], true, static_cast<Texture::CubeFace>(i), {}});
+}
+
+bool TextureBatchLoader::load(RendererBase const & render)
+{
+    JobSystem & jobs = GetJobSystem();
+    assert(jobs.isMainThread());
+
+    m_timings.assign(m_requests.size(), {});
+
+    // cube maps are created up front, so their faces can be uploaded in any order
+    for(Request const & req : m_requests)
+        if(req.cube_face && req.texture->m_render_id == 0)
+            req.texture->createCubeMap(render);
+
+    Job * root = jobs.create(nullptr);
+    for(uint32_t i = 0; i < m_requests.size(); ++i)
+    {
+        jobs.run(jobs.create(
+            [this, i, root, &render, &jobs] {
+                Request & req    = m_requests[i];
+                Timing &  timing = m_timings[i];
+
+                auto const start = Clock::now();
+                timing.file_name = req.file_name;
+                timing.loaded    = tex::ReadImage(req.file_name, req.image, true);
+                timing.decode_ms = ElapsedMs(start);
+                if(!timing.loaded)
+                    return;
+
+                jobs.runOnMainThread(jobs.create(
+                    [&req, &timing, &render] {
+                        auto const start = Clock::now();
+                        if(req.cube_face)
+                            req.texture->uploadCubeFace(req.image, req.face, render);
+                        else
+                            req.texture->createFromImage(req.image, render);
+                        timing.upload_ms = ElapsedMs(start);
+
+                        req.image = {};   // releases the pixels or the file mapping
+                    },
+                    root));
+            },
+            root));
+    }
+
+    jobs.run(root);
+    jobs.wait(root);
+
+    m_requests.clear();
+
+    bool result = true;
+    for(Timing const & timing : m_timings)
+        result = result && timing.loaded;
+
+    return result;
+}
@@ -0,0 +1,49 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include "texture.h"
+#include "../res/imagedata.h"
+#include <array>
+#include <string>
+#include <vector>
+
+//! Loads a set of textures at once
+/*!
+    The files are decoded in parallel on the job system, every decoded image is handed back to the
+    calling (context) thread and uploaded while the other files are still decoding.
+*/
+class TextureBatchLoader
+{
+public:
+    struct Timing
+    {
+        std::string file_name;
+        float       decode_ms = 0.0f;   // on the thread that decoded it
+        float       upload_ms = 0.0f;   // on the context thread
+        bool        loaded    = false;
+    };
+
+    void add(Texture & texture, std::string const & file_name);
+    //! The faces in CubeFace order
+    void addCubeMap(Texture & texture, std::array<char const *, 6> const & file_names);
+
+    //! Loads the added files and clears the list, false if any of them failed; the main thread only
+    bool load(RendererBase const & render);
+
+    std::vector<Timing> const & getTimings() const { return m_timings; }   // of the last load, in add order
+
+private:
+    struct Request
+    {
+        Texture *         texture;
+        std::string       file_name;
+        bool              cube_face;
+        Texture::CubeFace face;
+        tex::ImageData    image;
+    };
+
+    std::vector<Request> m_requests;
+    std::vector<Timing>  m_timings;
+};
+
+#endif   // TEXTURE_LOADER_H
@@ -0,0 +1,307 @@
+#include "texture_streamer.h"
+#include "../core/job_system.h"
+#include <assert.h>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+template<typename Container, typename Pred>
+void EraseIf(Container & requests, Pred pred)
+{
+    requests.erase(std::remove_if(requests.begin(), requests.end(), pred), requests.end());
+}
+}   // namespace
+
+TextureStreamer::TextureStreamer(UploadScheduler & uploads, PixelUploadRing * ring) :
+    m_uploads(uploads),
+    m_ring(ring)
+{}
+
+TextureStreamer::~TextureStreamer()
+{
+    // the upload callbacks refer to this
+    cancelUploads([](Upload const &) { return true; });
+
+    // so do the decode jobs
+    std::unique_lock<std::mutex> lock(m_mutex);
+    waitForJobs(lock);
+
+    auto const has_slot = [](RequestPtr const & req) { return req->slot != nullptr; };
+    assert(std::none_of(m_queued.begin(), m_queued.end(), has_slot));
+    assert(std::none_of(m_decoded.begin(), m_decoded.end(), has_slot));
+}
+
+TextureStreamer::Handle TextureStreamer::load(Texture & texture, std::string const & file_name,
+                                              Callback on_done)
+{
+    assert(texture.m_render_id == 0);
+
+    // the placeholder is a 2D texture
+    texture.m_type     = Texture::Type::TEXTURE_2D;
+    texture.m_comitted = false;
+
+    cancelUploads([&texture](Upload const & upload) { return upload.second == &texture; });
+
+    Handle handle = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        cancelRequests([&texture](Request const & req) { return req.texture == &texture; });
+
+        handle = m_next_handle++;
+
+        auto req       = std::make_unique<Request>();
+        req->handle    = handle;
+        req->texture   = &texture;
+        req->file_name = file_name;
+        req->on_done   = std::move(on_done);
+        m_queued.push_back(std::move(req));
+        startJob();
+    }
+
+    return handle;
+}
+
+void TextureStreamer::cancel(Handle handle)
+{
+    cancelUploads([handle](Upload const & upload) { return upload.first == handle; });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    cancelRequests([handle](Request const & req) { return req.handle == handle; });
+}
+
+bool TextureStreamer::isPending(Handle handle) const
+{
+    if(std::any_of(m_uploading.begin(), m_uploading.end(),
+                   [handle](Upload const & upload) { return upload.first == handle; }))
+        return true;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto const same_handle = [handle](RequestPtr const & req) {
+        return req->handle == handle && !req->cancelled;
+    };
+    return (m_decoding != nullptr && m_decoding->handle == handle && !m_cancel_decoding)
+           || std::any_of(m_queued.begin(), m_queued.end(), same_handle)
+           || std::any_of(m_waiting.begin(), m_waiting.end(), same_handle)
+           || std::any_of(m_decoded.begin(), m_decoded.end(), same_handle);
+}
+
+void TextureStreamer::update(RendererBase const & render)
+{
+    // slots are mapped on the context thread, the requests go back to the front of the queue
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(RequestPtr & req : m_waiting)
+        {
+            req->slot     = m_ring->acquire(render, req->slot_size);
+            req->answered = true;
+            startJob();
+        }
+        m_queued.insert(m_queued.begin(), std::make_move_iterator(m_waiting.begin()),
+                        std::make_move_iterator(m_waiting.end()));
+        m_waiting.clear();
+    }
+
+    // one at a time, a callback may load or cancel other textures
+    for(;;)
+    {
+        RequestPtr req;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_decoded.empty())
+                break;
+
+            req = std::move(m_decoded.front());
+            m_decoded.erase(m_decoded.begin());
+        }
+
+        if(req->slot != nullptr && (req->cancelled || !req->loaded))
+        {
+            m_ring->retire(render, req->slot);
+            req->slot = nullptr;
+        }
+        else if(req->slot != nullptr && !m_ring->unmap(render, req->slot))
+        {
+            // the buffer contents were lost, decode once more into memory
+            req->slot     = nullptr;
+            req->use_ring = false;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queued.push_front(std::move(req));
+            startJob();
+            continue;
+        }
+
+        if(req->cancelled)
+            continue;
+
+        if(!req->loaded)
+        {
+            if(req->on_done)
+                req->on_done(*req->texture, false);
+            continue;
+        }
+
+        queueUpload(std::move(req), render);
+    }
+}
+
+void TextureStreamer::stop(RendererBase const & render)
+{
+    cancelUploads([](Upload const &) { return true; });
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    waitForJobs(lock);
+
+    // no job holds a slot now, they are in m_queued and m_decoded
+    for(RequestPtr const & req : m_queued)
+        if(req->slot != nullptr)
+            m_ring->retire(render, req->slot);
+    for(RequestPtr const & req : m_decoded)
+        if(req->slot != nullptr)
+            m_ring->retire(render, req->slot);
+    m_queued.clear();
+    m_waiting.clear();
+    m_decoded.clear();
+}
+
+void TextureStreamer::cancelRequests(RequestPred const & pred)
+{
+    // a slot is given back by update(), queued requests holding one go with the decoded ones
+    for(RequestPtr & req : m_queued)
+    {
+        if(!pred(*req))
+            continue;
+
+        req->cancelled = true;
+        if(req->slot != nullptr)
+            m_decoded.push_back(std::move(req));
+    }
+    EraseIf(m_queued, [](RequestPtr const & req) { return req == nullptr || req->cancelled; });
+    EraseIf(m_waiting, [&pred](RequestPtr const & req) { return pred(*req); });
+
+    for(RequestPtr & req : m_decoded)
+        if(pred(*req))
+            req->cancelled = true;
+    EraseIf(m_decoded, [](RequestPtr const & req) { return req->cancelled && req->slot == nullptr; });
+
+    if(m_decoding != nullptr && pred(*m_decoding))
+        m_cancel_decoding = true;
+}
+
+void TextureStreamer::cancelUploads(std::function<bool(Upload const &)> const & pred)
+{
+    for(Upload const & upload : m_uploading)
+        if(pred(upload))
+            m_uploads.cancel(*upload.second);
+
+    EraseIf(m_uploading, pred);
+}
+
+void TextureStreamer::queueUpload(RequestPtr req, RendererBase const & render)
+{
+    Handle const handle  = req->handle;
+    Texture &    texture = *req->texture;
+    auto const   done    = [this, handle, &texture, on_done = std::move(req->on_done)] {
+        EraseIf(m_uploading, [handle](Upload const & upload) { return upload.first == handle; });
+        if(on_done)
+            on_done(texture, true);
+    };
+
+    m_uploading.emplace_back(handle, &texture);
+    if(req->slot != nullptr)
+        m_uploads.queueTexture(texture, std::move(req->image), *m_ring, req->slot, done);
+    else
+        m_uploads.queueTexture(texture, std::move(req->image), done);
+}
+
+void TextureStreamer::startJob()
+{
+    ++m_num_jobs;
+    GetJobSystem().runIO([this] { decodeNext(); });
+}
+
+void TextureStreamer::waitForJobs(std::unique_lock<std::mutex> & lock)
+{
+    // the jobs still queued find m_stop set and return at once
+    m_stop = true;
+    m_idle.wait(lock, [this] { return m_num_jobs == 0; });
+}
+
+bool TextureStreamer::openForSlot(Request & req)
+{
+    req.reader = std::make_unique<tex::TGAStreamReader>();
+    if(req.reader->open(req.file_name))
+    {
+        size_t const size = static_cast<size_t>(req.reader->getWidth()) * req.reader->getBytesPerPixel()
+                            * req.reader->getHeight();
+        if(size <= m_ring->getSlotSize())
+        {
+            req.slot_size = size;
+            return true;
+        }
+    }
+
+    req.reader.reset();
+    return false;
+}
+
+bool TextureStreamer::readToSlot(Request & req)
+{
+    tex::TGAStreamReader & reader   = *req.reader;
+    size_t const           row_size = static_cast<size_t>(reader.getWidth()) * reader.getBytesPerPixel();
+    uint8_t * const        pixels   = req.slot->data;
+
+    auto const sink   = [pixels, row_size](uint32_t row, uint8_t const * src) {
+        std::memcpy(pixels + row_size * row, src, row_size);
+        return true;
+    };
+    bool const loaded = reader.read(sink);
+
+    req.image.width     = reader.getWidth();
+    req.image.height    = reader.getHeight();
+    req.image.depth     = 0;
+    req.image.data_size = static_cast<uint32_t>(req.slot_size);
+    req.image.type      = reader.getType();
+    req.reader.reset();
+
+    return loaded;
+}
+
+void TextureStreamer::decodeNext()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(!m_stop && !m_queued.empty())
+    {
+        RequestPtr req = std::move(m_queued.front());
+        m_queued.pop_front();
+        m_decoding        = req.get();
+        m_cancel_decoding = false;
+
+        // the texture itself is only touched on the context thread
+        lock.unlock();
+        bool wants_slot = false;
+        if(req->slot != nullptr)
+            req->loaded = readToSlot(*req);
+        else if(m_ring && req->use_ring && !req->answered)
+            wants_slot = openForSlot(*req);
+
+        if(!wants_slot && req->slot == nullptr)
+        {
+            req->reader.reset();   // update() found no free slot
+            req->loaded = tex::ReadImage(req->file_name, req->image, true);
+        }
+        lock.lock();
+
+        req->cancelled = m_cancel_decoding || m_stop;
+        m_decoding     = nullptr;
+        if(wants_slot && !req->cancelled)
+            m_waiting.push_back(std::move(req));
+        else if(!wants_slot && (!req->cancelled || req->slot != nullptr))
+            m_decoded.push_back(std::move(req));
+    }
+
+    // the lock is held until the count is down, waitForJobs() may destroy this right after
+    --m_num_jobs;
+    m_idle.notify_all();
+}
@@ -0,0 +1,99 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include "texture.h"
+#include "upload_scheduler.h"
+#include "../res/imagedata.h"
+#include "../res/tga_stream.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! Loads 2D textures without blocking the render loop
+/*!
+    load() returns at once, the file is decoded by a job on the I/O thread of the job system and
+    update() hands the image to the upload scheduler. Until the upload is done the texture has no GL
+    object and the renderer binds its default texture in its place, so the texture can be put into
+    slots right away. With a PixelUploadRing the decode job reads the header and leaves the request
+    to update(), which maps a slot and queues a second job that decodes straight into the pixel
+    buffer; images that don't fit or find no free slot are decoded into memory. The interface is for
+    the context thread.
+*/
+class TextureStreamer
+{
+public:
+    using Handle = uint32_t;   // 0 is never returned
+    //! Called once the texture is uploaded or the file failed to load
+    using Callback = std::function<void(Texture & texture, bool loaded)>;
+
+    explicit TextureStreamer(UploadScheduler & uploads, PixelUploadRing * ring = nullptr);
+    ~TextureStreamer();   // cancels the pending loads
+
+    TextureStreamer(TextureStreamer const &)             = delete;
+    TextureStreamer & operator=(TextureStreamer const &) = delete;
+
+    //! The texture must have no GL object, a pending load of the same texture is cancelled
+    Handle load(Texture & texture, std::string const & file_name, Callback on_done = {});
+    //! The texture keeps the placeholder and the callback isn't called, does nothing for finished loads
+    void   cancel(Handle handle);
+    bool   isPending(Handle handle) const;
+
+    //! Maps slots for the decode jobs and queues the decoded textures for upload, once per frame
+    //! before UploadScheduler::update()
+    void update(RendererBase const & render);
+    //! Cancels everything and waits for the decode jobs, gives the slots back; before the ring is released
+    void stop(RendererBase const & render);
+
+private:
+    struct Request
+    {
+        Handle                                handle  = 0;
+        Texture *                             texture = nullptr;
+        std::string                           file_name;
+        Callback                              on_done;
+        tex::ImageData                        image;
+        bool                                  loaded    = false;
+        bool                                  cancelled = false;   // only requests holding a slot are kept
+        bool                                  use_ring  = true;
+        size_t                                slot_size = 0;       // the image fits a slot
+        bool                                  answered  = false;   // update() has looked for a slot
+        PixelUploadRing::Slot *               slot      = nullptr;   // mapped, the image has no pixels
+        std::unique_ptr<tex::TGAStreamReader> reader;   // open from the header until the slot is filled
+    };
+
+    using RequestPtr  = std::unique_ptr<Request>;
+    using RequestPred = std::function<bool(Request const &)>;
+    using Upload      = std::pair<Handle, Texture *>;
+
+    UploadScheduler &   m_uploads;
+    PixelUploadRing *   m_ring;
+    std::vector<Upload> m_uploading;   // queued in m_uploads, context thread only
+
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_idle;               // a decode job has finished
+    std::deque<RequestPtr>  m_queued;             // waiting for a decode job
+    std::vector<RequestPtr> m_waiting;            // waiting for update() to look for a slot
+    std::vector<RequestPtr> m_decoded;            // waiting for update()
+    Request *               m_decoding = nullptr;   // owned by the running decode job
+    bool                    m_cancel_decoding = false;   // drop the request being read when it's done
+    bool                    m_stop            = false;
+    uint32_t                m_num_jobs        = 0;   // queued or running on the I/O thread
+    Handle                  m_next_handle     = 1;
+
+    void cancelRequests(RequestPred const & pred);   // m_mutex locked
+    void cancelUploads(std::function<bool(Upload const &)> const & pred);
+    void queueUpload(RequestPtr req, RendererBase const & render);
+    void startJob();   // m_mutex locked, a job per queued request
+    void waitForJobs(std::unique_lock<std::mutex> & lock);   // sets m_stop
+    bool openForSlot(Request & req);   // false - decode into memory
+    bool readToSlot(Request & req);
+    void decodeNext();   // runs on the I/O thread
+};
+
+#endif   // TEXTURE_STREAMER_H
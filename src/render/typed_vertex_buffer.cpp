@@ -0,0 +1,71 @@
+#include "typed_vertex_buffer.h"
+#include <GL/glew.h>
+
+namespace
+{
+void EnableTexCoords(uint32_t unit, GLsizei stride, uint32_t offset)
+{
+    glClientActiveTexture(GL_TEXTURE0 + unit);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, stride, reinterpret_cast<void *>(offset));
+}
+
+void DisableTexCoords(uint32_t unit)
+{
+    glClientActiveTexture(GL_TEXTURE0 + unit);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+}   // namespace
+
+template<uint32_t... Channels, typename... Components>
+void TypedVertexBuffer<vtx::Units<Channels...>, Components...>::BindArrays(void const * buffer)
+{
+    auto const * geo = static_cast<TypedVertexBuffer const *>(buffer);
+
+    glBindBuffer(GL_ARRAY_BUFFER, geo->m_vertex_buffer_id);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, static_cast<GLsizei>(stride),
+                    reinterpret_cast<void *>(offset<vtx::Position>()));
+    if constexpr(vtx::Contains<vtx::Normal, Components...>())
+    {
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, static_cast<GLsizei>(stride),
+                        reinterpret_cast<void *>(offset<vtx::Normal>()));
+    }
+    BindTexCoords(UnitSequence());
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo->m_indices_id);
+}
+
+template<uint32_t... Channels, typename... Components>
+void TypedVertexBuffer<vtx::Units<Channels...>, Components...>::UnbindArrays()
+{
+    glDisableClientState(GL_VERTEX_ARRAY);
+    if constexpr(vtx::Contains<vtx::Normal, Components...>())
+        glDisableClientState(GL_NORMAL_ARRAY);
+    UnbindTexCoords(UnitSequence());
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Unit and Channels expand together, unit i gets the offset of channel Channels[i]
+template<uint32_t... Channels, typename... Components>
+template<uint32_t... Unit>
+void TypedVertexBuffer<vtx::Units<Channels...>, Components...>::BindTexCoords(
+    std::integer_sequence<uint32_t, Unit...>)
+{
+    (EnableTexCoords(Unit, static_cast<GLsizei>(stride), offset<vtx::TexCoord<Channels>>()), ...);
+}
+
+template<uint32_t... Channels, typename... Components>
+template<uint32_t... Unit>
+void TypedVertexBuffer<vtx::Units<Channels...>, Components...>::UnbindTexCoords(
+    std::integer_sequence<uint32_t, Unit...>)
+{
+    (DisableTexCoords(Unit), ...);
+}
+
+template class TypedVertexBuffer<vtx::Units<0, 1>, vtx::Position, vtx::Normal, vtx::TexCoord<0>,
+                                 vtx::TexCoord<1>>;
@@ -0,0 +1,186 @@
+#ifndef TYPEDVERTEXBUFFER_H
+#define TYPEDVERTEXBUFFER_H
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "vertex_buffer.h"
+
+// Vertex components of TypedVertexBuffer
+namespace vtx
+{
+struct Position
+{
+    constexpr static uint32_t num_floats = 3;
+    static float const *      source(VertexBuffer const & vb) { return vb.getPositions(); }
+};
+
+struct Normal
+{
+    constexpr static uint32_t num_floats = 3;
+    static float const *      source(VertexBuffer const & vb) { return vb.getNormals(); }
+};
+
+// tex coords of the channel, the Units of the buffer say which texture units read it
+template<uint32_t Channel>
+struct TexCoord
+{
+    constexpr static uint32_t num_floats = 2;
+    constexpr static uint32_t channel    = Channel;
+    static float const *      source(VertexBuffer const & vb) { return vb.getTexCoords(Channel); }
+};
+
+// the tex coord channel read by each texture unit: unit i reads Channels[i]. Takes the place of
+// TextureSlot::tex_channel_num, units with generated coords or without a slot are left out at the end
+template<uint32_t... Channels>
+struct Units
+{};
+
+template<typename C, typename... Components>
+constexpr bool Contains()
+{
+    return (std::is_same_v<C, Components> || ...);
+}
+
+// offset in floats of the component C inside of the interleaved vertex
+template<typename C, typename First, typename... Rest>
+constexpr uint32_t OffsetOf()
+{
+    if constexpr(std::is_same_v<C, First>)
+        return 0;
+    else
+        return First::num_floats + OffsetOf<C, Rest...>();
+}
+}   // namespace vtx
+
+// Type erased handle to a typed buffer, the way RendererBase binds and draws it; the index count is
+// read from the buffer at draw time
+struct VertexBufferView
+{
+    void const * buffer = nullptr;
+    void         (*bind)(void const * buffer) = nullptr;
+    void         (*unbind)()                  = nullptr;
+};
+
+// Format independent part: interleaved vertices in one VBO and indices, owned GL objects
+class TypedVertexBufferBase
+{
+public:
+    uint32_t getNumVertex() const { return m_vertex_count; }
+    uint32_t getNumTriangles() const { return getNumIndices() / 3; }
+    uint32_t getNumIndices() const { return static_cast<uint32_t>(m_indices.size()); }
+
+protected:
+    std::vector<float>    m_vertices;
+    std::vector<uint32_t> m_indices;
+    uint32_t              m_vertex_count     = 0;
+    uint32_t              m_vertex_buffer_id = 0;
+    uint32_t              m_indices_id       = 0;
+    bool                  m_is_generated     = false;
+    VertexBuffer::State   m_state            = VertexBuffer::State::NODATA;
+
+    friend class RendererBase;
+};
+
+// Vertex buffer with a compile time layout: interleaved components in the given order, and the
+// channel each texture unit reads. Strides, offsets and the array pointer setup are constants, the
+// whole binding is one inlined sequence of GL calls without per-component or per-slot tests. Bind
+// functions are explicitly instantiated in typed_vertex_buffer.cpp for the formats listed at the end
+// of this file.
+template<typename UnitMap, typename... Components>
+class TypedVertexBuffer;
+
+template<uint32_t... Channels, typename... Components>
+class TypedVertexBuffer<vtx::Units<Channels...>, Components...> : public TypedVertexBufferBase
+{
+    static_assert(vtx::Contains<vtx::Position, Components...>(), "Position component is required");
+    static_assert((vtx::Contains<vtx::TexCoord<Channels>, Components...>() && ...),
+                  "A texture unit reads a tex coord channel that is not a part of the format");
+
+public:
+    constexpr static uint32_t stride_floats = (Components::num_floats + ...);
+    constexpr static uint32_t stride        = stride_floats * static_cast<uint32_t>(sizeof(float));
+
+    template<typename C>
+    constexpr static uint32_t offset()   // in bytes
+    {
+        static_assert(vtx::Contains<C, Components...>(), "Component is not a part of the format");
+        return vtx::OffsetOf<C, Components...>() * static_cast<uint32_t>(sizeof(float));
+    }
+
+    // vertices are interleaved in the format order
+    void pushBack(float const * vertices, uint32_t vcount, uint32_t const * indices, uint32_t icount)
+    {
+        uint32_t const vstart = m_vertex_count;
+
+        m_vertices.insert(m_vertices.end(), vertices, vertices + vcount * stride_floats);
+        for(uint32_t i = 0; i < icount; ++i)
+            m_indices.push_back(indices[i] + vstart);
+
+        m_vertex_count += vcount;
+        m_state = VertexBuffer::State::INITDATA;
+    }
+
+    // converts planar VertexBuffer data, the source must contain all components of the format
+    void assign(VertexBuffer const & src)
+    {
+        m_vertex_count = src.getNumVertex();
+        m_vertices.resize(m_vertex_count * stride_floats);
+        (copyComponent<Components>(src), ...);
+        m_indices = src.getIndices();
+        m_state   = m_vertex_count > 0 ? VertexBuffer::State::INITDATA : VertexBuffer::State::NODATA;
+    }
+
+    template<typename C>
+    float * component(uint32_t vertex)
+    {
+        static_assert(vtx::Contains<C, Components...>(), "Component is not a part of the format");
+
+        m_state = VertexBuffer::State::INITDATA;
+        return m_vertices.data() + vertex * stride_floats + vtx::OffsetOf<C, Components...>();
+    }
+
+    void clear()
+    {
+        m_vertices.resize(0);
+        m_indices.resize(0);
+        m_vertex_count = 0;
+        m_state        = VertexBuffer::State::NODATA;
+    }
+
+    VertexBufferView view() const
+    {
+        return {this, &TypedVertexBuffer::BindArrays, &TypedVertexBuffer::UnbindArrays};
+    }
+
+    static void BindArrays(void const * buffer);
+    static void UnbindArrays();
+
+private:
+    using UnitSequence = std::make_integer_sequence<uint32_t, sizeof...(Channels)>;
+
+    template<uint32_t... Unit>
+    static void BindTexCoords(std::integer_sequence<uint32_t, Unit...>);
+    template<uint32_t... Unit>
+    static void UnbindTexCoords(std::integer_sequence<uint32_t, Unit...>);
+
+    template<typename C>
+    void copyComponent(VertexBuffer const & src)
+    {
+        float const *  data = C::source(src);
+        uint32_t const off  = vtx::OffsetOf<C, Components...>();
+
+        for(uint32_t v = 0; v < m_vertex_count; ++v)
+            for(uint32_t k = 0; k < C::num_floats; ++k)
+                m_vertices[v * stride_floats + off + k] = data[v * C::num_floats + k];
+    }
+};
+
+// instantiated formats
+// two channels, units 0 and 1 read them in order; a third unit may use generated coords
+using VertexBufferPNT2 =
+    TypedVertexBuffer<vtx::Units<0, 1>, vtx::Position, vtx::Normal, vtx::TexCoord<0>, vtx::TexCoord<1>>;
+
+#endif   // TYPEDVERTEXBUFFER_H
@@ -0,0 +1,253 @@
+#include "upload_scheduler.h"
+#include "renderer.h"
+#include <assert.h>
+#include <algorithm>
+
+namespace
+{
+constexpr float g_ema_weight = 0.1f;
+
+float ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t GetBufferSize(VertexBuffer const & geo)
+{
+    auto const components = geo.getComponentsFlags();
+    uint32_t   floats     = 3;   // per vertex
+    if(components[VertexBuffer::ComponentsBitPos::normal])
+        floats += 3;
+    if(components[VertexBuffer::ComponentsBitPos::tex])
+        floats += 2 * geo.getNumTexChannels();
+
+    return sizeof(float) * floats * geo.getNumVertex() + sizeof(uint32_t) * geo.getNumIndices();
+}
+}   // namespace
+
+UploadScheduler::~UploadScheduler()
+{
+    assert(std::none_of(m_queue.begin(), m_queue.end(), [](Item const & item) {
+        return item.staging.m_render_id != 0 || item.slot != nullptr;
+    }));
+}
+
+void UploadScheduler::queueTexture(Texture & texture, tex::ImageData image, Callback on_done)
+{
+    assert(image.pixels() != nullptr && image.depth == 0);
+
+    cancel(texture);
+
+    Item item;
+    item.texture   = &texture;
+    item.image     = std::move(image);
+    item.remaining = item.image.data_size;
+    item.on_done   = std::move(on_done);
+    item.queued    = Clock::now();
+    m_queue.push_back(std::move(item));
+
+    ++m_metrics.queue_depth;
+    m_metrics.queued_bytes += m_queue.back().remaining;
+}
+
+void UploadScheduler::queueTexture(Texture & texture, tex::ImageData desc, PixelUploadRing & ring,
+                                   PixelUploadRing::Slot * slot, Callback on_done)
+{
+    assert(slot != nullptr && slot->state == PixelUploadRing::Slot::State::FILLED);
+    assert(desc.pixels() == nullptr && !desc.isCompressed() && !desc.hasLevels());
+
+    cancel(texture);
+
+    Item item;
+    item.texture   = &texture;
+    item.image     = std::move(desc);
+    item.ring      = &ring;
+    item.slot      = slot;
+    item.remaining = item.image.data_size;
+    item.on_done   = std::move(on_done);
+    item.queued    = Clock::now();
+    m_queue.push_back(std::move(item));
+
+    ++m_metrics.queue_depth;
+    m_metrics.queued_bytes += m_queue.back().remaining;
+}
+
+void UploadScheduler::queueBuffer(VertexBuffer & geo, Callback on_done)
+{
+    Item item;
+    item.buffer    = &geo;
+    item.remaining = GetBufferSize(geo);
+    item.on_done   = std::move(on_done);
+    item.queued    = Clock::now();
+    m_queue.push_back(std::move(item));
+
+    ++m_metrics.queue_depth;
+    m_metrics.queued_bytes += m_queue.back().remaining;
+}
+
+void UploadScheduler::cancel(Texture const & texture)
+{
+    // the staging textures are released by the next update()
+    for(Item & item : m_queue)
+    {
+        if(item.texture == &texture && !item.cancelled)
+        {
+            item.cancelled = true;
+            --m_metrics.queue_depth;
+            m_metrics.queued_bytes -= item.remaining;
+        }
+    }
+}
+
+void UploadScheduler::update(RendererBase const & render)
+{
+    run(render, true);
+}
+
+void UploadScheduler::flush(RendererBase const & render)
+{
+    run(render, false);
+}
+
+void UploadScheduler::clear(RendererBase const & render)
+{
+    for(Item & item : m_queue)
+        item.cancelled = true;
+
+    dropCancelled(render);
+    m_metrics.queue_depth  = 0;
+    m_metrics.queued_bytes = 0;
+}
+
+void UploadScheduler::releaseItem(Item & item, RendererBase const & render)
+{
+    if(item.staging.m_render_id != 0)
+        render.destroyTexture(item.staging);
+
+    if(item.slot != nullptr)
+    {
+        item.ring->retire(render, item.slot);
+        item.slot = nullptr;
+    }
+}
+
+void UploadScheduler::dropCancelled(RendererBase const & render)
+{
+    for(Item & item : m_queue)
+        if(item.cancelled)
+            releaseItem(item, render);
+
+    auto const cancelled = [](Item const & item) { return item.cancelled; };
+    m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(), cancelled), m_queue.end());
+}
+
+void UploadScheduler::run(RendererBase const & render, bool use_budget)
+{
+    dropCancelled(render);
+
+    auto const start = Clock::now();
+
+    m_metrics.frame_uploads = 0;
+    m_metrics.frame_bytes   = 0;
+    while(!m_queue.empty())
+    {
+        if(use_budget && m_metrics.frame_bytes > 0
+           && (m_metrics.frame_bytes >= m_budget.bytes || ElapsedMs(start) >= m_budget.time_ms))
+            break;
+
+        Item & item = m_queue.front();
+        if(item.cancelled)   // by a callback
+        {
+            releaseItem(item, render);
+            m_queue.pop_front();
+            continue;
+        }
+
+        size_t const bytes = step(item, render);
+        item.remaining -= bytes;
+        m_metrics.frame_bytes += bytes;
+        m_metrics.queued_bytes -= bytes;
+
+        if(item.remaining > 0)
+            continue;
+
+        // the callback may queue or cancel uploads
+        Item done = std::move(item);
+        m_queue.pop_front();
+
+        float const latency = ElapsedMs(done.queued);
+        float &     avg     = m_metrics.avg_latency_ms;
+        avg                 = avg < 0.0f ? latency : avg + g_ema_weight * (latency - avg);
+        m_metrics.max_latency_ms = std::max(m_metrics.max_latency_ms, latency);
+        --m_metrics.queue_depth;
+        ++m_metrics.frame_uploads;
+
+        if(done.on_done)
+            done.on_done();
+    }
+
+    m_metrics.frame_ms = ElapsedMs(start);
+}
+
+size_t UploadScheduler::step(Item & item, RendererBase const & render)
+{
+    if(item.buffer != nullptr)
+    {
+        render.uploadBuffer(*item.buffer);
+        return item.remaining;
+    }
+
+    tex::ImageData const & image = item.image;
+    Texture &              tex   = item.staging;
+
+    bool const whole = image.isCompressed() || image.hasLevels();   // no row bands
+    if(tex.m_render_id == 0)
+    {
+        tex             = *item.texture;   // keeps the wrap modes
+        tex.m_render_id = 0;
+        tex.setImageDesc(image);
+        render.createTexture(tex);
+        if(!whole)
+            render.allocateTextureData(tex);
+    }
+
+    size_t bytes = item.remaining;
+    if(whole)
+        render.uploadTextureData(tex, image);
+    else
+    {
+        size_t const   row_size = image.data_size / image.height;
+        size_t const   band     = std::max<size_t>(m_budget.band_size / row_size, 1);
+        uint32_t const num_rows = static_cast<uint32_t>(std::min<size_t>(band, image.height - item.next_row));
+
+        if(item.slot != nullptr)
+            render.uploadTextureRows(tex, item.slot->buffer, row_size * item.next_row, item.next_row,
+                                     num_rows);
+        else
+            render.uploadTextureRows(tex, image, item.next_row, num_rows);
+
+        item.next_row += num_rows;
+        bytes = row_size * num_rows;
+        if(item.next_row == image.height)
+        {
+            if(item.slot != nullptr)
+            {
+                item.ring->retire(render, item.slot);
+                item.slot = nullptr;
+            }
+            render.finishTextureData(tex);
+            bytes = item.remaining;   // the last band takes any division remainder
+        }
+    }
+
+    if(bytes == item.remaining)
+    {
+        // swap in the new GL object
+        if(item.texture->m_render_id != 0)
+            render.destroyTexture(*item.texture);
+        *item.texture   = tex;
+        tex.m_render_id = 0;
+    }
+
+    return bytes;
+}
@@ -0,0 +1,98 @@
+#ifndef UPLOAD_SCHEDULER_H
+#define UPLOAD_SCHEDULER_H
+
+#include "pixel_upload_ring.h"
+#include "texture.h"
+#include "../res/imagedata.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+class VertexBuffer;
+
+//! Spreads texture and buffer uploads over frames
+/*!
+    Uploads are queued and update() runs them in queue order until the time or the byte budget of the
+    frame is spent. Uncompressed textures go up in row bands, so one big image doesn't take a frame
+    on its own; pixels already in a PixelUploadRing slot are read from the buffer. A texture keeps
+    what it had (the renderer's default texture when it had no GL object) until the last band is in,
+    then the new GL object is swapped in. Context thread only.
+*/
+class UploadScheduler
+{
+public:
+    struct Budget
+    {
+        float  time_ms   = 2.0f;
+        size_t bytes     = 8u << 20;
+        size_t band_size = 256u << 10;   // bytes of texture rows per glTexSubImage2D call
+    };
+
+    struct Metrics
+    {
+        uint32_t queue_depth    = 0;   // uploads not finished yet
+        size_t   queued_bytes   = 0;   // left to upload
+        uint32_t frame_uploads  = 0;   // finished by the last update()
+        size_t   frame_bytes    = 0;
+        float    frame_ms       = 0.0f;
+        float    avg_latency_ms = -1.0f;   // queued to finished, moving average; < 0 - none finished yet
+        float    max_latency_ms = 0.0f;
+    };
+
+    using Callback = std::function<void()>;
+
+    ~UploadScheduler();   // clear() must have been called while the context was alive
+
+    void           setBudget(Budget const & budget) { m_budget = budget; }
+    Budget const & getBudget() const { return m_budget; }
+
+    //! 2D images; a queued upload of the same texture is cancelled
+    void queueTexture(Texture & texture, tex::ImageData image, Callback on_done = {});
+    //! The pixels are in an unmapped slot, 'desc' has no data; the slot is retired when done
+    void queueTexture(Texture & texture, tex::ImageData desc, PixelUploadRing & ring,
+                      PixelUploadRing::Slot * slot, Callback on_done = {});
+    //! Uploaded in one step, the buffer must not change or go away until it is done
+    void queueBuffer(VertexBuffer & geo, Callback on_done = {});
+    //! Drops the queued uploads of the texture, the callbacks aren't called
+    void cancel(Texture const & texture);
+
+    //! Runs the queued uploads until the budget is spent, at least one step so the queue always moves
+    void update(RendererBase const & render);
+    //! Runs everything regardless of the budget
+    void flush(RendererBase const & render);
+    //! Drops everything, releases the GL objects of unfinished textures
+    void clear(RendererBase const & render);
+
+    Metrics const & getMetrics() const { return m_metrics; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Item
+    {
+        Texture *               texture = nullptr;   // either a texture
+        VertexBuffer *          buffer  = nullptr;   // or a buffer
+        Texture                 staging;             // filled band by band, then copied to *texture
+        tex::ImageData          image;
+        PixelUploadRing *       ring      = nullptr;   // holds the pixels when set
+        PixelUploadRing::Slot * slot      = nullptr;
+        uint32_t                next_row  = 0;
+        size_t                  remaining = 0;   // bytes
+        Callback                on_done;
+        Clock::time_point       queued;
+        bool                    cancelled = false;
+    };
+
+    Budget           m_budget;
+    Metrics          m_metrics;
+    std::deque<Item> m_queue;
+
+    void   run(RendererBase const & render, bool use_budget);
+    size_t step(Item & item, RendererBase const & render);   // returns the bytes uploaded
+    void   dropCancelled(RendererBase const & render);
+    void   releaseItem(Item & item, RendererBase const & render);
+};
+
+#endif   // UPLOAD_SCHEDULER_H
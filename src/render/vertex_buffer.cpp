@@ -1,6 +1,81 @@
 #include "vertex_buffer.h"
+#include "aabb_batch.h"
+#include "../core/cpu_features.h"
+#include "../core/parallel.h"
 #include <assert.h>
-// #include <algorithm>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef CPU_X86_DISPATCH
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+uint32_t const g_erased_vertex = 0xFFFFFFFF;
+
+uint32_t const g_weld_buckets    = 256;   // power of two
+uint32_t const g_weld_grain      = 4096;
+uint64_t const g_hash_offset     = 14695981039346656037ull;   // FNV-1a
+uint64_t const g_hash_prime      = 1099511628211ull;
+
+void RemapIndicesScalar(uint32_t * indices, uint32_t count, uint32_t const * remap)
+{
+    for(uint32_t i = 0; i < count; ++i)
+        indices[i] = remap[indices[i]];
+}
+
+#ifdef CPU_X86_DISPATCH
+CPU_TARGET_AVX2 void RemapIndicesAVX2(uint32_t * indices, uint32_t count, uint32_t const * remap)
+{
+    int const * table = reinterpret_cast<int const *>(remap);
+    uint32_t    i     = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i const idx = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(indices + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(indices + i), _mm256_i32gather_epi32(table, idx, 4));
+    }
+    RemapIndicesScalar(indices + i, count - i, remap);
+}
+#endif
+
+// indices[i] = remap[indices[i]]
+void RemapIndices(uint32_t * indices, uint32_t count, uint32_t const * remap)
+{
+#ifdef CPU_X86_DISPATCH
+    if(GetCpuFeatures().avx2)
+    {
+        RemapIndicesAVX2(indices, count, remap);
+        return;
+    }
+#endif
+    RemapIndicesScalar(indices, count, remap);
+}
+
+// Removes the triangles that reference an erased vertex and, optionally, the degenerate ones
+void CompactTriangles(std::vector<uint32_t> & indices, bool drop_degenerate)
+{
+    size_t num_indices = 0;
+    for(size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        uint32_t const i0 = indices[i];
+        uint32_t const i1 = indices[i + 1];
+        uint32_t const i2 = indices[i + 2];
+
+        indices[num_indices]     = i0;
+        indices[num_indices + 1] = i1;
+        indices[num_indices + 2] = i2;
+
+        bool keep = i0 != g_erased_vertex && i1 != g_erased_vertex && i2 != g_erased_vertex;
+        if(drop_degenerate)
+            keep = keep && i0 != i1 && i1 != i2 && i0 != i2;
+        if(keep)
+            num_indices += 3;
+    }
+    indices.resize(num_indices);
+}
+}   // namespace
 
 VertexBuffer::VertexBuffer(ComponentsFlags format, uint32_t num_tex_channels)
     : m_tex_channels_count(num_tex_channels),
@@ -17,6 +92,7 @@ void VertexBuffer::insertVertices(uint32_t const index, float const * pos,
                                   std::vector<float const *> const & tex, float const * norm,
                                   uint32_t const vcount)
 {
+    assert(hasCpuData());
     // This function inserts 'vcount' new vertices *before* the vertex currently at 'index'.
     // Assumes contiguous block layout:
     // - m_dynamic_buffer: PPP...NNN...
@@ -121,24 +197,30 @@ void VertexBuffer::insertVertices(uint32_t const index, float const * pos,
         m_static_bufffer.swap(new_static_buffer);
     }
 
+    m_bounds.expandBy(AABBBatch::ReducePoints(pos, vcount));
+
     m_vertex_count += vcount;
     m_state         = State::INITDATA;
+    markDirty(index, m_vertex_count);
 }
 
 void VertexBuffer::insertIndices(uint32_t const index, uint32_t const * indices, uint32_t const icount)
 {
+    assert(hasCpuData());
     assert(index < m_indices.size());
     assert(indices);
 
     auto ind_it = m_indices.begin() + index;
     m_indices.insert(ind_it, indices, indices + icount);
 
-    m_state = State::INITDATA;
+    m_state         = State::INITDATA;
+    m_indices_dirty = true;
 }
 
 void VertexBuffer::pushBack(float const * pos, std::vector<float const *> const & tex, float const * norm,
                             uint32_t const vcount, uint32_t const * indices, uint32_t const icount)
 {
+    assert(hasCpuData());
     assert(pos);
     if(icount > 0)
     {   // Ensure indices is valid if we are going to use it.
@@ -193,6 +275,10 @@ void VertexBuffer::pushBack(float const * pos, std::vector<float const *> const
         }
     }
 
+    m_bounds.expandBy(AABBBatch::ReducePoints(pos, vcount));
+
+    markDirty(vstart, vstart + vcount);
+    m_indices_dirty = m_indices_dirty || icount > 0;
     m_vertex_count += vcount;
     m_state         = State::INITDATA;
 }
@@ -202,72 +288,291 @@ void VertexBuffer::eraseVertices(uint32_t const first, uint32_t const last)
     assert(last > first);
     assert(last <= m_vertex_count);
 
-    if(first >= m_vertex_count || first >= last)
-    {   // If 'first' is out of bounds or range is invalid/empty.
-        return;
-    }
+    VertexRange const range{first, last};
+    eraseVertices(&range, 1);
+}
 
-    uint32_t const count_to_erase         = last - first;
-    uint32_t const pos_floats_per_vertex  = 3;
-    uint32_t const norm_floats_per_vertex = 3;
-    uint32_t const tex_floats_per_vertex  = 2;
+void VertexBuffer::eraseVertices(VertexRange const * ranges, uint32_t const count)
+{
+    assert(hasCpuData());
+    assert(ranges || count == 0);
 
-    // --- Handle m_dynamic_buffer (Positions and Normals) ---
-    // Layout: P_block N_block
-    // Erase from P_block:
-    auto p_erase_begin_it = m_dynamic_buffer.begin() + first * pos_floats_per_vertex;
-    auto p_erase_end_it   = m_dynamic_buffer.begin() + last * pos_floats_per_vertex;
-    m_dynamic_buffer.erase(p_erase_begin_it, p_erase_end_it);
+    // Sort, clip and merge the ranges
+    std::vector<VertexRange> erased;
+    erased.reserve(count);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t const last = std::min(ranges[i].last, m_vertex_count);
+        if(ranges[i].first < last)
+            erased.push_back({ranges[i].first, last});
+    }
+    if(erased.empty())
+        return;
 
-    if(m_components[ComponentsBitPos::normal])
+    std::sort(erased.begin(), erased.end(),
+              [](VertexRange const & a, VertexRange const & b) { return a.first < b.first; });
+    uint32_t num_erased = 0;
+    for(uint32_t i = 1; i < erased.size(); ++i)
     {
-        // Normals are after ALL positions.
-        // Original start of N_block was at m_vertex_count * pos_floats_per_vertex (relative to old
-        // dynamic_buffer start). After erasing 'count_to_erase' positions, the P_block is now (m_vertex_count
-        // - count_to_erase) * pos_floats_per_vertex long. This is the new offset from dynamic_buffer.begin()
-        // to where the N_block data starts.
-        uint32_t n_block_new_start_offset = (m_vertex_count - count_to_erase) * pos_floats_per_vertex;
-
-        auto n_erase_begin_it =
-            m_dynamic_buffer.begin() + n_block_new_start_offset + first * norm_floats_per_vertex;
-        auto n_erase_end_it =
-            m_dynamic_buffer.begin() + n_block_new_start_offset + last * norm_floats_per_vertex;
-        m_dynamic_buffer.erase(n_erase_begin_it, n_erase_end_it);
+        if(erased[i].first <= erased[num_erased].last)
+            erased[num_erased].last = std::max(erased[num_erased].last, erased[i].last);
+        else
+            erased[++num_erased] = erased[i];
     }
+    erased.resize(num_erased + 1);
 
-    // --- Handle m_static_bufffer (Texture Coordinates) ---
-    // Layout: T0_block T1_block ...
-    if(m_components[ComponentsBitPos::tex])
+    // Old to new vertex index table
+    std::vector<uint32_t> remap(m_vertex_count);
+    uint32_t              new_count = 0;
+    uint32_t              next      = 0;
+    for(auto const & range : erased)
     {
-        uint32_t total_tex_floats_erased_from_previous_channels = 0;
-        for(uint32_t i = 0; i < m_tex_channels_count; ++i)
+        for(; next < range.first; ++next)
+            remap[next] = new_count++;
+        std::fill(remap.begin() + range.first, remap.begin() + range.last, g_erased_vertex);
+        next = range.last;
+    }
+    for(; next < m_vertex_count; ++next)
+        remap[next] = new_count++;
+
+    // Kept runs only move towards the start of the buffer, so every block is compacted in place
+    auto compact = [this, &erased](std::vector<float> & data, uint32_t num_blocks, uint32_t comps) {
+        float * ptr = data.data();
+        size_t  dst = 0;
+
+        auto copy_run = [&](size_t block_start, uint32_t begin, uint32_t end) {
+            size_t const num_floats = static_cast<size_t>(end - begin) * comps;
+            if(num_floats > 0)
+                std::memmove(ptr + dst, ptr + block_start + begin * comps, num_floats * sizeof(float));
+            dst += num_floats;
+        };
+
+        for(uint32_t b = 0; b < num_blocks; ++b)
         {
-            // Calculate start of this channel's data in the original m_static_bufffer
-            uint32_t channel_i_original_start_offset = i * m_vertex_count * tex_floats_per_vertex;
+            size_t const block_start = static_cast<size_t>(b) * m_vertex_count * comps;
+            uint32_t     run_begin   = 0;
+            for(auto const & range : erased)
+            {
+                copy_run(block_start, run_begin, range.first);
+                run_begin = range.last;
+            }
+            copy_run(block_start, run_begin, m_vertex_count);
+        }
+        data.resize(dst);
+    };
 
-            auto t_erase_begin_it = m_static_bufffer.begin() + channel_i_original_start_offset
-                                    + first * tex_floats_per_vertex
-                                    - total_tex_floats_erased_from_previous_channels;
-            auto t_erase_end_it = t_erase_begin_it + count_to_erase * tex_floats_per_vertex;
+    compact(m_dynamic_buffer, m_components[ComponentsBitPos::normal] ? 2 : 1, 3);
+    if(m_components[ComponentsBitPos::tex])
+        compact(m_static_bufffer, m_tex_channels_count, 2);
 
-            m_static_bufffer.erase(t_erase_begin_it, t_erase_end_it);
+    // Remap the indices and drop the triangles that lost a vertex
+    RemapIndices(m_indices.data(), static_cast<uint32_t>(m_indices.size()), remap.data());
+    CompactTriangles(m_indices, false);
 
-            total_tex_floats_erased_from_previous_channels += count_to_erase * tex_floats_per_vertex;
-        }
+    markDirty(erased.front().first, new_count);
+    m_indices_dirty = true;
+    m_vertex_count  = new_count;
+    m_state         = m_vertex_count > 0 ? State::INITDATA : State::NODATA;
+    updateBounds();
+}
+
+uint32_t VertexBuffer::weld(float const tolerance)
+{
+    assert(hasCpuData());
+    assert(tolerance > 0.0f);
+
+    uint32_t const num_verts = m_vertex_count;
+    if(num_verts < 2)
+        return 0;
+
+    // Attribute blocks: data and floats per vertex
+    std::vector<std::pair<float const *, uint32_t>> blocks;
+    blocks.emplace_back(m_dynamic_buffer.data(), 3);
+    if(m_components[ComponentsBitPos::normal])
+        blocks.emplace_back(m_dynamic_buffer.data() + num_verts * 3, 3);
+    if(m_components[ComponentsBitPos::tex])
+    {
+        for(uint32_t ch = 0; ch < m_tex_channels_count; ++ch)
+            blocks.emplace_back(m_static_bufffer.data() + ch * num_verts * 2, 2);
     }
 
-    m_indices.erase(m_indices.begin() + first, m_indices.begin() + last);
+    // Positions are hashed on a grid of tolerance sized cells. Two vertices within the tolerance lie in
+    // the same or in adjacent cells, so every vertex probes the 27 cells around its own and compares
+    // all attributes of the candidates found there.
+    std::vector<int64_t>  cells(static_cast<size_t>(num_verts) * 3);
+    std::vector<uint64_t> hashes(num_verts);
+    double const          inv_tolerance = 1.0 / static_cast<double>(tolerance);
+
+    auto const cell_hash = [](int64_t const * cell) {
+        uint64_t hash = g_hash_offset;
+        for(uint32_t c = 0; c < 3; ++c)
+            hash = (hash ^ static_cast<uint64_t>(cell[c])) * g_hash_prime;
+        return hash;
+    };
+
+    ParallelFor(num_verts, g_weld_grain, [&](uint32_t begin, uint32_t end) {
+        for(uint32_t v = begin; v < end; ++v)
+        {
+            int64_t * cell = cells.data() + static_cast<size_t>(v) * 3;
+            for(uint32_t c = 0; c < 3; ++c)
+                cell[c] = static_cast<int64_t>(std::floor(static_cast<double>(blocks[0].first[v * 3 + c])
+                                                          * inv_tolerance));
+            hashes[v] = cell_hash(cell);
+        }
+    });
+
+    // Bucket the vertices by hash, counting sort keeps the index order inside every bucket
+    auto bucket_of = [](uint64_t hash) { return static_cast<uint32_t>(hash >> 32) & (g_weld_buckets - 1); };
+
+    std::vector<uint32_t> bucket_start(g_weld_buckets + 1, 0);
+    for(uint32_t v = 0; v < num_verts; ++v)
+        bucket_start[bucket_of(hashes[v]) + 1]++;
+    for(uint32_t b = 0; b < g_weld_buckets; ++b)
+        bucket_start[b + 1] += bucket_start[b];
+
+    std::vector<uint32_t> order(num_verts);
+    std::vector<uint32_t> fill(bucket_start.begin(), bucket_start.end() - 1);
+    for(uint32_t v = 0; v < num_verts; ++v)
+        order[fill[bucket_of(hashes[v])]++] = v;
+
+    auto const by_hash = [&hashes](uint32_t a, uint32_t c) { return hashes[a] < hashes[c]; };
+    ParallelFor(g_weld_buckets, 1, [&](uint32_t begin, uint32_t end) {
+        for(uint32_t b = begin; b < end; ++b)
+            std::stable_sort(order.begin() + bucket_start[b], order.begin() + bucket_start[b + 1], by_hash);
+    });
+
+    auto const within_tolerance = [&blocks, tolerance](uint32_t a, uint32_t c) {
+        for(auto const & [data, comps] : blocks)
+        {
+            for(uint32_t k = 0; k < comps; ++k)
+            {
+                if(std::abs(data[a * comps + k] - data[c * comps + k]) > tolerance)
+                    return false;
+            }
+        }
+        return true;
+    };
 
-    for(uint32_t i = 0; i < m_indices.size(); i++)
+    // calls 'match' for every vertex with a lower index that is equal to v within the tolerance
+    auto const for_each_match = [&](uint32_t v, auto && match) {
+        int64_t const * own = cells.data() + static_cast<size_t>(v) * 3;
+        for(int64_t dx = -1; dx <= 1; ++dx)
+        {
+            for(int64_t dy = -1; dy <= 1; ++dy)
+            {
+                for(int64_t dz = -1; dz <= 1; ++dz)
+                {
+                    int64_t const  cell[3] = {own[0] + dx, own[1] + dy, own[2] + dz};
+                    uint64_t const hash    = cell_hash(cell);
+                    uint32_t const b       = bucket_of(hash);
+
+                    auto const first = order.begin() + bucket_start[b];
+                    auto const last  = order.begin() + bucket_start[b + 1];
+                    auto       it    = std::lower_bound(first, last, hash, [&hashes](uint32_t u, uint64_t h) {
+                        return hashes[u] < h;
+                    });
+                    for(; it != last && hashes[*it] == hash; ++it)
+                    {
+                        uint32_t const u = *it;
+                        if(u < v && std::equal(cell, cell + 3, cells.data() + static_cast<size_t>(u) * 3)
+                           && within_tolerance(u, v))
+                        {
+                            match(u);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    // Matches of every vertex, counted and then stored in ascending index order
+    std::vector<uint32_t> match_start(num_verts + 1, 0);
+    ParallelFor(num_verts, g_weld_grain, [&](uint32_t begin, uint32_t end) {
+        for(uint32_t v = begin; v < end; ++v)
+            for_each_match(v, [&match_start, v](uint32_t) { match_start[v + 1]++; });
+    });
+    for(uint32_t v = 0; v < num_verts; ++v)
+        match_start[v + 1] += match_start[v];
+
+    std::vector<uint32_t> matches(match_start[num_verts]);
+    ParallelFor(num_verts, g_weld_grain, [&](uint32_t begin, uint32_t end) {
+        for(uint32_t v = begin; v < end; ++v)
+        {
+            uint32_t next = match_start[v];
+            for_each_match(v, [&matches, &next](uint32_t u) { matches[next++] = u; });
+            std::sort(matches.begin() + match_start[v], matches.begin() + match_start[v + 1]);
+        }
+    });
+
+    // A vertex joins the lowest representative within the tolerance, so every merged vertex is within
+    // the tolerance of the one it is replaced with and the result doesn't depend on the thread scheduling
+    std::vector<uint32_t> rep(num_verts);
+    for(uint32_t v = 0; v < num_verts; ++v)
     {
-        if(m_indices[i] > first)
+        rep[v] = v;
+        for(uint32_t m = match_start[v]; m < match_start[v + 1]; ++m)
         {
-            m_indices[i] -= count_to_erase;
+            if(rep[matches[m]] == matches[m])
+            {
+                rep[v] = matches[m];
+                break;
+            }
         }
     }
 
+    std::vector<uint32_t> remap(num_verts);
+    uint32_t              new_count = 0;
+    for(uint32_t v = 0; v < num_verts; ++v)
+        remap[v] = rep[v] == v ? new_count++ : remap[rep[v]];
+
+    if(new_count == num_verts)
+        return 0;
+
+    // Representatives only move towards the start of the buffer, compact in place
+    auto compact = [&rep, num_verts](std::vector<float> & data, uint32_t num_blocks, uint32_t comps) {
+        size_t dst = 0;
+        for(uint32_t b = 0; b < num_blocks; ++b)
+        {
+            size_t const block_start = static_cast<size_t>(b) * num_verts * comps;
+            for(uint32_t v = 0; v < num_verts; ++v)
+            {
+                if(rep[v] != v)
+                    continue;
+                for(uint32_t c = 0; c < comps; ++c)
+                    data[dst++] = data[block_start + v * comps + c];
+            }
+        }
+        data.resize(dst);
+    };
+
+    compact(m_dynamic_buffer, m_components[ComponentsBitPos::normal] ? 2 : 1, 3);
+    if(m_components[ComponentsBitPos::tex])
+        compact(m_static_bufffer, m_tex_channels_count, 2);
+
+    RemapIndices(m_indices.data(), static_cast<uint32_t>(m_indices.size()), remap.data());
+    CompactTriangles(m_indices, true);
+
+    m_vertex_count  = new_count;
     m_state         = State::INITDATA;
-    m_vertex_count -= count_to_erase;
+    m_indices_dirty = true;
+    markDirty(0, new_count);
+    updateBounds();
+
+    return num_verts - new_count;
+}
+
+void VertexBuffer::markDirty(uint32_t const first, uint32_t const last)
+{
+    if(m_dirty_first >= m_dirty_last)
+    {
+        m_dirty_first = first;
+        m_dirty_last  = last;
+    }
+    else
+    {
+        m_dirty_first = std::min(m_dirty_first, first);
+        m_dirty_last  = std::max(m_dirty_last, last);
+    }
 }
 
 void VertexBuffer::clear()
@@ -277,12 +582,94 @@ void VertexBuffer::clear()
     m_static_bufffer.resize(0);
     m_dynamic_buffer.resize(0);
     m_indices.resize(0);
-    m_vertex_count       = 0;
-    m_tex_channels_count = 0;
+    m_vertex_count          = 0;
+    m_committed_index_count = 0;
+    m_resident              = Retention::ALL;
+    m_dirty_first           = 0;
+    m_dirty_last            = 0;
+    m_indices_dirty         = false;
+    m_bounds                = AABB();
+    // m_tex_channels_count is a part of the buffer format and survives clear(), so a cleared buffer
+    // can be refilled with pushBack()
+}
+
+void VertexBuffer::swapData(std::vector<float> & dynamic_block, std::vector<float> & static_block,
+                            std::vector<uint32_t> & indices, uint32_t const vcount)
+{
+    assert(dynamic_block.size() == vcount * (m_components[ComponentsBitPos::normal] ? 6u : 3u));
+    assert(!m_components[ComponentsBitPos::tex] || static_block.size() == vcount * m_tex_channels_count * 2);
+
+    m_dynamic_buffer.swap(dynamic_block);
+    m_static_bufffer.swap(static_block);
+    m_indices.swap(indices);
+
+    m_vertex_count = vcount;
+    m_state        = vcount > 0 ? State::INITDATA : State::NODATA;
+    m_resident     = Retention::ALL;
+    markDirty(0, vcount);
+    m_indices_dirty = true;
+    updateBounds();
+}
+
+uint32_t VertexBuffer::getNumIndices() const
+{
+    return m_resident == Retention::ALL ? static_cast<uint32_t>(m_indices.size()) : m_committed_index_count;
+}
+
+void VertexBuffer::releaseCpuData()
+{
+    m_committed_index_count = static_cast<uint32_t>(m_indices.size());
+
+    if(m_retention == Retention::ALL)
+        return;
+
+    // swap with empty vectors to really free the memory
+    if(m_retention == Retention::POSITIONS)
+    {
+        std::vector<float> positions(m_dynamic_buffer.begin(), m_dynamic_buffer.begin() + m_vertex_count * 3);
+        m_dynamic_buffer.swap(positions);
+    }
+    else
+    {
+        std::vector<float>().swap(m_dynamic_buffer);
+    }
+    std::vector<float>().swap(m_static_bufffer);
+    std::vector<uint32_t>().swap(m_indices);
+
+    m_resident = m_retention;
+}
+
+void VertexBuffer::updateBounds()
+{
+    assert(m_resident != Retention::NONE);
+
+    m_bounds = AABBBatch::ReducePoints(m_dynamic_buffer.data(), m_vertex_count);
+}
+
+float const * VertexBuffer::getPositions() const
+{
+    assert(m_resident != Retention::NONE);
+
+    return m_dynamic_buffer.data();
+}
+
+float const * VertexBuffer::getNormals() const
+{
+    assert(m_components[ComponentsBitPos::normal] && hasCpuData());
+
+    return m_dynamic_buffer.data() + m_vertex_count * 3;
+}
+
+float const * VertexBuffer::getTexCoords(uint32_t channel) const
+{
+    assert(m_components[ComponentsBitPos::tex] && channel < m_tex_channels_count && hasCpuData());
+
+    return m_static_bufffer.data() + channel * m_vertex_count * 2;
 }
 
 void VertexBuffer::updateDynamicBuffer(std::vector<float> pos, std::vector<float> norm)
 {
+    assert(hasCpuData());
     assert((pos.size() == m_vertex_count * 3) && (norm.size() == m_vertex_count * 3));
 
     std::vector<float> new_dynamic_buffer(std::move(pos));
@@ -290,6 +677,9 @@ void VertexBuffer::updateDynamicBuffer(std::vector<float> pos, std::vector<float
                               std::make_move_iterator(norm.end()));
 
     m_dynamic_buffer.swap(new_dynamic_buffer);
+    m_state = State::INITDATA;
+    markDirty(0, m_vertex_count);
+    updateBounds();
 }
 
 void Add2DRectangle(VertexBuffer & vb, float x0, float y0, float x1, float y1, float s0, float t0, float s1,
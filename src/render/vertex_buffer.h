@@ -1,6 +1,7 @@
 #ifndef VERTEXBUFFER_H
 #define VERTEXBUFFER_H
 
+#include "AABB.h"
 #include <vector>
 #include <bitset>
 #include <cstdint>
@@ -15,6 +16,21 @@ public:
         COMITTED
     };
 
+    // CPU copies kept after uploadBuffer()
+    enum class Retention
+    {
+        ALL,         // every block, the buffer stays editable
+        POSITIONS,   // position block only (culling, picking)
+        NONE         // GPU data only
+    };
+
+    // Half-open vertex range [first, last)
+    struct VertexRange
+    {
+        uint32_t first;
+        uint32_t last;
+    };
+
     struct ComponentsBitPos
     {
         constexpr static int pos    = 0;
@@ -39,14 +55,43 @@ public:
                   uint32_t const vcount, uint32_t const * indices, uint32_t const icount);
 
     void eraseVertices(uint32_t const first, uint32_t const last);
+    // Erases any number of ranges (unsorted, overlapping) at once: the blocks are compacted in a single
+    // pass, triangles referencing an erased vertex are dropped and the remaining indices are remapped.
+    void eraseVertices(VertexRange const * ranges, uint32_t const count);
+    // Merges vertices whose position, normal and texture coordinates all differ by at most 'tolerance'
+    // from the kept vertex, rewrites the indices (dropping triangles that became degenerate) and shrinks
+    // the blocks. Returns the number of removed vertices.
+    uint32_t weld(float const tolerance = 1e-5f);
     void clear();
+    // Replaces the content with ready planar blocks without copying: the old blocks are returned in the
+    // arguments so that their storage can be reused for the next fill (streaming geometry).
+    void swapData(std::vector<float> & dynamic_block, std::vector<float> & static_block,
+                  std::vector<uint32_t> & indices, uint32_t const vcount);
 
     ComponentsFlags getComponentsFlags() const { return m_components; }
     uint32_t        getNumTexChannels() const { return m_tex_channels_count; }
     uint32_t        getNumVertex() const { return m_vertex_count; }
-    uint32_t        getNumTriangles() const { return static_cast<uint32_t>(m_indices.size()) / 3; }
+    uint32_t        getNumTriangles() const { return getNumIndices() / 3; }
+    uint32_t        getNumIndices() const;
     void            updateDynamicBuffer(std::vector<float> pos, std::vector<float> norm);
 
+    // Applied on every upload. Meshes edited on the CPU or fed to batching must keep all data;
+    // dropped blocks can be restored with RendererBase::readbackBuffer() or by refilling the buffer.
+    void      setRetention(Retention policy) { m_retention = policy; }
+    Retention getRetention() const { return m_retention; }
+    Retention getResidentData() const { return m_resident; }
+    bool      hasCpuData() const { return m_resident == Retention::ALL; }
+
+    // CPU side data access, planar blocks: PPP... NNN... and T0T0T0... T1T1T1...
+    float const *                 getPositions() const;
+    float const *                 getNormals() const;
+    float const *                 getTexCoords(uint32_t channel) const;
+    std::vector<uint32_t> const & getIndices() const { return m_indices; }
+
+    // Bounds of the position block: grown on appends, recomputed by the other edits, so reading them
+    // from several threads is safe. Stay available when the CPU copies are dropped.
+    AABB const & getBounds() const { return m_bounds; }
+
 private:
     std::vector<float> m_static_bufffer;   // for tex0 tex1 ...
     std::vector<float> m_dynamic_buffer;   // for pos norm
@@ -62,6 +107,26 @@ private:
     bool                  m_is_generated = false;
     State                 m_state        = State::NODATA;
 
+    Retention m_retention             = Retention::ALL;
+    Retention m_resident              = Retention::ALL;
+    uint32_t  m_committed_index_count = 0;   // GPU side, valid when the CPU indices are dropped
+
+    // Changes since the last upload, uploadBuffer() rewrites only these parts while the GPU storage
+    // is large enough
+    uint32_t m_dirty_first            = 0;   // vertex range [m_dirty_first, m_dirty_last)
+    uint32_t m_dirty_last             = 0;
+    bool     m_indices_dirty          = false;
+    uint32_t m_committed_vertex_count = 0;
+    size_t   m_gpu_dynamic_size       = 0;   // allocated bytes
+    size_t   m_gpu_static_size        = 0;
+    size_t   m_gpu_indices_size       = 0;
+
+    AABB m_bounds;
+
+    void markDirty(uint32_t first, uint32_t last);
+    void updateBounds();   // from the positions, after edits other than appends
+    void releaseCpuData();   // applies m_retention after the upload
+
     friend class RendererBase;
 };
 
@@ -0,0 +1,125 @@
+#include "vertex_transform.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <xmmintrin.h>
+#    define VT_USE_SSE
+#endif
+
+#ifdef VT_USE_SSE
+namespace
+{
+// x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3  ->  x0 x1 x2 x3 | y0 y1 y2 y3 | z0 z1 z2 z3
+inline void LoadXYZ4(float const * src, __m128 & x, __m128 & y, __m128 & z)
+{
+    __m128 const a  = _mm_loadu_ps(src + 0);
+    __m128 const b  = _mm_loadu_ps(src + 4);
+    __m128 const c  = _mm_loadu_ps(src + 8);
+    __m128 const t0 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));   // x2 y2 x3 y3
+    __m128 const t1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));   // y0 z0 y1 z1
+
+    x = _mm_shuffle_ps(a, t0, _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(t1, t0, _MM_SHUFFLE(3, 1, 2, 0));
+    z = _mm_shuffle_ps(t1, c, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+// inverse of LoadXYZ4
+inline void StoreXYZ4(float * dst, __m128 x, __m128 y, __m128 z)
+{
+    __m128 const xy01 = _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 0, 1, 0));   // x0 x1 y0 y1
+    __m128 const xy23 = _mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 2, 3, 2));   // x2 x3 y2 y3
+    __m128 const zx01 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0));   // z0 z0 x1 x1
+    __m128 const yz12 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(2, 1, 2, 1));   // y1 y2 z1 z2
+    __m128 const zx23 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2));   // z2 z2 x3 x3
+    __m128 const yz33 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3));   // y3 y3 z3 z3
+
+    _mm_storeu_ps(dst + 0, _mm_shuffle_ps(xy01, zx01, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(dst + 4, _mm_shuffle_ps(yz12, xy23, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(dst + 8, _mm_shuffle_ps(zx23, yz33, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+}   // namespace
+#endif
+
+glm::mat3 GetNormalMatrix(glm::mat4 const & model)
+{
+    return glm::transpose(glm::inverse(glm::mat3(model)));
+}
+
+void TransformPositions(glm::mat4 const & model, float const * src, float * dst, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef VT_USE_SSE
+    __m128 const m00 = _mm_set1_ps(model[0][0]), m01 = _mm_set1_ps(model[0][1]);
+    __m128 const m02 = _mm_set1_ps(model[0][2]), m10 = _mm_set1_ps(model[1][0]);
+    __m128 const m11 = _mm_set1_ps(model[1][1]), m12 = _mm_set1_ps(model[1][2]);
+    __m128 const m20 = _mm_set1_ps(model[2][0]), m21 = _mm_set1_ps(model[2][1]);
+    __m128 const m22 = _mm_set1_ps(model[2][2]), m30 = _mm_set1_ps(model[3][0]);
+    __m128 const m31 = _mm_set1_ps(model[3][1]), m32 = _mm_set1_ps(model[3][2]);
+
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 x, y, z;
+        LoadXYZ4(src + i * 3, x, y, z);
+
+        __m128 const rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)),
+                                     _mm_add_ps(_mm_mul_ps(m20, z), m30));
+        __m128 const ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)),
+                                     _mm_add_ps(_mm_mul_ps(m21, z), m31));
+        __m128 const rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)),
+                                     _mm_add_ps(_mm_mul_ps(m22, z), m32));
+
+        StoreXYZ4(dst + i * 3, rx, ry, rz);
+    }
+#endif
+    for(; i < count; ++i)
+    {
+        glm::vec4 const p = model * glm::vec4(src[i * 3 + 0], src[i * 3 + 1], src[i * 3 + 2], 1.0f);
+
+        dst[i * 3 + 0] = p.x;
+        dst[i * 3 + 1] = p.y;
+        dst[i * 3 + 2] = p.z;
+    }
+}
+
+void TransformNormals(glm::mat3 const & normal_mtx, float const * src, float * dst, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef VT_USE_SSE
+    __m128 const m00 = _mm_set1_ps(normal_mtx[0][0]), m01 = _mm_set1_ps(normal_mtx[0][1]),
+                 m02 = _mm_set1_ps(normal_mtx[0][2]);
+    __m128 const m10 = _mm_set1_ps(normal_mtx[1][0]), m11 = _mm_set1_ps(normal_mtx[1][1]),
+                 m12 = _mm_set1_ps(normal_mtx[1][2]);
+    __m128 const m20 = _mm_set1_ps(normal_mtx[2][0]), m21 = _mm_set1_ps(normal_mtx[2][1]),
+                 m22 = _mm_set1_ps(normal_mtx[2][2]);
+    __m128 const tiny = _mm_set1_ps(1e-30f);
+
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 x, y, z;
+        LoadXYZ4(src + i * 3, x, y, z);
+
+        __m128 const nx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_mul_ps(m20, z));
+        __m128 const ny = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m21, z));
+        __m128 const nz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_mul_ps(m22, z));
+
+        __m128 const len2 =
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+        // max() keeps degenerate (zero) normals finite
+        __m128 const inv_len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(len2, tiny)));
+
+        StoreXYZ4(dst + i * 3, _mm_mul_ps(nx, inv_len), _mm_mul_ps(ny, inv_len), _mm_mul_ps(nz, inv_len));
+    }
+#endif
+    for(; i < count; ++i)
+    {
+        glm::vec3 n = normal_mtx * glm::vec3(src[i * 3 + 0], src[i * 3 + 1], src[i * 3 + 2]);
+
+        float const len = std::sqrt(glm::dot(n, n));
+        if(len > 0.0f)
+            n = n / len;
+
+        dst[i * 3 + 0] = n.x;
+        dst[i * 3 + 1] = n.y;
+        dst[i * 3 + 2] = n.z;
+    }
+}
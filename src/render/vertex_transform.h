@@ -0,0 +1,18 @@
+#ifndef VERTEX_TRANSFORM_H
+#define VERTEX_TRANSFORM_H
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// CPU vertex transform kernels used by geometry batching.
+// All arrays are tightly packed xyz triples (the VertexBuffer planar block layout), src and dst may alias.
+
+// Returns the inverse-transpose of the upper 3x3 part of the model matrix
+glm::mat3 GetNormalMatrix(glm::mat4 const & model);
+
+// dst[i] = model * vec4(src[i], 1.0)
+void TransformPositions(glm::mat4 const & model, float const * src, float * dst, uint32_t count);
+// dst[i] = normalize(normal_mtx * src[i])
+void TransformNormals(glm::mat3 const & normal_mtx, float const * src, float * dst, uint32_t count);
+
+#endif   // VERTEX_TRANSFORM_H
@@ -0,0 +1,331 @@
+#include "imagedata.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cstring>
+
+#pragma pack(push, 1)
+
+struct DDSPIXELFORMAT
+{
+    uint32_t dwSize;
+    uint32_t dwFlags;
+    uint32_t dwFourCC;
+    uint32_t dwRGBBitCount;
+    uint32_t dwRBitMask;
+    uint32_t dwGBitMask;
+    uint32_t dwBBitMask;
+    uint32_t dwABitMask;
+};
+
+struct DDSHEADER
+{
+    uint32_t       dwMagic;   // "DDS "
+    uint32_t       dwSize;    // 124, without the magic
+    uint32_t       dwFlags;
+    uint32_t       dwHeight;
+    uint32_t       dwWidth;
+    uint32_t       dwPitchOrLinearSize;
+    uint32_t       dwDepth;
+    uint32_t       dwMipMapCount;
+    uint32_t       dwReserved1[11];
+    DDSPIXELFORMAT ddspf;
+    uint32_t       dwCaps;
+    uint32_t       dwCaps2;
+    uint32_t       dwCaps3;
+    uint32_t       dwCaps4;
+    uint32_t       dwReserved2;
+};
+
+struct DDSHEADERDX10
+{
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+#pragma pack(pop)
+
+namespace
+{
+constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+{
+    return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 | static_cast<uint32_t>(c) << 16
+           | static_cast<uint32_t>(d) << 24;
+}
+
+constexpr uint32_t g_dds_magic        = MakeFourCC('D', 'D', 'S', ' ');
+constexpr uint32_t g_fourcc_dxt1      = MakeFourCC('D', 'X', 'T', '1');
+constexpr uint32_t g_fourcc_dxt3      = MakeFourCC('D', 'X', 'T', '3');
+constexpr uint32_t g_fourcc_dxt5      = MakeFourCC('D', 'X', 'T', '5');
+constexpr uint32_t g_fourcc_dx10      = MakeFourCC('D', 'X', '1', '0');
+constexpr uint32_t g_ddsd_mipmapcount = 0x20000;
+constexpr uint32_t g_ddpf_alpha       = 0x1;
+constexpr uint32_t g_ddpf_fourcc      = 0x4;
+constexpr uint32_t g_ddpf_rgb         = 0x40;
+constexpr uint32_t g_caps2_cubemap    = 0x200;
+constexpr uint32_t g_caps2_all_faces  = 0xFC00;
+constexpr uint32_t g_caps2_volume     = 0x200000;
+constexpr uint32_t g_dx10_texture2d   = 3;
+constexpr uint32_t g_dx10_cubemap     = 0x4;
+
+using PixelType = tex::ImageData::PixelType;
+
+struct Format
+{
+    PixelType type         = PixelType::pt_none;
+    bool      opaque_alpha = false;   // X8 channel, set to 255
+};
+
+Format GetLegacyFormat(DDSPIXELFORMAT const & pf)
+{
+    if(pf.dwFlags & g_ddpf_fourcc)
+    {
+        switch(pf.dwFourCC)
+        {
+            case g_fourcc_dxt1:
+                return {PixelType::pt_dxt1};
+            case g_fourcc_dxt3:
+                return {PixelType::pt_dxt3};
+            case g_fourcc_dxt5:
+                return {PixelType::pt_dxt5};
+            default:
+                return {};
+        }
+    }
+
+    if(!(pf.dwFlags & g_ddpf_rgb) || pf.dwGBitMask != 0xFF00)
+        return {};
+
+    bool const bgr = pf.dwRBitMask == 0xFF0000 && pf.dwBBitMask == 0xFF;
+    bool const rgb = pf.dwRBitMask == 0xFF && pf.dwBBitMask == 0xFF0000;
+    if(pf.dwRGBBitCount == 24 && (bgr || rgb))
+        return {bgr ? PixelType::pt_bgr : PixelType::pt_rgb};
+    if(pf.dwRGBBitCount == 32 && (bgr || rgb))
+    {
+        bool const alpha = (pf.dwFlags & g_ddpf_alpha) && pf.dwABitMask == 0xFF000000;
+        return {bgr ? PixelType::pt_bgra : PixelType::pt_rgba, !alpha};
+    }
+
+    return {};
+}
+
+Format GetDX10Format(uint32_t dxgi_format)
+{
+    switch(dxgi_format)
+    {
+        case 71:   // BC1_UNORM
+        case 72:   // BC1_UNORM_SRGB
+            return {PixelType::pt_dxt1};
+        case 74:   // BC2
+        case 75:
+            return {PixelType::pt_dxt3};
+        case 77:   // BC3
+        case 78:
+            return {PixelType::pt_dxt5};
+        case 28:   // R8G8B8A8_UNORM
+        case 29:
+            return {PixelType::pt_rgba};
+        case 87:   // B8G8R8A8_UNORM
+        case 91:
+            return {PixelType::pt_bgra};
+        case 88:   // B8G8R8X8_UNORM
+        case 93:
+            return {PixelType::pt_bgra, true};
+        default:
+            return {};
+    }
+}
+
+// Flips the first 'rows' rows of a 4x4 block upside down
+void FlipColorBlock(uint8_t * block, uint32_t rows)
+{
+    std::reverse(block + 4, block + 4 + rows);   // a byte of indices per row
+}
+
+void FlipExplicitAlphaBlock(uint8_t * block, uint32_t rows)
+{
+    for(uint32_t i = 0; i < rows / 2; ++i)   // 16 bits per row
+    {
+        std::swap(block[i * 2], block[(rows - 1 - i) * 2]);
+        std::swap(block[i * 2 + 1], block[(rows - 1 - i) * 2 + 1]);
+    }
+}
+
+void FlipInterpolatedAlphaBlock(uint8_t * block, uint32_t rows)
+{
+    // 48 bits of 3 bit indices after the two endpoints, 12 bits per row
+    uint64_t bits = 0;
+    for(uint32_t i = 0; i < 6; ++i)
+        bits |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+
+    uint64_t flipped = bits;
+    for(uint32_t i = 0; i < rows; ++i)
+    {
+        uint64_t const row   = (bits >> (12 * i)) & 0xFFF;
+        uint32_t const shift = 12 * (rows - 1 - i);
+        flipped              = (flipped & ~(uint64_t{0xFFF} << shift)) | row << shift;
+    }
+
+    for(uint32_t i = 0; i < 6; ++i)
+        block[2 + i] = static_cast<uint8_t>(flipped >> (8 * i));
+}
+
+// Copies one level with its rows in bottom-up order
+void CopyLevel(uint8_t const * src, uint8_t * dst, tex::ImageData::Level const & level, PixelType type,
+               bool opaque_alpha)
+{
+    if(type == PixelType::pt_dxt1 || type == PixelType::pt_dxt3 || type == PixelType::pt_dxt5)
+    {
+        uint32_t const block_size = type == PixelType::pt_dxt1 ? 8 : 16;
+        uint32_t const blocks_x   = std::max((level.width + 3) / 4, 1u);
+        uint32_t const blocks_y   = std::max((level.height + 3) / 4, 1u);
+        uint32_t const row_size   = blocks_x * block_size;
+        uint32_t const rows       = std::min(level.height, 4u);   // in a block
+
+        for(uint32_t y = 0; y < blocks_y; ++y)
+        {
+            uint8_t * row = dst + (blocks_y - 1 - y) * row_size;
+            std::memcpy(row, src + y * row_size, row_size);
+
+            for(uint8_t * block = row; block < row + row_size; block += block_size)
+            {
+                if(type == PixelType::pt_dxt1)
+                    FlipColorBlock(block, rows);
+                else
+                {
+                    if(type == PixelType::pt_dxt3)
+                        FlipExplicitAlphaBlock(block, rows);
+                    else
+                        FlipInterpolatedAlphaBlock(block, rows);
+                    FlipColorBlock(block + 8, rows);
+                }
+            }
+        }
+        return;
+    }
+
+    uint32_t const row_size = level.size / level.height;
+    for(uint32_t y = 0; y < level.height; ++y)
+        std::memcpy(dst + (level.height - 1 - y) * row_size, src + y * row_size, row_size);
+
+    if(opaque_alpha)
+        for(uint32_t i = 3; i < level.size; i += 4)
+            dst[i] = 255;
+}
+}   // namespace
+
+namespace tex
+{
+//==============================================================================
+//         Read DDS section
+//==============================================================================
+bool ReadDDS(std::string const & file_name, ImageData & id)
+{
+    id.width     = 0;
+    id.height    = 0;
+    id.depth     = 0;
+    id.num_mips  = 1;
+    id.num_faces = 1;
+    id.type      = ImageData::PixelType::pt_none;
+    id.data.reset();
+    id.view = nullptr;
+    id.view_source.reset();
+
+    MappedFile file;
+    if(!file.open(file_name))
+        return false;
+
+    uint8_t const * data = file.data();
+    uint8_t const * end  = data + file.size();
+    if(file.size() < sizeof(DDSHEADER))
+        return false;
+
+    DDSHEADER header;
+    std::memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    if(header.dwMagic != g_dds_magic || header.dwSize != sizeof(DDSHEADER) - sizeof(uint32_t)
+       || header.dwWidth == 0 || header.dwHeight == 0 || (header.dwCaps2 & g_caps2_volume))
+        return false;
+
+    Format format;
+    bool   cube = false;
+    if((header.ddspf.dwFlags & g_ddpf_fourcc) && header.ddspf.dwFourCC == g_fourcc_dx10)
+    {
+        DDSHEADERDX10 dx10;
+        if(static_cast<size_t>(end - data) < sizeof(dx10))
+            return false;
+        std::memcpy(&dx10, data, sizeof(dx10));
+        data += sizeof(dx10);
+
+        if(dx10.resourceDimension != g_dx10_texture2d || dx10.arraySize != 1)
+            return false;
+
+        format = GetDX10Format(dx10.dxgiFormat);
+        cube   = (dx10.miscFlag & g_dx10_cubemap) != 0;
+    }
+    else
+    {
+        format = GetLegacyFormat(header.ddspf);
+        if(header.dwCaps2 & g_caps2_cubemap)
+        {
+            if((header.dwCaps2 & g_caps2_all_faces) != g_caps2_all_faces)
+                return false;   // GL cube maps need every face
+            cube = true;
+        }
+    }
+
+    if(format.type == ImageData::PixelType::pt_none)
+        return false;
+
+    id.width     = header.dwWidth;
+    id.height    = header.dwHeight;
+    id.type      = format.type;
+    id.num_faces = cube ? 6 : 1;
+    id.num_mips  = 1;
+    if((header.dwFlags & g_ddsd_mipmapcount) && header.dwMipMapCount > 1)
+    {
+        // a chain never goes below 1x1; the size of levels stored past it is unknown, so the offsets of
+        // the following faces would be too
+        uint32_t max_mips = 1;
+        while((std::max(id.width, id.height) >> max_mips) > 0)
+            ++max_mips;
+        if(header.dwMipMapCount > max_mips)
+            return false;
+        id.num_mips = header.dwMipMapCount;
+    }
+
+    // the face layout of the file is the one of ImageData
+    uint64_t face_size = 0;
+    for(uint32_t mip = 0; mip < id.num_mips; ++mip)
+    {
+        uint32_t const height = std::max(id.height >> mip, 1u);
+        if(id.isCompressed() && height > 4 && height % 4 != 0)
+            return false;   // the rows of a partial block row can't be flipped in place
+
+        face_size += ImageData::GetLevelSize(id.type, std::max(id.width >> mip, 1u), height);
+    }
+
+    uint64_t const total_size = face_size * id.num_faces;
+    if(total_size > UINT32_MAX || static_cast<uint64_t>(end - data) < total_size)
+        return false;
+
+    id.data_size = static_cast<uint32_t>(total_size);
+    id.data      = std::make_unique<uint8_t[]>(id.data_size);
+
+    for(uint32_t face = 0; face < id.num_faces; ++face)
+    {
+        for(uint32_t mip = 0; mip < id.num_mips; ++mip)
+        {
+            ImageData::Level const level = id.getLevel(face, mip);
+            uint8_t * const        dst   = id.data.get() + (level.pixels - id.data.get());
+
+            CopyLevel(data, dst, level, id.type, format.opaque_alpha);
+            data += level.size;
+        }
+    }
+
+    return true;
+}
+}   // namespace tex
@@ -1,8 +1,14 @@
 #include "imagedata.h"
+#include "mapped_file.h"
+#include "pixel_convert.h"
+#include "tga_stream.h"
+#include <assert.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 #include <fstream>
-#include <iostream>
 
 #pragma pack(push, 1)
 
@@ -60,58 +66,109 @@ struct TGAHEADER
 namespace tex
 {
 //==============================================================================
-//         Read BMP section
+//         ImageData
 //==============================================================================
-bool ReadBMP(std::string const & file_name, ImageData & id)
+bool ImageData::isCompressed() const
 {
-    bool   res         = false;
-    bool   compressed  = false;
-    bool   flip        = false;
-    size_t file_length = 0;
+    return type == PixelType::pt_dxt1 || type == PixelType::pt_dxt3 || type == PixelType::pt_dxt5
+           || type == PixelType::pt_compressed;
+}
 
-    id.width  = 0;
-    id.height = 0;
-    id.type   = ImageData::PixelType::pt_none;
-    if(id.data)
-        id.data.reset(nullptr);
+uint32_t ImageData::GetLevelSize(PixelType type, uint32_t width, uint32_t height)
+{
+    switch(type)
+    {
+        case PixelType::pt_rgb:
+        case PixelType::pt_bgr:
+            return width * height * 3;
+        case PixelType::pt_rgba:
+        case PixelType::pt_bgra:
+            return width * height * 4;
+        case PixelType::pt_dxt1:
+            return std::max((width + 3) / 4, 1u) * std::max((height + 3) / 4, 1u) * 8;
+        case PixelType::pt_dxt3:
+        case PixelType::pt_dxt5:
+            return std::max((width + 3) / 4, 1u) * std::max((height + 3) / 4, 1u) * 16;
+        default:
+            assert(false);
+            return 0;
+    }
+}
 
-    std::ifstream        ifile(file_name, std::ios::binary);
-    std::vector<uint8_t> file;
+ImageData::Level ImageData::getLevel(uint32_t face, uint32_t mip) const
+{
+    assert(face < num_faces && mip < num_mips && pixels() != nullptr);
 
-    if(ifile.is_open())
+    uint32_t face_size = 0;
+    uint32_t offset    = 0;
+    for(uint32_t i = 0; i < num_mips; ++i)
     {
-        ifile.seekg(0, std::ios_base::end);
-        auto length = ifile.tellg();
-        ifile.seekg(0, std::ios_base::beg);
+        uint32_t const level_size = GetLevelSize(type, std::max(width >> i, 1u), std::max(height >> i, 1u));
+        if(i < mip)
+            offset += level_size;
+        face_size += level_size;
+    }
 
-        file.resize(static_cast<size_t>(length));
+    Level level;
+    level.pixels = pixels() + face_size * face + offset;
+    level.width  = std::max(width >> mip, 1u);
+    level.height = std::max(height >> mip, 1u);
+    level.size   = GetLevelSize(type, level.width, level.height);
 
-        ifile.read(reinterpret_cast<char *>(file.data()), length);
+    return level;
+}
 
-        auto success = !ifile.fail() && length == ifile.gcount();
-        ifile.close();
+bool ReadImage(std::string const & file_name, ImageData & id, bool allow_view)
+{
+    auto const  dot = file_name.rfind('.');
+    std::string ext = dot == std::string::npos ? std::string() : file_name.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
 
-        if(!success)
-            return false;
-    }
-    else
-        return false;
+    if(ext == "dds")
+        return ReadDDS(file_name, id);
+    if(ext == "bmp")
+        return ReadBMP(file_name, id, allow_view);
+
+    return ReadTGA(file_name, id, allow_view);
+}
+
+//==============================================================================
+//         Read BMP section
+//==============================================================================
+bool ReadBMP(std::string const & file_name, ImageData & id, bool allow_view)
+{
+    bool res        = false;
+    bool compressed = false;
+    bool flip       = false;
+
+    id.width     = 0;
+    id.height    = 0;
+    id.num_mips  = 1;
+    id.num_faces = 1;
+    id.type      = ImageData::PixelType::pt_none;
+    id.data.reset();
+    id.view = nullptr;
+    id.view_source.reset();
+
+    auto file = std::make_shared<MappedFile>();
+    if(!file->open(file_name))
+        return res;
 
-    file_length = file.size();
-    if(file_length == 0)
+    size_t const file_length = file->size();
+    if(file_length < sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFO12))
         return res;
 
-    auto * buffer = file.data();
+    auto const * buffer = file->data();
 
-    auto *             pPtr    = buffer;
-    BITMAPFILEHEADER * pHeader = reinterpret_cast<BITMAPFILEHEADER *>(pPtr);
+    auto const *             pPtr    = buffer;
+    BITMAPFILEHEADER const * pHeader = reinterpret_cast<BITMAPFILEHEADER const *>(pPtr);
     pPtr += sizeof(BITMAPFILEHEADER);
     if(pHeader->bfSize != file_length || pHeader->bfType != 0x4D42)   // little-endian
         return res;
 
-    if(reinterpret_cast<uint32_t *>(pPtr)[0] == 12)
+    if(reinterpret_cast<BITMAPINFO12 const *>(pPtr)->biSize == 12)   // packed, no unaligned uint32_t load
     {
-        BITMAPINFO12 * pInfo = reinterpret_cast<BITMAPINFO12 *>(pPtr);
+        BITMAPINFO12 const * pInfo = reinterpret_cast<BITMAPINFO12 const *>(pPtr);
 
         if(pInfo->biBitCount != 24 && pInfo->biBitCount != 32)
             return res;
@@ -126,7 +183,10 @@ bool ReadBMP(std::string const & file_name, ImageData & id)
     }
     else
     {
-        BITMAPINFO * pInfo = reinterpret_cast<BITMAPINFO *>(pPtr);
+        if(file_length < sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFO))
+            return res;
+
+        BITMAPINFO const * pInfo = reinterpret_cast<BITMAPINFO const *>(pPtr);
 
         if(pInfo->biBitCount != 24 && pInfo->biBitCount != 32)
             return res;
@@ -157,72 +217,42 @@ bool ReadBMP(std::string const & file_name, ImageData & id)
     pPtr                     = buffer + pHeader->bfOffBits;
     uint32_t lineLength      = 0;
     uint32_t bytes_per_pixel = (id.type == ImageData::PixelType::pt_rgb ? 3 : 4);
-    auto     image           = std::make_unique<uint8_t[]>(id.width * id.height * bytes_per_pixel);
-    id.data_size             = id.width * id.height * bytes_per_pixel;
-    uint8_t  red, green, blue, alpha;
-    uint32_t w_ind(0), h_ind(0);
 
     if(id.type == ImageData::PixelType::pt_rgb)
         lineLength = id.width * bytes_per_pixel + id.width % 4;
     else
         lineLength = id.width * bytes_per_pixel;
 
-    for(uint32_t i = 0; i < id.height; ++i)
-    {
-        w_ind = 0;
-        for(uint32_t j = 0; j < lineLength; j += bytes_per_pixel)
-        {
-            if(j > id.width * bytes_per_pixel)
-                continue;
-
-            if(compressed)
-            {
-                uint32_t count = 0;
-                if(id.type == ImageData::PixelType::pt_rgba)
-                {
-                    alpha = pPtr[i * lineLength + j + count];
-                    count++;
-                }
-                blue = pPtr[i * lineLength + j + count];
-                count++;
-                green = pPtr[i * lineLength + j + count];
-                count++;
-                red = pPtr[i * lineLength + j + count];
-            }
-            else
-            {
-                blue  = pPtr[i * lineLength + j + 0];
-                green = pPtr[i * lineLength + j + 1];
-                red   = pPtr[i * lineLength + j + 2];
-                if(id.type == ImageData::PixelType::pt_rgba)   // !!!Not supported - the high byte in each
-                                                               // DWORD is not used
-                    // https://msdn.microsoft.com/en-us/library/windows/desktop/dd183376(v=vs.85).aspx
-                    alpha = pPtr[i * lineLength + j + 3];
-            }
-
-            image[h_ind * id.width * bytes_per_pixel + w_ind * bytes_per_pixel + 0] = red;
-            image[h_ind * id.width * bytes_per_pixel + w_ind * bytes_per_pixel + 1] = green;
-            image[h_ind * id.width * bytes_per_pixel + w_ind * bytes_per_pixel + 2] = blue;
-            if(id.type == ImageData::PixelType::pt_rgba)
-                image[h_ind * id.width * bytes_per_pixel + w_ind * bytes_per_pixel + 3] = alpha;
-            w_ind++;
-        }
-        h_ind++;
-    }
+    if(pHeader->bfOffBits + static_cast<size_t>(lineLength) * id.height > file_length)
+        return res;
+
+    id.data_size = id.width * id.height * bytes_per_pixel;
 
-    // flip image if necessary
-    if(flip)
+    // bottom-up rows without padding are already in GL order
+    if(allow_view && !compressed && !flip && lineLength == id.width * bytes_per_pixel)
     {
-        auto temp_buf = std::make_unique<uint8_t[]>(id.width * id.height * bytes_per_pixel);
+        id.type        = bytes_per_pixel == 3 ? ImageData::PixelType::pt_bgr : ImageData::PixelType::pt_bgra;
+        id.view        = pPtr;
+        id.view_source = std::move(file);
+        return true;
+    }
 
-        for(uint32_t i = 0; i < id.height; i++)
-        {
-            std::memcpy(temp_buf.get() + i * id.width * bytes_per_pixel,
-                        image.get() + (id.height - 1 - i) * id.width * bytes_per_pixel,
-                        id.width * bytes_per_pixel);
-        }
+    auto image = std::make_unique<uint8_t[]>(id.data_size);
 
-        image = std::move(temp_buf);
+    for(uint32_t i = 0; i < id.height; ++i)
+    {
+        // top-down files are flipped while decoding
+        uint32_t const  dst_index = flip ? id.height - 1 - i : i;
+        uint8_t const * src_row   = pPtr + i * lineLength;
+        uint8_t *       dst_row   = image.get() + dst_index * id.width * bytes_per_pixel;
+
+        if(id.type == ImageData::PixelType::pt_rgb)
+            convert::BGRToRGB(src_row, dst_row, id.width);
+        else if(compressed)
+            convert::ABGRToRGBA(src_row, dst_row, id.width);
+        else   // !!!Not supported - the high byte in each DWORD is not used
+            // https://msdn.microsoft.com/en-us/library/windows/desktop/dd183376(v=vs.85).aspx
+            convert::BGRAToRGBA(src_row, dst_row, id.width);
     }
 
     id.data = std::move(image);
@@ -238,37 +268,31 @@ bool WriteTGA(std::string file_name, ImageData const & id)
 {
     TGAHEADER tga;
     std::memset(&tga, 0, sizeof(tga));
-    uint8_t bytes_per_pixel = (id.type == ImageData::PixelType::pt_rgb ? 3 : 4);
+    bool const bgr = id.type == ImageData::PixelType::pt_bgr || id.type == ImageData::PixelType::pt_bgra;
+    uint8_t    bytes_per_pixel =
+        (id.type == ImageData::PixelType::pt_rgb || id.type == ImageData::PixelType::pt_bgr ? 3 : 4);
 
     tga.datatypecode = 2;
     tga.width        = static_cast<uint16_t>(id.width);
     tga.height       = static_cast<uint16_t>(id.height);
     tga.bitsperpixel = static_cast<uint8_t>(bytes_per_pixel * 8);
-    if(id.type == ImageData::PixelType::pt_rgb)
+    if(bytes_per_pixel == 3)
         tga.imagedescriptor = 0x10;
     else
         tga.imagedescriptor = 0x18;
 
-    std::vector<uint8_t> out_data;
-    out_data.resize(sizeof(tga));
+    uint32_t const       num_pixels = id.width * id.height;
+    std::vector<uint8_t> out_data(sizeof(tga) + num_pixels * bytes_per_pixel);
     std::memcpy(out_data.data(), &tga, sizeof(tga));
 
-    uint8_t * data_ptr = id.data.get();
-    uint8_t   red, green, blue, alpha;
-    for(uint32_t i = 0; i < id.width * id.height * bytes_per_pixel; i += bytes_per_pixel)
-    {
-        red   = data_ptr[i + 0];
-        green = data_ptr[i + 1];
-        blue  = data_ptr[i + 2];
-        if(bytes_per_pixel == 4)
-            alpha = data_ptr[i + 3];
-
-        out_data.push_back(blue);
-        out_data.push_back(green);
-        out_data.push_back(red);
-        if(id.type == ImageData::PixelType::pt_rgba)
-            out_data.push_back(alpha);
-    }
+    uint8_t const * data_ptr = id.pixels();
+    uint8_t *       out_ptr  = out_data.data() + sizeof(tga);
+    if(bgr)   // already in file order
+        std::memcpy(out_ptr, data_ptr, num_pixels * bytes_per_pixel);
+    else if(bytes_per_pixel == 3)
+        convert::BGRToRGB(data_ptr, out_ptr, num_pixels);   // the same swap turns RGB to BGR
+    else
+        convert::BGRAToRGBA(data_ptr, out_ptr, num_pixels);
 
     std::ofstream ofile(file_name, std::ios::binary);
     if(!ofile.is_open())
@@ -280,45 +304,42 @@ bool WriteTGA(std::string file_name, ImageData const & id)
     return true;
 }
 
-bool ReadUncompressedTGA(ImageData & image, uint8_t * data);
-bool ReadCompressedTGA(ImageData & image, uint8_t * data);
+// The decoders write every row to its final place: bottom-up (flipped when the file is top-down) and
+// mirrored in place when the file is right to left, so no pass over the whole image is added
+bool ReadUncompressedTGA(ImageData & image, uint8_t const * data, bool flip_horizontal, bool flip_vertical);
+bool ReadCompressedTGA(ImageData & image, uint8_t const * data, uint8_t const * end, bool flip_horizontal,
+                       bool flip_vertical);
 
-bool ReadTGA(std::string const & file_name, ImageData & id)
+bool ReadTGA(std::string const & file_name, ImageData & id, bool allow_view)
 {
-    size_t file_length = 0;
-
-    std::ifstream     ifile(file_name, std::ios::binary);
-    std::vector<char> file;
-
-    if(ifile.is_open())
-    {
-        ifile.seekg(0, std::ios_base::end);
-        auto length = ifile.tellg();
-        ifile.seekg(0, std::ios_base::beg);
-
-        file.resize(static_cast<size_t>(length));
-
-        ifile.read(reinterpret_cast<char *>(file.data()), length);
-
-        auto success = !ifile.fail() && length == ifile.gcount();
-        ifile.close();
-
-        if(!success)
-            return false;
-    }
-    else
+    id.num_mips  = 1;
+    id.num_faces = 1;
+    id.data.reset();
+    id.view = nullptr;
+    id.view_source.reset();
+
+    auto file = std::make_shared<MappedFile>();
+    if(!file->open(file_name))
         return false;
 
-    file_length = file.size();
-    if(file_length == 0)
+    size_t const file_length = file->size();
+    if(file_length < sizeof(TGAHEADER))
         return false;
 
-    auto * buffer = file.data();
-
-    uint8_t *   data     = reinterpret_cast<uint8_t *>(buffer);
-    TGAHEADER * p_header = reinterpret_cast<TGAHEADER *>(data);
+    uint8_t const *   data     = file->data();
+    uint8_t const *   end      = data + file_length;
+    TGAHEADER const * p_header = reinterpret_cast<TGAHEADER const *>(data);
+
+    // a colour map of a true colour file is skipped as in TGAStreamReader, entries take whole bytes
+    size_t const colour_map_size =
+        p_header->colourmaptype != 0
+            ? static_cast<size_t>(p_header->colourmaplength) * ((p_header->colourmapdepth + 7u) / 8u)
+            : 0;
+    size_t const pixels_offset = sizeof(TGAHEADER) + p_header->idlength + colour_map_size;
+    if(pixels_offset > file_length)
+        return false;
 
-    data += sizeof(TGAHEADER);
+    data += pixels_offset;
     if((p_header->width == 0) || (p_header->height == 0)
        || ((p_header->bitsperpixel != 24)
            && (p_header->bitsperpixel != 32)))   // Make sure all information is valid
@@ -337,139 +358,86 @@ bool ReadTGA(std::string const & file_name, ImageData & id)
 
     if(p_header->datatypecode == 2)
     {
-        ReadUncompressedTGA(id, data);
-    }
-    else if(p_header->datatypecode == 10)
-    {
-        if(!ReadCompressedTGA(id, data))
+        if(data > end || static_cast<size_t>(end - data) < id.data_size)
             return false;
-    }
-
-    if(flip_vertical)
-    {
-        auto flipped_image = std::make_unique<uint8_t[]>(id.data_size);
 
-        for(uint32_t i = 0; i < id.height; i++)
+        // bottom-up, left to right BGR(A) rows are already in GL order
+        if(allow_view && !flip_horizontal && !flip_vertical)
         {
-            std::memcpy(flipped_image.get() + i * id.width * bytes_per_pixel,
-                        id.data.get() + (id.height - 1 - i) * id.width * bytes_per_pixel,
-                        id.width * bytes_per_pixel);
+            id.type =
+                bytes_per_pixel == 3 ? ImageData::PixelType::pt_bgr : ImageData::PixelType::pt_bgra;
+            id.view        = data;
+            id.view_source = std::move(file);
+            return true;
         }
 
-        id.data = std::move(flipped_image);
+        ReadUncompressedTGA(id, data, flip_horizontal, flip_vertical);
     }
-
-    if(flip_horizontal)
+    else if(p_header->datatypecode == 10)
     {
-        auto flipped_image = std::make_unique<uint8_t[]>(id.data_size);
-
-        for(uint32_t i = 0; i < id.height; i++)
-        {
-            for(uint32_t j = 0; j < id.width; j++)
-            {
-                flipped_image[id.width * bytes_per_pixel * i + j * bytes_per_pixel + 0] =
-                    id.data[id.width * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 0];
-                flipped_image[id.width * bytes_per_pixel * i + j * bytes_per_pixel + 1] =
-                    id.data[id.width * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 1];
-                flipped_image[id.width * bytes_per_pixel * i + j * bytes_per_pixel + 2] =
-                    id.data[id.width * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 2];
-                if(id.type == ImageData::PixelType::pt_rgba)
-                    flipped_image[id.width * bytes_per_pixel * i + j * bytes_per_pixel + 3] =
-                        id.data[id.width * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 3];
-            }
-        }
-
-        id.data = std::move(flipped_image);
+        if(data > end || !ReadCompressedTGA(id, data, end, flip_horizontal, flip_vertical))
+            return false;
     }
+    else
+        return false;
 
     return true;
 }
 
-bool ReadUncompressedTGA(ImageData & image, uint8_t * data)
+namespace
+{
+uint8_t * GetRow(ImageData const & image, uint32_t file_row, bool flip_vertical, uint32_t row_size)
 {
-    uint32_t bytes_per_pixel = image.type == ImageData::PixelType::pt_rgb ? 3 : 4;
-    auto     img             = std::make_unique<uint8_t[]>(image.data_size);
+    uint32_t const row = flip_vertical ? image.height - 1 - file_row : file_row;
+    return image.data.get() + static_cast<size_t>(row) * row_size;
+}
+
+void ConvertPixels(ImageData const & image, uint8_t const * src, uint8_t * dst, uint32_t num_pixels)
+{
+    if(image.type == ImageData::PixelType::pt_rgb)
+        convert::BGRToRGB(src, dst, num_pixels);
+    else
+        convert::BGRAToRGBA(src, dst, num_pixels);
+}
+}   // namespace
 
-    for(uint32_t i = 0; i < image.width * image.height; ++i)
+bool ReadUncompressedTGA(ImageData & image, uint8_t const * data, bool flip_horizontal, bool flip_vertical)
+{
+    uint32_t const bytes_per_pixel = image.type == ImageData::PixelType::pt_rgb ? 3 : 4;
+    uint32_t const row_size        = image.width * bytes_per_pixel;
+
+    image.data = std::make_unique<uint8_t[]>(image.data_size);
+    for(uint32_t i = 0; i < image.height; ++i)
     {
-        uint8_t red, green, blue, alpha;
-
-        red   = data[i * bytes_per_pixel + 2];
-        green = data[i * bytes_per_pixel + 1];
-        blue  = data[i * bytes_per_pixel + 0];
-        if(image.type == ImageData::PixelType::pt_rgba)
-            alpha = data[i * bytes_per_pixel + 3];
-
-        img[i * bytes_per_pixel + 0] = red;
-        img[i * bytes_per_pixel + 1] = green;
-        img[i * bytes_per_pixel + 2] = blue;
-        if(image.type == ImageData::PixelType::pt_rgba)
-            img[i * bytes_per_pixel + 3] = alpha;
+        uint8_t * row = GetRow(image, i, flip_vertical, row_size);
+        ConvertPixels(image, data + static_cast<size_t>(i) * row_size, row, image.width);
+        if(flip_horizontal)
+            convert::ReversePixels(row, image.width, bytes_per_pixel);
     }
 
-    image.data = std::move(img);
-
     return true;
 }
 
-bool ReadCompressedTGA(ImageData & image, uint8_t * data)
+bool ReadCompressedTGA(ImageData & image, uint8_t const * data, uint8_t const * end, bool flip_horizontal,
+                       bool flip_vertical)
 {
-    uint32_t bytes_per_pixel = image.type == ImageData::PixelType::pt_rgb ? 3 : 4;
-    auto     img             = std::make_unique<uint8_t[]>(image.data_size);
-    uint32_t pixel_count     = image.height * image.width;
-    uint32_t current_pixel   = 0;
-    uint32_t current_byte    = 0;
+    uint32_t const bytes_per_pixel = image.type == ImageData::PixelType::pt_rgb ? 3 : 4;
+    uint32_t const row_size        = image.width * bytes_per_pixel;
+    TGARleDecoder  decoder(image.width, bytes_per_pixel);
 
-    do
+    image.data = std::make_unique<uint8_t[]>(image.data_size);
+    for(uint32_t i = 0; i < image.height; ++i)
     {
-        uint8_t chunk = data[0];
-        data++;
+        uint8_t * row = GetRow(image, i, flip_vertical, row_size);
+        data += decoder.decode(data, static_cast<size_t>(end - data), row);
+        if(!decoder.isRowComplete())   // truncated file
+            return false;
+        decoder.nextRow();
 
-        if(chunk > 128)
-        {
-            chunk -= 127;
-            for(uint16_t counter = 0; counter < chunk; counter++)
-            {
-                img[current_byte + 0] = data[2];
-                img[current_byte + 1] = data[1];
-                img[current_byte + 2] = data[0];
-                if(image.type == ImageData::PixelType::pt_rgba)
-                    img[current_byte + 3] = data[3];
-
-                current_byte += bytes_per_pixel;
-                current_pixel++;
-
-                if(current_pixel > pixel_count)   // Make sure we havent read too many pixels
-                {
-                    return false;
-                }
-            }
-            data += bytes_per_pixel;
-        }
-        else
-        {
-            chunk++;
-            for(uint16_t counter = 0; counter < chunk; counter++)
-            {
-                img[current_byte + 0] = data[2];
-                img[current_byte + 1] = data[1];
-                img[current_byte + 2] = data[0];
-                if(image.type == ImageData::PixelType::pt_rgba)
-                    img[current_byte + 3] = data[3];
-
-                current_byte += bytes_per_pixel;
-                current_pixel++;
-                data += bytes_per_pixel;
-
-                if(current_pixel > pixel_count)   // Make sure we havent read too many pixels
-                {
-                    return false;
-                }
-            }
-        }
-    } while(current_pixel < pixel_count);
+        if(flip_horizontal)
+            convert::ReversePixels(row, image.width, bytes_per_pixel);
+    }
 
-    image.data = std::move(img);
     return true;
 }
 }   // namespace tex
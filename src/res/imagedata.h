@@ -5,6 +5,8 @@
 #include <memory>
 #include <string>
 
+class MappedFile;
+
 namespace tex
 {
 struct ImageData
@@ -14,7 +16,12 @@ struct ImageData
     {
         pt_rgb,
         pt_rgba,
-        pt_compressed,
+        pt_bgr,
+        pt_bgra,
+        pt_dxt1,   // S3TC blocks
+        pt_dxt3,
+        pt_dxt5,
+        pt_compressed,   // other compressed formats, read back from GL
         pt_float,
         pt_none
     };
@@ -23,12 +30,41 @@ struct ImageData
     uint32_t                   height    = 0;
     uint32_t                   depth     = 0;
     uint32_t                   data_size = 0;
+    uint32_t                   num_mips  = 1;   // levels of every face, largest first
+    uint32_t                   num_faces = 1;   // 6 for cube maps, in Texture::CubeFace order
     PixelType                  type      = PixelType::pt_none;
     std::unique_ptr<uint8_t[]> data;
+    // pixels inside a mapped file, used when data is empty
+    uint8_t const *                   view = nullptr;
+    std::shared_ptr<MappedFile const> view_source;   // keeps the mapping alive
+
+    // one mip level of one face, the faces follow each other with their whole mip chains
+    struct Level
+    {
+        uint8_t const * pixels;
+        uint32_t        width;
+        uint32_t        height;
+        uint32_t        size;
+    };
+
+    uint8_t const * pixels() const { return data ? data.get() : view; }
+    bool            isCompressed() const;
+    bool            hasLevels() const { return num_mips > 1 || num_faces > 1; }
+    Level           getLevel(uint32_t face, uint32_t mip) const;   // not for pt_compressed and pt_float
+
+    static uint32_t GetLevelSize(PixelType type, uint32_t width, uint32_t height);
 };
 
-bool ReadBMP(std::string const & file_name, ImageData & id);
-bool ReadTGA(std::string const & file_name, ImageData & id);
+// Files are memory mapped and decoded straight into the image. With allow_view an uncompressed file
+// whose pixels are already in GL order (bottom-up rows, BGR(A), no row padding) isn't decoded at all:
+// the image is a pt_bgr/pt_bgra view of the mapping.
+bool ReadBMP(std::string const & file_name, ImageData & id, bool allow_view = false);
+bool ReadTGA(std::string const & file_name, ImageData & id, bool allow_view = false);
+// DXT1/3/5 (also as DX10 BC1-3) and 24/32 bit RGB files with their mip chains and cube faces. The blocks
+// are kept compressed, only their rows are flipped to the bottom-up order.
+bool ReadDDS(std::string const & file_name, ImageData & id);
+// Picks the reader by the file extension
+bool ReadImage(std::string const & file_name, ImageData & id, bool allow_view = false);
 
 bool WriteTGA(std::string file_name, ImageData const & id);
 }   // namespace tex
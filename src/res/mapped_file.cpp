@@ -0,0 +1,134 @@
+#include "mapped_file.h"
+#include <utility>
+
+#ifdef _WIN32
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile && other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile & MappedFile::operator=(MappedFile && other) noexcept
+{
+    if(this != &other)
+    {
+        close();
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+#ifdef _WIN32
+        std::swap(m_mapping, other.m_mapping);
+#endif
+    }
+
+    return *this;
+}
+
+#ifdef _WIN32
+bool MappedFile::open(std::string const & file_name, Access access)
+{
+    close();
+
+    DWORD const flags = access == Access::SEQUENTIAL ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+    HANDLE      file  = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | flags, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    // the mapping keeps the file open
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if(mapping == nullptr)
+        return false;
+
+    void * view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(view == nullptr)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    m_data    = static_cast<uint8_t const *>(view);
+    m_size    = static_cast<size_t>(file_size.QuadPart);
+    m_mapping = mapping;
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(m_data != nullptr)
+    {
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+    }
+
+    m_data    = nullptr;
+    m_size    = 0;
+    m_mapping = nullptr;
+}
+#else
+bool MappedFile::open(std::string const & file_name, Access access)
+{
+    close();
+
+    int const fd = ::open(file_name.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    auto const size = static_cast<size_t>(st.st_size);
+    void *     addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);   // the mapping keeps the file open
+    if(addr == MAP_FAILED)
+        return false;
+
+    // the advice values aren't flags, one call each
+    if(access == Access::SEQUENTIAL)
+    {
+        madvise(addr, size, MADV_SEQUENTIAL);
+        madvise(addr, size, MADV_WILLNEED);
+    }
+    else
+        madvise(addr, size, MADV_RANDOM);
+
+    m_data = static_cast<uint8_t const *>(addr);
+    m_size = size;
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(m_data != nullptr)
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+
+    m_data = nullptr;
+    m_size = 0;
+}
+#endif
@@ -0,0 +1,46 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//! Read only memory mapping of a whole file
+/*!
+    The pages are read by the OS on first access, straight into the page cache, so a loader decodes
+    from the mapping without a copy into a file buffer. The access hint is passed to madvise.
+*/
+class MappedFile
+{
+public:
+    enum class Access
+    {
+        SEQUENTIAL,   // read once from start to end, read ahead aggressively
+        RANDOM
+    };
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(MappedFile && other) noexcept;
+    MappedFile & operator=(MappedFile && other) noexcept;
+    MappedFile(MappedFile const &)             = delete;
+    MappedFile & operator=(MappedFile const &) = delete;
+
+    //! Fails for missing and empty files
+    bool open(std::string const & file_name, Access access = Access::SEQUENTIAL);
+    void close();
+
+    bool            isOpen() const { return m_data != nullptr; }
+    uint8_t const * data() const { return m_data; }
+    size_t          size() const { return m_size; }
+
+private:
+    uint8_t const * m_data = nullptr;
+    size_t          m_size = 0;
+#ifdef _WIN32
+    void * m_mapping = nullptr;
+#endif
+};
+
+#endif   // MAPPED_FILE_H
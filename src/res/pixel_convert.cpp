@@ -0,0 +1,614 @@
+#include "pixel_convert.h"
+#include "../core/cpu_features.h"
+#include <assert.h>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define PC_USE_SSE
+#endif
+
+#ifdef CPU_X86_DISPATCH
+#    include <immintrin.h>
+#endif
+
+// Kernels convert the pixels [i, count) and return the first unprocessed one. The byte shuffles load
+// whole vectors, so they stop before a load or store would pass the end of the range and leave the
+// tail to the next kernel in the chain.
+namespace
+{
+float const g_u8_to_float = 1.0f / 255.0f;
+
+//==============================================================================
+//         Channel shuffles
+//==============================================================================
+uint32_t SwapRB3Scalar(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count)
+{
+    for(; i < count; ++i)
+    {
+        uint8_t const c0 = src[i * 3 + 0];
+        uint8_t const c2 = src[i * 3 + 2];
+        dst[i * 3 + 0]   = c2;
+        dst[i * 3 + 1]   = src[i * 3 + 1];
+        dst[i * 3 + 2]   = c0;
+    }
+
+    return i;
+}
+
+// order[k] is the source byte of destination byte k
+uint32_t Shuffle4Scalar(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count, int const order[4])
+{
+    for(; i < count; ++i)
+    {
+        uint8_t const px[4] = {src[i * 4 + 0], src[i * 4 + 1], src[i * 4 + 2], src[i * 4 + 3]};
+        for(int k = 0; k < 4; ++k)
+            dst[i * 4 + k] = px[order[k]];
+    }
+
+    return i;
+}
+
+uint32_t RGBToRGBAScalar(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count, uint8_t alpha)
+{
+    for(; i < count; ++i)
+    {
+        dst[i * 4 + 0] = src[i * 3 + 0];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = alpha;
+    }
+
+    return i;
+}
+
+#ifdef CPU_X86_DISPATCH
+// 5 pixels per 16 byte load, the last byte is written back unchanged
+CPU_TARGET_SSSE3 uint32_t SwapRB3SSSE3(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count)
+{
+    __m128i const mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    for(; i * 3 + 16 <= count * 3; i += 5)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 3), _mm_shuffle_epi8(v, mask));
+    }
+
+    return i;
+}
+
+// 8 pixels per 32 byte load: the upper lane is moved to start at byte 12 so no pixel crosses a lane,
+// swizzled, moved back and the last 8 bytes are written back unchanged
+CPU_TARGET_AVX2 uint32_t SwapRB3AVX2(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count)
+{
+    __m256i const spread  = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    __m256i const compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    __m256i const mask    = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15,   //
+                                             2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+    for(; i * 3 + 32 <= count * 3; i += 8)
+    {
+        __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i * 3));
+        __m256i const s = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, spread), mask);
+        __m256i const r = _mm256_blend_epi32(_mm256_permutevar8x32_epi32(s, compact), v, 0x80);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 3), r);
+    }
+
+    return i;
+}
+
+CPU_TARGET_SSSE3 uint32_t Shuffle4SSSE3(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count,
+                                        int const order[4])
+{
+    int const     pixel  = order[0] | order[1] << 8 | order[2] << 16 | order[3] << 24;
+    __m128i const offset = _mm_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+    __m128i const mask   = _mm_add_epi8(_mm_set1_epi32(pixel), offset);
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_shuffle_epi8(v, mask));
+    }
+
+    return i;
+}
+
+CPU_TARGET_AVX2 uint32_t Shuffle4AVX2(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count,
+                                      int const order[4])
+{
+    int const     pixel = order[0] | order[1] << 8 | order[2] << 16 | order[3] << 24;
+    __m256i const mask  =
+        _mm256_add_epi8(_mm256_set1_epi32(pixel),
+                        _mm256_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12,   //
+                                         0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12));
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_shuffle_epi8(v, mask));
+    }
+
+    return i;
+}
+
+CPU_TARGET_SSSE3 uint32_t RGBToRGBASSSE3(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count,
+                                         uint8_t alpha)
+{
+    __m128i const mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m128i const a    = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(alpha) << 24));
+    for(; i * 3 + 16 <= count * 3; i += 4)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 3));
+        __m128i const s = _mm_or_si128(_mm_shuffle_epi8(v, mask), a);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), s);
+    }
+
+    return i;
+}
+
+CPU_TARGET_AVX2 uint32_t RGBToRGBAAVX2(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count,
+                                       uint8_t alpha)
+{
+    __m256i const spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    __m256i const mask   = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,   //
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m256i const a      = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(alpha) << 24));
+    for(; i * 3 + 32 <= count * 3; i += 8)
+    {
+        __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i * 3));
+        __m256i const s = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, spread), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_or_si256(s, a));
+    }
+
+    return i;
+}
+#endif   // CPU_X86_DISPATCH
+
+void Shuffle4(uint8_t const * src, uint8_t * dst, uint32_t count, int const order[4])
+{
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    CpuFeatures const & cpu = GetCpuFeatures();
+    if(cpu.avx2)
+        i = Shuffle4AVX2(src, dst, i, count, order);
+    if(cpu.ssse3)
+        i = Shuffle4SSSE3(src, dst, i, count, order);
+#endif
+    Shuffle4Scalar(src, dst, i, count, order);
+}
+
+//==============================================================================
+//         Fills
+//==============================================================================
+uint32_t FillScalar(uint8_t * dst, uint8_t const * pixel, uint32_t i, uint32_t count,
+                    uint32_t bytes_per_pixel)
+{
+    for(; i < count; ++i)
+        std::memcpy(dst + i * bytes_per_pixel, pixel, bytes_per_pixel);
+
+    return i;
+}
+
+#ifdef PC_USE_SSE
+uint32_t Fill4SSE(uint8_t * dst, uint8_t const * pixel, uint32_t i, uint32_t count)
+{
+    int32_t value;
+    std::memcpy(&value, pixel, 4);
+    __m128i const v = _mm_set1_epi32(value);
+    for(; i + 4 <= count; i += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), v);
+
+    return i;
+}
+
+// 16 pixels of 3 bytes are 3 whole vectors
+uint32_t Fill3SSE(uint8_t * dst, uint8_t const * pixel, uint32_t i, uint32_t count)
+{
+    if(count - i < 16)
+        return i;
+
+    uint8_t pattern[48];
+    for(uint32_t k = 0; k < 16; ++k)
+        std::memcpy(pattern + k * 3, pixel, 3);
+
+    __m128i const v0 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(pattern));
+    __m128i const v1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(pattern + 16));
+    __m128i const v2 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(pattern + 32));
+    for(; i + 16 <= count; i += 16)
+    {
+        auto * p = reinterpret_cast<__m128i *>(dst + i * 3);
+        _mm_storeu_si128(p, v0);
+        _mm_storeu_si128(p + 1, v1);
+        _mm_storeu_si128(p + 2, v2);
+    }
+
+    return i;
+}
+#endif   // PC_USE_SSE
+
+#ifdef CPU_X86_DISPATCH
+CPU_TARGET_AVX2 uint32_t Fill4AVX2(uint8_t * dst, uint8_t const * pixel, uint32_t i, uint32_t count)
+{
+    int32_t value;
+    std::memcpy(&value, pixel, 4);
+    __m256i const v = _mm256_set1_epi32(value);
+    for(; i + 8 <= count; i += 8)
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), v);
+
+    return i;
+}
+#endif   // CPU_X86_DISPATCH
+
+//==============================================================================
+//         Row reversal
+//==============================================================================
+// Pixels are swapped from both ends: [0, i) and [count - i, count) are done
+uint32_t ReverseScalar(uint8_t * row, uint32_t i, uint32_t count, uint32_t bytes_per_pixel)
+{
+    for(; i < count / 2; ++i)
+    {
+        uint8_t * l = row + i * bytes_per_pixel;
+        uint8_t * r = row + (count - 1 - i) * bytes_per_pixel;
+        for(uint32_t c = 0; c < bytes_per_pixel; ++c)
+            std::swap(l[c], r[c]);
+    }
+
+    return i;
+}
+
+#ifdef PC_USE_SSE
+uint32_t Reverse4SSE(uint8_t * row, uint32_t i, uint32_t count)
+{
+    for(; count - 2 * i >= 8; i += 4)
+    {
+        auto *        l = reinterpret_cast<__m128i *>(row + i * 4);
+        auto *        r = reinterpret_cast<__m128i *>(row + (count - i - 4) * 4);
+        __m128i const a = _mm_loadu_si128(l);
+        __m128i const b = _mm_loadu_si128(r);
+        _mm_storeu_si128(l, _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3)));
+        _mm_storeu_si128(r, _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+
+    return i;
+}
+#endif   // PC_USE_SSE
+
+#ifdef CPU_X86_DISPATCH
+CPU_TARGET_AVX2 uint32_t Reverse4AVX2(uint8_t * row, uint32_t i, uint32_t count)
+{
+    __m256i const reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    for(; count - 2 * i >= 16; i += 8)
+    {
+        auto *        l = reinterpret_cast<__m256i *>(row + i * 4);
+        auto *        r = reinterpret_cast<__m256i *>(row + (count - i - 8) * 4);
+        __m256i const a = _mm256_loadu_si256(l);
+        __m256i const b = _mm256_loadu_si256(r);
+        _mm256_storeu_si256(l, _mm256_permutevar8x32_epi32(b, reverse));
+        _mm256_storeu_si256(r, _mm256_permutevar8x32_epi32(a, reverse));
+    }
+
+    return i;
+}
+
+// 5 pixels from each end per step. The left load has a spare byte after its pixels and the right one
+// before them, both are written back unchanged; the loads must not overlap.
+CPU_TARGET_SSSE3 uint32_t Reverse3SSSE3(uint8_t * row, uint32_t i, uint32_t count)
+{
+    // the left pixels go to bytes 1..15 of the right store, the right ones to bytes 0..14 of the left one
+    __m128i const to_right = _mm_setr_epi8(-1, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2);
+    __m128i const to_left  = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, -1);
+    __m128i const first    = _mm_setr_epi8(-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i const last     = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1);
+    for(; 3 * (count - 2 * i) >= 32; i += 5)
+    {
+        auto *        l = reinterpret_cast<__m128i *>(row + i * 3);
+        auto *        r = reinterpret_cast<__m128i *>(row + (count - i) * 3 - 16);
+        __m128i const a = _mm_loadu_si128(l);
+        __m128i const b = _mm_loadu_si128(r);
+        _mm_storeu_si128(l, _mm_or_si128(_mm_shuffle_epi8(b, to_left), _mm_and_si128(a, last)));
+        _mm_storeu_si128(r, _mm_or_si128(_mm_shuffle_epi8(a, to_right), _mm_and_si128(b, first)));
+    }
+
+    return i;
+}
+#endif   // CPU_X86_DISPATCH
+
+//==============================================================================
+//         Alpha premultiplication
+//==============================================================================
+// c * a / 255 rounded: t = c * a + 128, (t + (t >> 8)) >> 8
+uint8_t MulDiv255(uint32_t c, uint32_t a)
+{
+    uint32_t const t = c * a + 128;
+    return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+uint32_t PremultiplyScalar(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count)
+{
+    for(; i < count; ++i)
+    {
+        uint8_t const a = src[i * 4 + 3];
+        dst[i * 4 + 0]  = MulDiv255(src[i * 4 + 0], a);
+        dst[i * 4 + 1]  = MulDiv255(src[i * 4 + 1], a);
+        dst[i * 4 + 2]  = MulDiv255(src[i * 4 + 2], a);
+        dst[i * 4 + 3]  = a;
+    }
+
+    return i;
+}
+
+#ifdef PC_USE_SSE
+// 8 x 16 bit channels of 2 pixels, the alpha channel is multiplied by 255 so it stays the same
+__m128i PremultiplyPixels(__m128i px)
+{
+    __m128i const rgb_mask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    __m128i const a255     = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+    __m128i const half     = _mm_set1_epi16(128);
+
+    __m128i a = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    a         = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    a         = _mm_or_si128(_mm_and_si128(a, rgb_mask), a255);
+
+    __m128i const t = _mm_add_epi16(_mm_mullo_epi16(px, a), half);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+uint32_t PremultiplySSE(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count)
+{
+    __m128i const zero = _mm_setzero_si128();
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i const v  = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 4));
+        __m128i const lo = PremultiplyPixels(_mm_unpacklo_epi8(v, zero));
+        __m128i const hi = PremultiplyPixels(_mm_unpackhi_epi8(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+
+    return i;
+}
+#endif   // PC_USE_SSE
+
+#ifdef CPU_X86_DISPATCH
+CPU_TARGET_AVX2 __m256i PremultiplyPixelsAVX2(__m256i px)
+{
+    __m256i const alpha = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1,   //
+                                           6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1);
+    __m256i const a255  = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+    __m256i const half  = _mm256_set1_epi16(128);
+
+    __m256i const a = _mm256_or_si256(_mm256_shuffle_epi8(px, alpha), a255);
+    __m256i const t = _mm256_add_epi16(_mm256_mullo_epi16(px, a), half);
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// unpack and pack both work per lane, so the pixels come out in their order
+CPU_TARGET_AVX2 uint32_t PremultiplyAVX2(uint8_t const * src, uint8_t * dst, uint32_t i, uint32_t count)
+{
+    __m256i const zero = _mm256_setzero_si256();
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i const v  = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i * 4));
+        __m256i const lo = PremultiplyPixelsAVX2(_mm256_unpacklo_epi8(v, zero));
+        __m256i const hi = PremultiplyPixelsAVX2(_mm256_unpackhi_epi8(v, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+
+    return i;
+}
+#endif   // CPU_X86_DISPATCH
+
+//==============================================================================
+//         u8 <-> float
+//==============================================================================
+uint32_t U8ToFloatScalar(uint8_t const * src, float * dst, uint32_t i, uint32_t count)
+{
+    for(; i < count; ++i)
+        dst[i] = static_cast<float>(src[i]) * g_u8_to_float;
+
+    return i;
+}
+
+uint32_t FloatToU8Scalar(float const * src, uint8_t * dst, uint32_t i, uint32_t count)
+{
+    for(; i < count; ++i)
+    {
+        float const c = src[i] > 0.0f ? (src[i] < 1.0f ? src[i] : 1.0f) : 0.0f;
+        dst[i]        = static_cast<uint8_t>(std::lrint(c * 255.0f));
+    }
+
+    return i;
+}
+
+#ifdef PC_USE_SSE
+uint32_t U8ToFloatSSE(uint8_t const * src, float * dst, uint32_t i, uint32_t count)
+{
+    __m128i const zero  = _mm_setzero_si128();
+    __m128 const  scale = _mm_set1_ps(g_u8_to_float);
+    for(; i + 16 <= count; i += 16)
+    {
+        __m128i const v    = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+        __m128i const lo   = _mm_unpacklo_epi8(v, zero);
+        __m128i const hi   = _mm_unpackhi_epi8(v, zero);
+        __m128i const w[4] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                              _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+        for(int k = 0; k < 4; ++k)
+            _mm_storeu_ps(dst + i + k * 4, _mm_mul_ps(_mm_cvtepi32_ps(w[k]), scale));
+    }
+
+    return i;
+}
+
+// cvtps rounds to nearest even like lrint in the default rounding mode, max(x, 0) turns NaN to 0
+uint32_t FloatToU8SSE(float const * src, uint8_t * dst, uint32_t i, uint32_t count)
+{
+    __m128 const zero  = _mm_setzero_ps();
+    __m128 const one   = _mm_set1_ps(1.0f);
+    __m128 const scale = _mm_set1_ps(255.0f);
+    for(; i + 16 <= count; i += 16)
+    {
+        __m128i w[4];
+        for(int k = 0; k < 4; ++k)
+        {
+            __m128 const c = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + k * 4), zero), one);
+            w[k]           = _mm_cvtps_epi32(_mm_mul_ps(c, scale));
+        }
+        __m128i const packed = _mm_packus_epi16(_mm_packs_epi32(w[0], w[1]), _mm_packs_epi32(w[2], w[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+    }
+
+    return i;
+}
+#endif   // PC_USE_SSE
+
+#ifdef CPU_X86_DISPATCH
+CPU_TARGET_AVX2 uint32_t U8ToFloatAVX2(uint8_t const * src, float * dst, uint32_t i, uint32_t count)
+{
+    __m256 const scale = _mm256_set1_ps(g_u8_to_float);
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i const v = _mm_loadl_epi64(reinterpret_cast<__m128i const *>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), scale));
+    }
+
+    return i;
+}
+
+CPU_TARGET_AVX2 uint32_t FloatToU8AVX2(float const * src, uint8_t * dst, uint32_t i, uint32_t count)
+{
+    __m256 const  zero  = _mm256_setzero_ps();
+    __m256 const  one   = _mm256_set1_ps(1.0f);
+    __m256 const  scale = _mm256_set1_ps(255.0f);
+    __m256i const order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);   // undoes the per lane packing
+    for(; i + 32 <= count; i += 32)
+    {
+        __m256i w[4];
+        for(int k = 0; k < 4; ++k)
+        {
+            __m256 const c = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + k * 8), zero), one);
+            w[k]           = _mm256_cvtps_epi32(_mm256_mul_ps(c, scale));
+        }
+        __m256i const packed =
+            _mm256_packus_epi16(_mm256_packs_epi32(w[0], w[1]), _mm256_packs_epi32(w[2], w[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                            _mm256_permutevar8x32_epi32(packed, order));
+    }
+
+    return i;
+}
+#endif   // CPU_X86_DISPATCH
+}   // namespace
+
+namespace tex::convert
+{
+void BGRToRGB(uint8_t const * src, uint8_t * dst, uint32_t num_pixels)
+{
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    CpuFeatures const & cpu = GetCpuFeatures();
+    if(cpu.avx2)
+        i = SwapRB3AVX2(src, dst, i, num_pixels);
+    if(cpu.ssse3)
+        i = SwapRB3SSSE3(src, dst, i, num_pixels);
+#endif
+    SwapRB3Scalar(src, dst, i, num_pixels);
+}
+
+void BGRAToRGBA(uint8_t const * src, uint8_t * dst, uint32_t num_pixels)
+{
+    int const order[4] = {2, 1, 0, 3};
+    Shuffle4(src, dst, num_pixels, order);
+}
+
+void ABGRToRGBA(uint8_t const * src, uint8_t * dst, uint32_t num_pixels)
+{
+    int const order[4] = {3, 2, 1, 0};
+    Shuffle4(src, dst, num_pixels, order);
+}
+
+void RGBToRGBA(uint8_t const * src, uint8_t * dst, uint32_t num_pixels, uint8_t alpha)
+{
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    CpuFeatures const & cpu = GetCpuFeatures();
+    if(cpu.avx2)
+        i = RGBToRGBAAVX2(src, dst, i, num_pixels, alpha);
+    if(cpu.ssse3)
+        i = RGBToRGBASSSE3(src, dst, i, num_pixels, alpha);
+#endif
+    RGBToRGBAScalar(src, dst, i, num_pixels, alpha);
+}
+
+void FillPixels(uint8_t * dst, uint8_t const * pixel, uint32_t num_pixels, uint32_t bytes_per_pixel)
+{
+    assert(bytes_per_pixel == 3 || bytes_per_pixel == 4);
+
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    if(bytes_per_pixel == 4 && GetCpuFeatures().avx2)
+        i = Fill4AVX2(dst, pixel, i, num_pixels);
+#endif
+#ifdef PC_USE_SSE
+    if(bytes_per_pixel == 4)
+        i = Fill4SSE(dst, pixel, i, num_pixels);
+    else
+        i = Fill3SSE(dst, pixel, i, num_pixels);
+#endif
+    FillScalar(dst, pixel, i, num_pixels, bytes_per_pixel);
+}
+
+void ReversePixels(uint8_t * row, uint32_t num_pixels, uint32_t bytes_per_pixel)
+{
+    assert(bytes_per_pixel == 3 || bytes_per_pixel == 4);
+
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    CpuFeatures const & cpu = GetCpuFeatures();
+    if(bytes_per_pixel == 4 && cpu.avx2)
+        i = Reverse4AVX2(row, i, num_pixels);
+    if(bytes_per_pixel == 3 && cpu.ssse3)
+        i = Reverse3SSSE3(row, i, num_pixels);
+#endif
+#ifdef PC_USE_SSE
+    if(bytes_per_pixel == 4)
+        i = Reverse4SSE(row, i, num_pixels);
+#endif
+    ReverseScalar(row, i, num_pixels, bytes_per_pixel);
+}
+
+void PremultiplyAlpha(uint8_t const * src, uint8_t * dst, uint32_t num_pixels)
+{
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    if(GetCpuFeatures().avx2)
+        i = PremultiplyAVX2(src, dst, i, num_pixels);
+#endif
+#ifdef PC_USE_SSE
+    i = PremultiplySSE(src, dst, i, num_pixels);
+#endif
+    PremultiplyScalar(src, dst, i, num_pixels);
+}
+
+void U8ToFloat(uint8_t const * src, float * dst, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    if(GetCpuFeatures().avx2)
+        i = U8ToFloatAVX2(src, dst, i, count);
+#endif
+#ifdef PC_USE_SSE
+    i = U8ToFloatSSE(src, dst, i, count);
+#endif
+    U8ToFloatScalar(src, dst, i, count);
+}
+
+void FloatToU8(float const * src, uint8_t * dst, uint32_t count)
+{
+    uint32_t i = 0;
+#ifdef CPU_X86_DISPATCH
+    if(GetCpuFeatures().avx2)
+        i = FloatToU8AVX2(src, dst, i, count);
+#endif
+#ifdef PC_USE_SSE
+    i = FloatToU8SSE(src, dst, i, count);
+#endif
+    FloatToU8Scalar(src, dst, i, count);
+}
+}   // namespace tex::convert
@@ -0,0 +1,34 @@
+#ifndef PIXEL_CONVERT_H
+#define PIXEL_CONVERT_H
+
+#include <cstdint>
+
+// Pixel format conversions for the image loaders and writers.
+// The kernels are selected at run time (AVX2, SSSE3/SSE2, scalar) and give the same result on every
+// path. Conversions between formats of the same pixel size work in place (src == dst), other ranges
+// must not overlap.
+namespace tex::convert
+{
+// Swaps the first and the third channel, so they also convert RGB(A) to BGR(A)
+void BGRToRGB(uint8_t const * src, uint8_t * dst, uint32_t num_pixels);
+void BGRAToRGBA(uint8_t const * src, uint8_t * dst, uint32_t num_pixels);
+void ABGRToRGBA(uint8_t const * src, uint8_t * dst, uint32_t num_pixels);   // reverses the 4 bytes
+
+void RGBToRGBA(uint8_t const * src, uint8_t * dst, uint32_t num_pixels, uint8_t alpha = 255);
+
+//! Repeats one pixel of 3 or 4 bytes
+void FillPixels(uint8_t * dst, uint8_t const * pixel, uint32_t num_pixels, uint32_t bytes_per_pixel);
+
+//! Mirrors a row in place, 3 or 4 bytes per pixel
+void ReversePixels(uint8_t * row, uint32_t num_pixels, uint32_t bytes_per_pixel);
+
+//! c = c * a / 255, rounded to nearest, alpha is kept
+void PremultiplyAlpha(uint8_t const * src, uint8_t * dst, uint32_t num_pixels);
+
+//! [0, 255] -> [0, 1]
+void U8ToFloat(uint8_t const * src, float * dst, uint32_t count);
+//! Clamped to [0, 1] (NaN gives 0) and rounded to nearest even
+void FloatToU8(float const * src, uint8_t * dst, uint32_t count);
+}   // namespace tex::convert
+
+#endif   // PIXEL_CONVERT_H
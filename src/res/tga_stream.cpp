@@ -0,0 +1,216 @@
+#include "tga_stream.h"
+#include "pixel_convert.h"
+#include <assert.h>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+size_t const g_header_size = 18;
+
+uint32_t ReadU16(uint8_t const * p)
+{
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8;
+}
+
+// TGA stores BGR(A)
+void ConvertPixels(uint8_t const * src, uint8_t * dst, uint32_t num_pixels, uint32_t bytes_per_pixel)
+{
+    if(bytes_per_pixel == 3)
+        tex::convert::BGRToRGB(src, dst, num_pixels);
+    else
+        tex::convert::BGRAToRGBA(src, dst, num_pixels);
+}
+}   // namespace
+
+namespace tex
+{
+//==============================================================================
+//         RLE decoder
+//==============================================================================
+TGARleDecoder::TGARleDecoder(uint32_t width, uint32_t bytes_per_pixel)
+    : m_width(width),
+      m_bytes_per_pixel(bytes_per_pixel)
+{
+    assert(bytes_per_pixel == 3 || bytes_per_pixel == 4);
+}
+
+size_t TGARleDecoder::decode(uint8_t const * data, size_t size, uint8_t * row)
+{
+    size_t used = 0;
+    while(m_x < m_width)
+    {
+        if(m_remaining == 0)
+        {
+            if(used == size)
+                break;
+
+            uint8_t const header = data[used];
+            bool const    run    = header >= 128;   // high bit set
+            if(run && size - used < 1 + m_bytes_per_pixel)
+                break;
+
+            ++used;
+            m_run       = run;
+            m_remaining = (header & 0x7Fu) + 1;
+            if(run)
+            {
+                ConvertPixels(data + used, m_run_pixel, 1, m_bytes_per_pixel);
+                used += m_bytes_per_pixel;
+            }
+        }
+
+        uint32_t  n   = std::min(m_remaining, m_width - m_x);
+        uint8_t * dst = row + m_x * m_bytes_per_pixel;
+        if(m_run)
+            convert::FillPixels(dst, m_run_pixel, n, m_bytes_per_pixel);
+        else
+        {
+            n = static_cast<uint32_t>(std::min<size_t>(n, (size - used) / m_bytes_per_pixel));
+            if(n == 0)
+                break;
+
+            ConvertPixels(data + used, dst, n, m_bytes_per_pixel);
+            used += n * m_bytes_per_pixel;
+        }
+
+        m_x += n;
+        m_remaining -= n;
+    }
+
+    return used;
+}
+
+//==============================================================================
+//         Stream reader
+//==============================================================================
+bool TGAStreamReader::open(std::string const & file_name)
+{
+    close();
+
+    m_file.open(file_name, std::ios::binary);
+    if(!m_file.is_open())
+        return false;
+
+    uint8_t header[g_header_size];
+    if(!m_file.read(reinterpret_cast<char *>(header), g_header_size))
+        return false;
+
+    uint8_t const id_length       = header[0];
+    uint8_t const colour_map_type = header[1];
+    uint8_t const data_type       = header[2];
+    uint32_t const colour_map_size =
+        colour_map_type != 0 ? ReadU16(header + 5) * ((header[7] + 7u) / 8u) : 0;
+
+    m_width           = ReadU16(header + 12);
+    m_height          = ReadU16(header + 14);
+    m_bytes_per_pixel = header[16] / 8u;
+    m_rle             = data_type == 10;
+    m_flip_horizontal = (header[17] & 0x10) != 0;
+    m_flip_vertical   = (header[17] & 0x20) != 0;
+
+    if(m_width == 0 || m_height == 0 || (header[16] != 24 && header[16] != 32)
+       || (data_type != 2 && data_type != 10))
+    {
+        close();
+        return false;
+    }
+
+    m_file.seekg(static_cast<std::streamoff>(id_length + colour_map_size), std::ios_base::cur);
+    m_chunk.resize(chunk_size);
+
+    return !m_file.fail();
+}
+
+void TGAStreamReader::close()
+{
+    if(m_file.is_open())
+        m_file.close();
+    m_file.clear();
+
+    m_chunk.clear();
+    m_chunk.shrink_to_fit();
+    m_begin           = 0;
+    m_end             = 0;
+    m_width           = 0;
+    m_height          = 0;
+    m_bytes_per_pixel = 0;
+}
+
+ImageData::PixelType TGAStreamReader::getType() const
+{
+    if(m_bytes_per_pixel == 0)
+        return ImageData::PixelType::pt_none;
+
+    return m_bytes_per_pixel == 3 ? ImageData::PixelType::pt_rgb : ImageData::PixelType::pt_rgba;
+}
+
+bool TGAStreamReader::refill()
+{
+    size_t const left = m_end - m_begin;
+    std::memmove(m_chunk.data(), m_chunk.data() + m_begin, left);
+    m_begin = 0;
+    m_end   = left;
+
+    m_file.read(reinterpret_cast<char *>(m_chunk.data() + m_end),
+                static_cast<std::streamsize>(chunk_size - m_end));
+    auto const count = static_cast<size_t>(m_file.gcount());
+    m_end += count;
+
+    return count > 0;
+}
+
+bool TGAStreamReader::read(RowSink const & sink)
+{
+    assert(m_file.is_open());
+
+    size_t const         row_size = static_cast<size_t>(m_width) * m_bytes_per_pixel;
+    std::vector<uint8_t> row(row_size);
+    TGARleDecoder        decoder(m_width, m_bytes_per_pixel);
+
+    for(uint32_t y = 0; y < m_height; ++y)
+    {
+        if(m_rle)
+        {
+            for(;;)
+            {
+                m_begin += decoder.decode(m_chunk.data() + m_begin, m_end - m_begin, row.data());
+                if(decoder.isRowComplete())
+                    break;
+                if(!refill())
+                    return false;
+            }
+            decoder.nextRow();
+        }
+        else if(m_end - m_begin >= row_size)
+        {
+            ConvertPixels(m_chunk.data() + m_begin, row.data(), m_width, m_bytes_per_pixel);
+            m_begin += row_size;
+        }
+        else
+        {
+            // the row crosses the chunk end, gather it and convert in place
+            for(size_t filled = 0; filled < row_size;)
+            {
+                if(m_begin == m_end && !refill())
+                    return false;
+
+                size_t const n = std::min(row_size - filled, m_end - m_begin);
+                std::memcpy(row.data() + filled, m_chunk.data() + m_begin, n);
+                filled += n;
+                m_begin += n;
+            }
+            ConvertPixels(row.data(), row.data(), m_width, m_bytes_per_pixel);
+        }
+
+        if(m_flip_horizontal)
+            convert::ReversePixels(row.data(), m_width, m_bytes_per_pixel);
+
+        uint32_t const image_row = m_flip_vertical ? m_height - 1 - y : y;
+        if(!sink(image_row, row.data()))
+            return false;
+    }
+
+    return true;
+}
+}   // namespace tex
@@ -0,0 +1,82 @@
+#ifndef TGA_STREAM_H
+#define TGA_STREAM_H
+
+#include "imagedata.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace tex
+{
+//! Receives the decoded RGB(A) rows, row is the index in the bottom-up image; false stops decoding
+using RowSink = std::function<bool(uint32_t row, uint8_t const * pixels)>;
+
+//! Incremental decoder of TGA RLE packets (data type 10)
+/*!
+    The input may be split anywhere, the decoder keeps the packet that crosses a row or an input
+    boundary. Runs are converted once and expanded with vector fills, raw packets are converted
+    straight into the row.
+*/
+class TGARleDecoder
+{
+public:
+    TGARleDecoder(uint32_t width, uint32_t bytes_per_pixel);
+
+    /*! Continues the row, returns the number of input bytes used. Stops when the row is full or
+        the input ends; a packet header with its run pixel is only taken whole, so up to
+        bytes_per_pixel bytes may be left for the next call.
+    */
+    size_t decode(uint8_t const * data, size_t size, uint8_t * row);
+    bool   isRowComplete() const { return m_x == m_width; }
+    void   nextRow() { m_x = 0; }
+
+private:
+    uint32_t const m_width;
+    uint32_t const m_bytes_per_pixel;
+    uint32_t       m_x         = 0;   // next pixel of the row
+    uint32_t       m_remaining = 0;   // pixels left in the current packet
+    bool           m_run       = false;
+    uint8_t        m_run_pixel[4];
+};
+
+//! Bounded memory TGA reader
+/*!
+    The file is read in chunk_size pieces and the image is handed to a RowSink one row at a time,
+    only a chunk and a row are held in memory. Rows come in file order, so top-down files give the
+    rows top to bottom.
+*/
+class TGAStreamReader
+{
+public:
+    constexpr static size_t chunk_size = 64 * 1024;
+
+    //! Reads the header, uncompressed and RLE 24/32 bit files are supported
+    bool open(std::string const & file_name);
+    void close();
+    bool read(RowSink const & sink);
+
+    uint32_t             getWidth() const { return m_width; }
+    uint32_t             getHeight() const { return m_height; }
+    uint32_t             getBytesPerPixel() const { return m_bytes_per_pixel; }
+    ImageData::PixelType getType() const;
+
+private:
+    std::ifstream        m_file;
+    std::vector<uint8_t> m_chunk;
+    size_t               m_begin           = 0;   // unread part of the chunk
+    size_t               m_end             = 0;
+    uint32_t             m_width           = 0;
+    uint32_t             m_height          = 0;
+    uint32_t             m_bytes_per_pixel = 0;
+    bool                 m_rle             = false;
+    bool                 m_flip_horizontal = false;
+    bool                 m_flip_vertical   = false;
+
+    bool refill();   // keeps the unread bytes, false at the end of the file
+};
+}   // namespace tex
+
+#endif   // TGA_STREAM_H
@@ -1,9 +1,13 @@
 #include "window.h"
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
+#include <assert.h>
+#include <algorithm>
 #include <stdexcept>
 
 #include "render/renderer.h"
+#include "render/texture_loader.h"
+#include "core/job_system.h"
 #include "input/inputglfw.h"
 #include "scene_data.h"
 
@@ -16,10 +20,19 @@ constexpr char const *                marble_tex_fname  = "marble.tga";
 constexpr std::array<char const *, 6> cube_map_names    = {
     {"cm_left.tga", "cm_right.tga", "cm_top.tga", "cm_bottom.tga", "cm_back.tga", "cm_front.tga"}
 };
+
+constexpr uint32_t g_num_satellites   = 12;
+constexpr float    g_satellite_orbit  = 2.2f;
+constexpr float    g_satellite_height = 1.3f;
+constexpr float    g_satellite_scale  = 0.15f;
 }   // namespace
 
 Window::Window(int width, int height, char const * title) :
-    m_size{width, height}, m_title{title}, m_pyramid{VertexBuffer::pos_norm_tex, 2}
+    m_size{width, height},
+    m_title{title},
+    m_pyramid{VertexBuffer::pos_norm_tex, 2},
+    m_shadow_casters{VertexBuffer::pos, 0},
+    m_texture_streamer{m_uploads, &m_pixel_ring}
 {
     // Initialise GLFW
     if(!glfwInit())
@@ -145,8 +158,15 @@ Window::~Window()
     // Cleanup VBO and textures
     if(mp_glfw_win && m_render_ptr->isInit())
     {
+        m_occlusion_queries.release(*m_render_ptr);
+        m_texture_streamer.stop(*m_render_ptr);
+        m_uploads.clear(*m_render_ptr);
+        m_pixel_ring.release(*m_render_ptr);
+        m_readbacks.release(*m_render_ptr);
+
         m_render_ptr->unloadBuffer(m_pyramid);
         m_render_ptr->deleteBuffer(m_pyramid);
+        m_render_ptr->deleteBuffer(m_typed_pyramid);
 
         m_render_ptr->unloadBuffer(m_plane);
         m_render_ptr->deleteBuffer(m_plane);
@@ -154,10 +174,16 @@ Window::~Window()
         m_render_ptr->unloadBuffer(m_sphere);
         m_render_ptr->deleteBuffer(m_sphere);
 
+        m_render_ptr->unloadBuffer(m_shadow_casters.getVertexBuffer());
+        m_render_ptr->deleteBuffer(m_shadow_casters.getVertexBuffer());
+
+        m_satellites.terminate(*m_render_ptr);
+
         m_render_ptr->destroyTexture(m_render_texture);
         m_render_ptr->destroyTexture(m_base_texture);
         m_render_ptr->destroyTexture(m_second_texture);
-        m_render_ptr->destroyTexture(m_marble_texture);
+        if(m_marble_texture.m_render_id != 0)   // streamed, may not have arrived
+            m_render_ptr->destroyTexture(m_marble_texture);
         m_render_ptr->destroyTexture(m_decal_texture);
         m_render_ptr->destroyTexture(m_shadow_texture);
         m_render_ptr->destroyTexture(m_reflection_texture);
@@ -195,7 +221,10 @@ void Window::createWindow()
     GLFWwindow * new_window{nullptr};
     new_window = glfwCreateWindow(m_vp_size.x, m_vp_size.y, "", mon, mp_glfw_win);
     if(mp_glfw_win != nullptr)
+    {
         glfwDestroyWindow(mp_glfw_win);
+        m_occlusion_queries.reset();   // query objects aren't shared between contexts
+    }
 
     mp_glfw_win = new_window;
     if(mp_glfw_win == nullptr)
@@ -238,33 +267,248 @@ void Window::initScene()
     m_pyramid.pushBack(pyr_vertex_buffer_data, {pyr_tex_buffer_data0, pyr_tex_buffer_data1},
                        pyr_normal_buffer_data, sizeof(pyr_vertex_buffer_data) / (sizeof(float) * 3),
                        pyr_index_buffer_data, sizeof(pyr_index_buffer_data) / sizeof(unsigned int));
+    m_pyramid.weld();
+    m_typed_pyramid.assign(m_pyramid);
+    m_render_ptr->uploadBuffer(m_typed_pyramid);
     m_render_ptr->uploadBuffer(m_pyramid);
 
     m_plane.pushBack(plane_vertex_buffer_data, {plane_tex_buffer_data}, plane_normal_buffer_data,
                      sizeof(plane_vertex_buffer_data) / (sizeof(float) * 3), plane_index_buffer_data,
                      sizeof(plane_index_buffer_data) / sizeof(unsigned int));
+    m_plane.weld();
     m_render_ptr->uploadBuffer(m_plane);
 
     m_sphere.pushBack(sphere_vertex_buffer_data, {sphere_tex_buffer_data}, sphere_normal_buffer_data,
                       sizeof(sphere_vertex_buffer_data) / (sizeof(float) * 3), sphere_index_buffer_data,
                       sizeof(sphere_index_buffer_data) / sizeof(unsigned int));
-    m_render_ptr->uploadBuffer(m_sphere);
+    m_sphere.weld();
+    // the biggest mesh goes up within the per frame budget, the first frames cull it
+    m_uploads.queueBuffer(m_sphere, [this] { m_sphere_uploaded = true; });
+
+    // the shadow pass needs positions only, so all static meshes share one buffer and one draw call
+    m_shadow_casters.addMesh(m_plane, glm::mat4(1.0f));
+    m_shadow_casters.addMesh(m_pyramid, glm::mat4(1.0f));
+    m_shadow_casters.addMesh(m_sphere, glm::mat4(1.0f));
+    m_shadow_casters.bake();
+    m_shadow_casters.getVertexBuffer().setRetention(VertexBuffer::Retention::NONE);
+    m_render_ptr->uploadBuffer(m_shadow_casters.getVertexBuffer());
+
+    // all meshes are placed with identity transforms, object bounds are the world bounds
+    AABB const object_bounds[] = {m_pyramid.getBounds(), m_plane.getBounds(), m_sphere.getBounds()};
+    static_assert(sizeof(object_bounds) / sizeof(AABB) == static_cast<size_t>(SceneObject::QUANTITY));
+    m_scene_bvh.build(object_bounds, static_cast<uint32_t>(SceneObject::QUANTITY));
+    m_occlusion_queries.resize(static_cast<uint32_t>(SceneObject::QUANTITY));
+
+    m_pyramid_bvh.build(m_pyramid);
+    m_plane_bvh.build(m_plane);
+    m_sphere_bvh.build(m_sphere);
+    m_picker.setObject(static_cast<uint32_t>(SceneObject::PYRAMID), &m_pyramid_bvh, glm::mat4(1.0f));
+    m_picker.setObject(static_cast<uint32_t>(SceneObject::PLANE), &m_plane_bvh, glm::mat4(1.0f));
+    m_picker.setObject(static_cast<uint32_t>(SceneObject::SPHERE), &m_sphere_bvh, glm::mat4(1.0f));
+
+    // the big closed meshes hide what is behind them, the sphere is only tested
+    m_occlusion_culler.addOccluder(m_pyramid, glm::mat4(1.0f));
+    m_occlusion_culler.addOccluder(m_plane, glm::mat4(1.0f));
+
+    // create textures, the files are decoded in parallel
+    TextureBatchLoader loader;
+    loader.add(m_second_texture, diffuse_tex_fname);
+    loader.add(m_base_texture, base_tex_fname);
+    loader.add(m_decal_texture, decal_tex_fname);
+    loader.addCubeMap(m_cube_map_texture, cube_map_names);
+    bool const loaded = loader.load(*m_render_ptr);
+
+    m_pixel_ring.init(*m_render_ptr);
+    m_readbacks.init(*m_render_ptr);
+
+    // the marble texture isn't needed for the first frames, it shows the default texture until it arrives
+    m_texture_streamer.load(m_marble_texture, marble_tex_fname, [](Texture &, bool loaded) {
+        if(!loaded)
+            throw std::runtime_error(std::string("Texture not found: ") + marble_tex_fname);
+    });
+
+    for(auto const & timing : loader.getTimings())
+        if(!loaded && !timing.loaded)
+            throw std::runtime_error("Texture not found: " + timing.file_name);
+}
+
+void Window::cullObjects()
+{
+    m_visible_objects.clear();
+    m_scene_bvh.query(m_render_ptr->getFrustum(), m_visible_objects, m_cull_scratch);
+    if(!m_sphere_uploaded)
+        m_visible_objects.erase(std::remove(m_visible_objects.begin(), m_visible_objects.end(),
+                                            static_cast<uint32_t>(SceneObject::SPHERE)),
+                                m_visible_objects.end());
+
+    m_object_visible.assign(static_cast<uint32_t>(SceneObject::QUANTITY), 0);
+    for(auto const index : m_visible_objects)
+        m_object_visible[index] = 1;
+}
+
+void Window::cullOccludedObjects()
+{
+    m_occlusion_culler.render(m_render_ptr->getMatrix(RendererBase::MatrixType::PROJECTION)
+                              * m_render_ptr->getMatrix(RendererBase::MatrixType::MODELVIEW));
+
+    // an occluder passes its own depth test, so occluders are never culled by themselves
+    for(auto const index : m_visible_objects)
+    {
+        if(!m_occlusion_culler.isVisible(m_scene_bvh.getBounds(index)))
+            m_object_visible[index] = 0;
+    }
+
+    auto const hidden = [this](uint32_t index) { return m_object_visible[index] == 0; };
+    m_visible_objects.erase(std::remove_if(m_visible_objects.begin(), m_visible_objects.end(), hidden),
+                            m_visible_objects.end());
+}
+
+void Window::applyOcclusionQueries()
+{
+    m_occlusion_queries.beginFrame(*m_render_ptr);
+
+    // no queries are issued for the objects out of view, they must not stay occluded until they are back
+    for(uint32_t index = 0; index < m_object_visible.size(); ++index)
+    {
+        if(m_object_visible[index] == 0)
+            m_occlusion_queries.forget(index);
+    }
+
+    for(auto const index : m_visible_objects)
+    {
+        if(!m_occlusion_queries.isVisible(index))
+            m_object_visible[index] = 0;
+    }
+}
+
+void Window::issueOcclusionQueries()
+{
+    // every object that passed the CPU tests, so the hidden ones can come back
+    for(auto const index : m_visible_objects)
+        m_occlusion_queries.issue(*m_render_ptr, index, m_scene_bvh.getBounds(index));
+}
+
+void Window::drawSatellites(float time)
+{
+    // the batcher decides from its timings whether one merged draw beats a draw per copy
+    m_satellites.begin();
+    for(uint32_t i = 0; i < g_num_satellites; ++i)
+    {
+        float const angle =
+            time * 0.5f + glm::radians(360.0f) * static_cast<float>(i) / static_cast<float>(g_num_satellites);
+
+        glm::mat4 model = glm::rotate(glm::mat4(1.0f), angle, {0.0f, 1.0f, 0.0f});
+        model           = glm::translate(model, {g_satellite_orbit, g_satellite_height, 0.0f});
+        model           = glm::rotate(model, time * 2.0f, {0.0f, 1.0f, 0.0f});
+        model           = glm::scale(model, glm::vec3(g_satellite_scale));
+        m_satellites.add(m_pyramid, model);
+    }
+
+    m_satellites.flush(*m_render_ptr, m_render_ptr->getMatrix(RendererBase::MatrixType::MODELVIEW));
+}
+
+void Window::addMainPassSlots(SceneObject obj)
+{
+    TextureSlot slot;
+    switch(obj)
+    {
+        case SceneObject::PYRAMID:
+        {
+            slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
+            slot.tex_channel_num   = 0;
+            slot.texture           = &m_base_texture;
+            slot.projector         = nullptr;
+            slot.combine_mode.mode = CombineStage::CombineMode::MODULATE;
+            m_render_ptr->addTextureSlot(slot);
+            slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
+            slot.tex_channel_num   = 1;
+            slot.texture           = &m_render_texture;
+            slot.projector         = nullptr;
+            slot.combine_mode.mode = CombineStage::CombineMode::DECAL;
+            m_render_ptr->addTextureSlot(slot);
+            slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
+            slot.texture           = nullptr;
+            slot.projector         = &m_decal_prj;
+            slot.combine_mode.mode = CombineStage::CombineMode::DECAL;
+            m_render_ptr->addTextureSlot(slot);
+            slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
+            slot.texture           = nullptr;
+            slot.projector         = &m_cube_map_prj;
+            slot.combine_mode.mode = CombineStage::CombineMode::MODULATE;
+            m_render_ptr->addTextureSlot(slot);
+            break;
+        }
+        case SceneObject::PLANE:
+        {
+            slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
+            slot.tex_channel_num   = 0;
+            slot.texture           = &m_marble_texture;
+            slot.projector         = nullptr;
+            slot.combine_mode.mode = CombineStage::CombineMode::MODULATE;
+            m_render_ptr->addTextureSlot(slot);
 
-    // create textures
-    if(!m_second_texture.loadImageDataFromFile(diffuse_tex_fname, *m_render_ptr))
-        throw std::runtime_error("Texture not found");
+            CombineStage blend_combine;
+            blend_combine.mode           = CombineStage::CombineMode::COMBINE;
+            blend_combine.rgb_func       = CombineStage::CombineFunctions::MODULATE;
+            blend_combine.alpha_func     = CombineStage::CombineFunctions::INTERPOLATE;
+            blend_combine.rgb_src0       = CombineStage::SrcType::PREVIOUS;
+            blend_combine.rgb_src1       = CombineStage::SrcType::TEXTURE;
+            blend_combine.rgb_src2       = CombineStage::SrcType::TEXTURE;
+            blend_combine.alpha_src0     = CombineStage::SrcType::PREVIOUS;
+            blend_combine.alpha_src1     = CombineStage::SrcType::TEXTURE;
+            blend_combine.alpha_src2     = CombineStage::SrcType::TEXTURE;
+            blend_combine.rgb_operand0   = CombineStage::OperandType::SRC_COLOR;
+            blend_combine.rgb_operand1   = CombineStage::OperandType::SRC_COLOR;
+            blend_combine.rgb_operand2   = CombineStage::OperandType::SRC_ALPHA;
+            blend_combine.alpha_operand0 = CombineStage::OperandType::SRC_ALPHA;
+            blend_combine.alpha_operand1 = CombineStage::OperandType::SRC_ALPHA;
+            blend_combine.alpha_operand2 = CombineStage::OperandType::SRC_ALPHA;
+            slot.coord_source            = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
+            slot.texture                 = nullptr;
+            slot.projector               = &m_reflection_prj;
+            slot.combine_mode            = blend_combine;
+            m_render_ptr->addTextureSlot(slot);
 
-    if(!m_base_texture.loadImageDataFromFile(base_tex_fname, *m_render_ptr))
-        throw std::runtime_error("Texture not found");
+            slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
+            slot.texture           = nullptr;
+            slot.projector         = &m_shadow_prj;
+            slot.combine_mode.mode = CombineStage::CombineMode::MODULATE;
+            m_render_ptr->addTextureSlot(slot);
+            slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
+            slot.texture           = nullptr;
+            slot.projector         = &m_decal_prj;
+            slot.combine_mode.mode = CombineStage::CombineMode::DECAL;
+            m_render_ptr->addTextureSlot(slot);
+            break;
+        }
+        case SceneObject::SPHERE:
+        {
+            auto & slot_ref            = m_render_ptr->getTextureSlot(m_render_ptr->addTextureSlot({}));
+            slot_ref.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
+            slot_ref.tex_channel_num   = 0;
+            slot_ref.texture           = &m_base_texture;
+            slot_ref.combine_mode.mode = CombineStage::CombineMode::MODULATE;
 
-    if(!m_decal_texture.loadImageDataFromFile(decal_tex_fname, *m_render_ptr))
-        throw std::runtime_error("Texture not found");
+            auto const slot_num = m_render_ptr->addTextureSlot({});
+            m_render_ptr->getTextureSlot(slot_num).coord_source =
+                TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
+            m_render_ptr->getTextureSlot(slot_num).projector         = &m_decal_prj;
+            m_render_ptr->getTextureSlot(slot_num).combine_mode.mode = CombineStage::CombineMode::DECAL;
+            break;
+        }
+        default:
+            assert(false);
+    }
+}
 
-    if(!m_marble_texture.loadImageDataFromFile(marble_tex_fname, *m_render_ptr))
-        throw std::runtime_error("Texture not found");
+void Window::pickObject()
+{
+    Ray const ray = UnprojectRay(glm::vec2(m_input_ptr->getMousePosition()), m_vp_size,
+                                 m_render_ptr->getMatrix(RendererBase::MatrixType::PROJECTION),
+                                 m_render_ptr->getMatrix(RendererBase::MatrixType::MODELVIEW));
 
-    if(!m_cube_map_texture.loadCubeMapFromFiles(cube_map_names, *m_render_ptr))
-        throw std::runtime_error("Texture not found");
+    m_picked = PickResult();
+    m_picker.pick(m_scene_bvh, ray, m_picked);
 }
 
 void Window::run()
@@ -273,6 +517,8 @@ void Window::run()
     glm::mat4   prj_mtx, mtx;
     TextureSlot slot;
 
+    std::vector<RendererBase::RenderItem> render_items;
+
     do
     {
         m_input_ptr->update();
@@ -294,17 +540,13 @@ void Window::run()
             temp_offset_state.bias          = 4.f;
             m_render_ptr->setOffsetState(temp_offset_state);
 
-            m_render_ptr->bindVertexBuffer(&m_plane);
-            m_render_ptr->draw(m_plane);
-            m_render_ptr->unbindVertexBuffer();
-
-            m_render_ptr->bindVertexBuffer(&m_pyramid);
-            m_render_ptr->draw(m_pyramid);
-            m_render_ptr->unbindVertexBuffer();
-
-            m_render_ptr->bindVertexBuffer(&m_sphere);
-            m_render_ptr->draw(m_sphere);
-            m_render_ptr->unbindVertexBuffer();
+            // the casters are merged into one buffer, so they are culled as a whole
+            if(m_render_ptr->getFrustum().intersects(m_shadow_casters.getVertexBuffer().getBounds()))
+            {
+                m_render_ptr->bindVertexBuffer(&m_shadow_casters.getVertexBuffer());
+                m_shadow_casters.drawAll(*m_render_ptr);
+                m_render_ptr->unbindVertexBuffer();
+            }
 
             m_render_ptr->setOffsetState(old_offset);
 
@@ -321,6 +563,7 @@ void Window::run()
             m_render_ptr->setMatrix(RendererBase::MatrixType::PROJECTION, prj_mtx);
             mtx = glm::translate(glm::mat4(1.0f), {0.0f, 0.0f, -3.0f});
             m_render_ptr->setMatrix(RendererBase::MatrixType::MODELVIEW, mtx);
+            cullObjects();
 
             m_render_ptr->setClearColor(glm::vec4(0.0f, 0.4f, 0.0f, 0.0f));
             m_render_ptr->clearColorBuffer();
@@ -334,11 +577,15 @@ void Window::run()
             slot.projector         = nullptr;
             slot.combine_mode.mode = CombineStage::CombineMode::MODULATE;
             m_render_ptr->addTextureSlot(slot);
-            m_render_ptr->bindSlots();
-            m_render_ptr->bindVertexBuffer(&m_pyramid);
-            m_render_ptr->draw(m_pyramid);
-            m_render_ptr->unbindVertexBuffer();
-            m_render_ptr->unbindAndClearSlots();
+            if(isVisible(SceneObject::PYRAMID))
+            {
+                m_render_ptr->bindSlots();
+                m_render_ptr->bindVertexBuffer(&m_pyramid);
+                m_render_ptr->draw(m_pyramid);
+                m_render_ptr->unbindVertexBuffer();
+                m_render_ptr->unbindSlots();
+            }
+            m_render_ptr->clearSlots();
 
             m_render_ptr->unbindLights();
 
@@ -372,6 +619,7 @@ void Window::run()
                                     m_reflection_prj.getProjectionMatrix());
             m_render_ptr->setMatrix(RendererBase::MatrixType::MODELVIEW,
                                     m_reflection_prj.getModelviewMatrix() * m_reflection_prj.reflection);
+            cullObjects();
 
             auto      old_cull = m_render_ptr->getCullState();
             CullState cull;
@@ -400,11 +648,17 @@ void Window::run()
             slot.projector         = &m_decal_prj;
             slot.combine_mode.mode = CombineStage::CombineMode::DECAL;
             m_render_ptr->addTextureSlot(slot);
-            m_render_ptr->bindSlots();
-            m_render_ptr->bindVertexBuffer(&m_pyramid);
-            m_render_ptr->draw(m_pyramid);
-            m_render_ptr->unbindVertexBuffer();
-            m_render_ptr->unbindAndClearSlots();
+            if(isVisible(SceneObject::PYRAMID))
+            {
+                // the typed buffer feeds units 0 and 1 with channels 0 and 1, as the slots above ask
+                VertexBufferView const view = m_typed_pyramid.view();
+                m_render_ptr->bindSlots();
+                m_render_ptr->bindVertexBuffer(view);
+                m_render_ptr->draw(view);
+                m_render_ptr->unbindVertexBuffer();
+                m_render_ptr->unbindSlots();
+            }
+            m_render_ptr->clearSlots();
 
             slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
             slot.tex_channel_num   = 0;
@@ -418,11 +672,15 @@ void Window::run()
             slot.combine_mode.mode = CombineStage::CombineMode::DECAL;
             m_render_ptr->addTextureSlot(slot);
 
-            m_render_ptr->bindSlots();
-            m_render_ptr->bindVertexBuffer(&m_plane);
-            m_render_ptr->draw(m_plane);
-            m_render_ptr->unbindVertexBuffer();
-            m_render_ptr->unbindAndClearSlots();
+            if(isVisible(SceneObject::PLANE))
+            {
+                m_render_ptr->bindSlots();
+                m_render_ptr->bindVertexBuffer(&m_plane);
+                m_render_ptr->draw(m_plane);
+                m_render_ptr->unbindVertexBuffer();
+                m_render_ptr->unbindSlots();
+            }
+            m_render_ptr->clearSlots();
 
             auto & slot_ref            = m_render_ptr->getTextureSlot(m_render_ptr->addTextureSlot({}));
             slot_ref.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
@@ -436,16 +694,19 @@ void Window::run()
             m_render_ptr->getTextureSlot(slot_num).projector         = &m_decal_prj;
             m_render_ptr->getTextureSlot(slot_num).combine_mode.mode = CombineStage::CombineMode::DECAL;
 
-            m_render_ptr->bindSlots();
-            m_render_ptr->bindVertexBuffer(&m_sphere);
-            m_render_ptr->draw(m_sphere);
-            m_render_ptr->unbindVertexBuffer();
-            m_render_ptr->unbindAndClearSlots();
+            if(isVisible(SceneObject::SPHERE))
+            {
+                m_render_ptr->bindSlots();
+                m_render_ptr->bindVertexBuffer(&m_sphere);
+                m_render_ptr->draw(m_sphere);
+                m_render_ptr->unbindVertexBuffer();
+                m_render_ptr->unbindSlots();
+            }
+            m_render_ptr->clearSlots();
 
             m_render_ptr->unbindLights();
 
-            AABB test_box({-1.f, -1.f, -1.f}, {1.f, 1.f, 1.f});
-            m_render_ptr->drawBBox(test_box, glm::mat4(1.f), {1.0f, 0.0f, 0.0f});
+            m_render_ptr->drawBBox(m_sphere.getBounds(), glm::mat4(1.f), {1.0f, 0.0f, 0.0f});
 
             m_render_ptr->disableClipPlane(0);
             m_render_ptr->setCullState(old_cull);
@@ -458,12 +719,14 @@ void Window::run()
 
         if(once)
         {
-            tex::ImageData image;
-
-            m_render_ptr->get2DTextureData(m_reflection_texture, image);
-            tex::WriteTGA("reflection.tga", image);
-
-            once = false;
+            // written a frame or two later, when the copy has reached the pack buffer; a lost copy is
+            // read again
+            once = !m_readbacks.read(*m_render_ptr, m_reflection_texture, [&once](tex::ImageData & image) {
+                if(image.pixels() != nullptr)
+                    tex::WriteTGA("reflection.tga", image);
+                else
+                    once = true;
+            });
         }
 
         //         Render scene:
@@ -485,105 +748,48 @@ void Window::run()
                              static_cast<float>(m_vp_size.x) / static_cast<float>(m_vp_size.y), 0.1f, 100.0f);
         m_render_ptr->setMatrix(RendererBase::MatrixType::PROJECTION, prj_mtx);
         m_render_ptr->setMatrix(RendererBase::MatrixType::MODELVIEW, m_reflection_prj.getModelviewMatrix());
+        cullObjects();
+        cullOccludedObjects();
+        applyOcclusionQueries();
+        if(m_input_ptr->getMouseButton(Buttons::Button_0))
+            pickObject();
 
         m_render_ptr->bindLights();
 
-        slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
-        slot.tex_channel_num   = 0;
-        slot.texture           = &m_base_texture;
-        slot.projector         = nullptr;
-        slot.combine_mode.mode = CombineStage::CombineMode::MODULATE;
-        m_render_ptr->addTextureSlot(slot);
-        slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
-        slot.tex_channel_num   = 1;
-        slot.texture           = &m_render_texture;
-        slot.projector         = nullptr;
-        slot.combine_mode.mode = CombineStage::CombineMode::DECAL;
-        m_render_ptr->addTextureSlot(slot);
-        slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
-        slot.texture           = nullptr;
-        slot.projector         = &m_decal_prj;
-        slot.combine_mode.mode = CombineStage::CombineMode::DECAL;
-        m_render_ptr->addTextureSlot(slot);
-        slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
-        slot.texture           = nullptr;
-        slot.projector         = &m_cube_map_prj;
-        slot.combine_mode.mode = CombineStage::CombineMode::MODULATE;
-        m_render_ptr->addTextureSlot(slot);
-        m_render_ptr->bindSlots();
-        m_render_ptr->bindVertexBuffer(&m_pyramid);
-        m_render_ptr->draw(m_pyramid);
-        m_render_ptr->unbindVertexBuffer();
-        m_render_ptr->unbindAndClearSlots();
+        // one render item per visible object, the material of an item is its SceneObject value
+        VertexBuffer const * const meshes[] = {&m_pyramid, &m_plane, &m_sphere};
+        render_items.clear();
+        for(uint32_t i = 0; i < static_cast<uint32_t>(SceneObject::QUANTITY); ++i)
+        {
+            if(m_object_visible[i] != 0)
+                render_items.push_back({meshes[i], i, {0, meshes[i]->getNumIndices()}});
+        }
+
+        m_render_ptr->resetSubmitStats();
+        m_render_ptr->submit(render_items.data(), static_cast<uint32_t>(render_items.size()),
+                             [this](RendererBase &, uint32_t material_id) {
+                                 addMainPassSlots(static_cast<SceneObject>(material_id));
+                             });
 
         slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
         slot.tex_channel_num   = 0;
-        slot.texture           = &m_marble_texture;
+        slot.texture           = &m_second_texture;
         slot.projector         = nullptr;
         slot.combine_mode.mode = CombineStage::CombineMode::MODULATE;
         m_render_ptr->addTextureSlot(slot);
-
-        CombineStage blend_combine;
-        blend_combine.mode           = CombineStage::CombineMode::COMBINE;
-        blend_combine.rgb_func       = CombineStage::CombineFunctions::MODULATE;
-        blend_combine.alpha_func     = CombineStage::CombineFunctions::INTERPOLATE;
-        blend_combine.rgb_src0       = CombineStage::SrcType::PREVIOUS;
-        blend_combine.rgb_src1       = CombineStage::SrcType::TEXTURE;
-        blend_combine.rgb_src2       = CombineStage::SrcType::TEXTURE;
-        blend_combine.alpha_src0     = CombineStage::SrcType::PREVIOUS;
-        blend_combine.alpha_src1     = CombineStage::SrcType::TEXTURE;
-        blend_combine.alpha_src2     = CombineStage::SrcType::TEXTURE;
-        blend_combine.rgb_operand0   = CombineStage::OperandType::SRC_COLOR;
-        blend_combine.rgb_operand1   = CombineStage::OperandType::SRC_COLOR;
-        blend_combine.rgb_operand2   = CombineStage::OperandType::SRC_ALPHA;
-        blend_combine.alpha_operand0 = CombineStage::OperandType::SRC_ALPHA;
-        blend_combine.alpha_operand1 = CombineStage::OperandType::SRC_ALPHA;
-        blend_combine.alpha_operand2 = CombineStage::OperandType::SRC_ALPHA;
-        slot.coord_source            = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
-        slot.texture                 = nullptr;
-        slot.projector               = &m_reflection_prj;
-        slot.combine_mode            = blend_combine;
-        m_render_ptr->addTextureSlot(slot);
-
-        slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
-        slot.texture           = nullptr;
-        slot.projector         = &m_shadow_prj;
-        slot.combine_mode.mode = CombineStage::CombineMode::MODULATE;
-        m_render_ptr->addTextureSlot(slot);
-        slot.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
-        slot.texture           = nullptr;
-        slot.projector         = &m_decal_prj;
-        slot.combine_mode.mode = CombineStage::CombineMode::DECAL;
-        m_render_ptr->addTextureSlot(slot);
-
         m_render_ptr->bindSlots();
-        m_render_ptr->bindVertexBuffer(&m_plane);
-        m_render_ptr->draw(m_plane);
-        m_render_ptr->unbindVertexBuffer();
-        m_render_ptr->unbindAndClearSlots();
-
-        auto & slot_ref            = m_render_ptr->getTextureSlot(m_render_ptr->addTextureSlot({}));
-        slot_ref.coord_source      = TextureSlot::TexCoordSource::TEX_COORD_BUFFER;
-        slot_ref.tex_channel_num   = 0;
-        slot_ref.texture           = &m_base_texture;
-        slot_ref.combine_mode.mode = CombineStage::CombineMode::MODULATE;
-
-        auto const slot_num = m_render_ptr->addTextureSlot({});
-        m_render_ptr->getTextureSlot(slot_num).coord_source =
-            TextureSlot::TexCoordSource::TEX_COORD_GENERATED;
-        m_render_ptr->getTextureSlot(slot_num).projector         = &m_decal_prj;
-        m_render_ptr->getTextureSlot(slot_num).combine_mode.mode = CombineStage::CombineMode::DECAL;
-
-        m_render_ptr->bindSlots();
-        m_render_ptr->bindVertexBuffer(&m_sphere);
-        m_render_ptr->draw(m_sphere);
-        m_render_ptr->unbindVertexBuffer();
-        m_render_ptr->unbindAndClearSlots();
+        drawSatellites(static_cast<float>(glfwGetTime()));
+        m_render_ptr->unbindSlots();
+        m_render_ptr->clearSlots();
 
         m_render_ptr->unbindLights();
 
-        AABB test_box({-1.f, -1.f, -1.f}, {1.f, 1.f, 1.f});
-        m_render_ptr->drawBBox(test_box, glm::mat4(1.f), {1.0f, 0.0f, 0.0f});
+        issueOcclusionQueries();
+
+        m_render_ptr->drawBBox(m_sphere.getBounds(), glm::mat4(1.f), {1.0f, 0.0f, 0.0f});
+        if(m_picked.object != BVH::null_index)
+            m_render_ptr->drawBBox(m_scene_bvh.getBounds(m_picked.object), glm::mat4(1.f),
+                                   {0.0f, 1.0f, 0.0f});
 
         m_render_ptr->setIdentityMatrix(RendererBase::MatrixType::MODELVIEW);
 
@@ -591,6 +797,11 @@ void Window::run()
         glfwSwapBuffers(mp_glfw_win);
         glfwPollEvents();
 
+        GetJobSystem().processMainThreadJobs();
+        m_texture_streamer.update(*m_render_ptr);
+        m_uploads.update(*m_render_ptr);
+        m_readbacks.update(*m_render_ptr);
+
         if(m_input_ptr->isKeyPressed(KeyboardKey::Key_F1))
             key_f1();
     }   // Check if the ESC key was pressed or the window was closed
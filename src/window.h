@@ -7,8 +7,18 @@
 #include <glm/glm.hpp>
 
 #include "input/input.h"
+#include "render/bvh.h"
+#include "render/dynamic_batch.h"
+#include "render/occlusion_culler.h"
+#include "render/occlusion_queries.h"
+#include "render/scene_picker.h"
 #include "render/vertex_buffer.h"
+#include "render/static_batch.h"
+#include "render/pixel_upload_ring.h"
+#include "render/readback_ring.h"
 #include "render/texture.h"
+#include "render/texture_streamer.h"
+#include "render/upload_scheduler.h"
 
 class GLFWvidmode;
 class GLFWwindow;
@@ -16,6 +26,14 @@ class RendererBase;
 
 class Window
 {
+    enum class SceneObject : uint32_t
+    {
+        PYRAMID,
+        PLANE,
+        SPHERE,
+        QUANTITY
+    };
+
     // window state
     bool                m_is_fullscreen    = false;
     GLFWvidmode const * mp_base_video_mode = nullptr;
@@ -29,8 +47,12 @@ class Window
 
     // Scene
     VertexBuffer     m_pyramid;
+    VertexBufferPNT2 m_typed_pyramid;   // interleaved copy for the reflection pass
     VertexBuffer     m_plane;
-    VertexBuffer     m_sphere;
+    VertexBuffer     m_sphere;   // streamed in through m_uploads, not drawn until it is there
+    bool             m_sphere_uploaded = false;
+    StaticBatch      m_shadow_casters;   // all static meshes merged for the depth only shadow pass
+    DynamicBatcher   m_satellites;       // small pyramids circling the scene, rebuilt every frame
     Texture          m_render_texture;
     Texture          m_base_texture;
     Texture          m_second_texture;
@@ -39,12 +61,42 @@ class Window
     Texture          m_shadow_texture;
     Texture          m_reflection_texture;
     Texture          m_cube_map_texture;
+    PixelUploadRing  m_pixel_ring;
+    UploadScheduler  m_uploads;   // streamed content, a few ms per frame
+    TextureStreamer  m_texture_streamer;
+    ReadbackRing     m_readbacks;
     TextureProjector m_decal_prj;
     TextureProjector m_shadow_prj;
     TextureProjector m_reflection_prj;
     TextureProjector m_cube_map_prj;
     Light            m_light;
 
+    // Culling
+    BVH                   m_scene_bvh;   // world space bounds, object ids are SceneObject values
+    OcclusionCuller       m_occlusion_culler;    // occluders seen from the main camera
+    OcclusionQueries      m_occlusion_queries;   // main pass only, the results belong to one camera
+    BVH::FrustumScratch   m_cull_scratch;
+    std::vector<uint32_t> m_visible_objects;
+    std::vector<uint8_t>  m_object_visible;
+
+    void cullObjects();   // against the frustum of the current render matrices
+    void cullOccludedObjects();   // main camera only, the mirror plane would hide the reflected scene
+    void applyOcclusionQueries();   // hides the objects the last query results found occluded
+    void issueOcclusionQueries();   // after the visible objects are drawn
+    bool isVisible(SceneObject obj) const { return m_object_visible[static_cast<uint32_t>(obj)] != 0; }
+
+    void addMainPassSlots(SceneObject obj);   // the material of the object in the main pass
+    void drawSatellites(float time);   // main pass, with the texture slots bound
+
+    // Picking
+    MeshBVH     m_pyramid_bvh;
+    MeshBVH     m_plane_bvh;
+    MeshBVH     m_sphere_bvh;
+    ScenePicker m_picker;
+    PickResult  m_picked;
+
+    void pickObject();   // under the mouse cursor, through the current render matrices
+
 public:
     Window(int width, int height, char const * title);
     ~Window();